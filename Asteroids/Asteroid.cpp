@@ -2,6 +2,7 @@
 #include "Asteroid.h"
 #include "Components.h"
 #include "Gamestate.h"
+#include "Random.h"
 
 // collision tags
 const uint16_t Asteroid::DefaultCollisionTagsSelf{ 0b0110000000000000 };
@@ -33,36 +34,11 @@ Asteroid::Asteroid(const Asteroid& other) : GameObject(other)
     m_YDrift = other.m_YDrift;
     m_Size = other.m_Size;
 }
-void Asteroid::Update(float deltaTime)
+void Asteroid::InitialiseEntity(EntityChunk& chunk, int row)
 {
-    if (!m_Active) return;
-    // update position, then check if off screen, if so wrap
-    // check lifetime since asteroids start off screen, so let them move in before wrap checking
-    sf::Vector2f newPos = m_Position + sf::Vector2f(m_XDrift * deltaTime, m_YDrift * deltaTime);
-    if (m_Lifetime > 3)
-    {
-        if (newPos.x < 0)
-        {
-            newPos.x += SCREEN_WIDTH;
-        }
-        else if (newPos.x > SCREEN_WIDTH)
-        {
-            newPos.x -= SCREEN_WIDTH;
-        }
-        if (newPos.y < 0)
-        {
-            newPos.y += SCREEN_HEIGHT;
-        }
-        else if (newPos.y > SCREEN_HEIGHT)
-        {
-            newPos.y -= SCREEN_HEIGHT;
-        }
-    }
-    // update the relevant members and then collision grid
-    m_Position = newPos;
-    m_Rotation += m_RotationSpeed * deltaTime;
-    m_Lifetime += deltaTime;
-    GetComponent<CollisionComponent>()->UpdateInCollisionGrid();
+    chunk.VelX[row] = m_XDrift;
+    chunk.VelY[row] = m_YDrift;
+    chunk.Spin[row] = m_RotationSpeed;
 }
 
 void Asteroid::Split()
@@ -80,7 +56,7 @@ void Asteroid::Split()
         break;
     }
     Gamestate::instance->AddScore(m_Score);
-    Gamestate::instance->AddToCleanupObjects(GetComponent<CollisionComponent>()->GetParentSharedPtr());
+    Gamestate::instance->AddToCleanupObjects(GetHandle());
 }
 
 void Asteroid::SpawnMediums() const
@@ -88,20 +64,20 @@ void Asteroid::SpawnMediums() const
     float offsetMultiplier = 40;
     sf::Vector2f offset = { std::sin(GetRotation() * TO_RADIANS) * offsetMultiplier, -std::cos(GetRotation() * TO_RADIANS) * offsetMultiplier };
 
-    std::shared_ptr<GameObject> ast = Gamestate::instance->GetPooledObject(AsteroidMediumPoolName);
-    std::shared_ptr<GameObject> ast2 = Gamestate::instance->GetPooledObject(AsteroidMediumPoolName);
-    ast->ReinitialiseObject(offset + m_Position, 0, ast);
-    ast2->ReinitialiseObject(-offset + m_Position, 0, ast2);
+    GameObject* ast = Gamestate::instance->GetPooledObject(AsteroidMediumPoolName);
+    GameObject* ast2 = Gamestate::instance->GetPooledObject(AsteroidMediumPoolName);
+    ast->ReinitialiseObject(offset + GetPosition(), 0);
+    ast2->ReinitialiseObject(-offset + GetPosition(), 0);
 }
 void Asteroid::SpawnSmalls() const
 {
     float offsetMultiplier = 25;
     sf::Vector2f offset = { std::sin(GetRotation() * TO_RADIANS) * offsetMultiplier, -std::cos(GetRotation() * TO_RADIANS) * offsetMultiplier };
 
-    std::shared_ptr<GameObject> ast = Gamestate::instance->GetPooledObject(AsteroidSmallPoolName);
-    std::shared_ptr<GameObject> ast2 = Gamestate::instance->GetPooledObject(AsteroidSmallPoolName);
-    ast->ReinitialiseObject(offset + m_Position, 0, ast);
-    ast2->ReinitialiseObject(-offset + m_Position, 0, ast2);
+    GameObject* ast = Gamestate::instance->GetPooledObject(AsteroidSmallPoolName);
+    GameObject* ast2 = Gamestate::instance->GetPooledObject(AsteroidSmallPoolName);
+    ast->ReinitialiseObject(offset + GetPosition(), 0);
+    ast2->ReinitialiseObject(-offset + GetPosition(), 0);
 }
 void Asteroid::HandleCollision(uint16_t otherTags)
 {
@@ -115,14 +91,14 @@ void Asteroid::HandleCollision(uint16_t otherTags)
 
 void Asteroid::Reinitialise()
 {
-    m_XDrift = m_Position.x > (SCREEN_WIDTH / 2) ? static_cast<float>(random_int(-80, -20)) : static_cast<float>(random_int(20, 80));
-    m_YDrift = m_Position.y > (SCREEN_HEIGHT / 2) ? static_cast<float>(random_int(-80, -20)) : static_cast<float>(random_int(20, 80));
-    m_Lifetime = 0;
+    RandomStream rng = Gamestate::instance->MakeObjectStream(Random::Purpose::AsteroidDrift, *this);
+    m_XDrift = GetPosition().x > (SCREEN_WIDTH / 2) ? static_cast<float>(rng.Int(-80, -20)) : static_cast<float>(rng.Int(20, 80));
+    m_YDrift = GetPosition().y > (SCREEN_HEIGHT / 2) ? static_cast<float>(rng.Int(-80, -20)) : static_cast<float>(rng.Int(20, 80));
 }
-std::shared_ptr<GameObject> Asteroid::CloneToSharedPtr()
+std::unique_ptr<GameObject> Asteroid::CloneToUniquePtr()
 {
-    std::shared_ptr<GameObject> obj = std::make_shared<Asteroid>(*this);
-    obj->CloneComponentsFromOther(obj, this);
+    std::unique_ptr<GameObject> obj = std::make_unique<Asteroid>(*this);
+    obj->CloneComponentsFromOther(this);
     return obj;
 }
 
@@ -10,11 +10,10 @@ enum class AST_SIZE { small, medium, large };
 class Asteroid : public GameObject
 {
 private:
-	// rotation and drift, on creation, drifts inwards on screen
+	// rotation and drift, on creation, drifts inwards on screen - copied into the entity store when the asteroid becomes active
 	float m_RotationSpeed = 40;
 	float m_XDrift = 0;
 	float m_YDrift = 0;
-	float m_Lifetime = 0;
 	const int m_Score = 10;
 	AST_SIZE m_Size = AST_SIZE::large;
 
@@ -30,10 +29,11 @@ public:
 	Asteroid(sf::Texture& _Texture, AST_SIZE _Size);
 	Asteroid(const Asteroid& other);
 	// overrides
-	void Update(float deltaTime) override;
+	EntityArchetype GetArchetype() const override { return EntityArchetype::Asteroid; }
+	void InitialiseEntity(EntityChunk& chunk, int row) override;
 	void HandleCollision(uint16_t otherTags) override;
 	void Reinitialise() override;
-	std::shared_ptr<GameObject> CloneToSharedPtr() override;
+	std::unique_ptr<GameObject> CloneToUniquePtr() override;
 	// called on successful collision with projectile
 	void Split();
 	// large spawns two mediums (retrieve from pool)
@@ -4,15 +4,17 @@
 #include "JobSystem.h"
 #include "Gamestate.h"
 #include <immintrin.h>
+#include <bitset>
 
 ObjectCollisionGrid::ObjectCollisionGrid()
 {
     m_CompletedCollisionsThisFrame.set_lock_style(ReadersWriterLock::LockStyle::M2CV);
+}
+
+void ObjectCollisionGrid::SetThreadCount(int threadCount)
+{
 #if USE_CPU_FOR_OCCLUDERS
-    for (int i = 0; i < PATCH_SIZE * NUM_THREADS * 9; ++i)
-    {
-        m_PixelBufferThread[i] = 0;
-    }
+    m_PixelBufferThread.assign(PATCH_SIZE * threadCount * 9, 0.f);
 #endif
 }
 
@@ -29,12 +31,21 @@ void ObjectCollisionGrid::RemoveObject(uint8_t nodeIndex, int x, int y)
     m_MemoryPool.DeallocateNode(nodeIndex, index);
 }
 
-void ObjectCollisionGrid::ResolveCollisionsOfCells(uintptr_t pData)
+float ObjectCollisionGrid::EstimateCellCost(int startCell, int endCell) const
 {
-    JobData_Ints* data = reinterpret_cast<JobData_Ints*>(pData);
-    int cellEndIndex = data->end;
+    // each cell costs a little even when empty, plus one per pair of nodes in it
+    float cost = 0.f;
+    for (int cellIndex = startCell; cellIndex < endCell; ++cellIndex)
+    {
+        int nodes = static_cast<int>(std::bitset<32>(m_MemoryPool.GetBitArray(cellIndex)).count());
+        cost += 1.f + nodes * (nodes - 1) * 0.5f;
+    }
+    return cost;
+}
 
-    for (int cellIndex = data->start; cellIndex <= cellEndIndex; ++cellIndex)
+void ObjectCollisionGrid::ResolveCollisionsOfCells(int startCell, int endCell)
+{
+    for (int cellIndex = startCell; cellIndex < endCell; ++cellIndex)
     {
 #if USE_CPU_FOR_OCCLUDERS
         int x = ((cellIndex % GRID_RESOLUTION) * SCREEN_WIDTH) / GRID_RESOLUTION;
@@ -74,7 +85,7 @@ void ObjectCollisionGrid::ResolveCollisionsOfCells(uintptr_t pData)
                 int y = cellIndex / GRID_RESOLUTION;
 
                 // each thread owns part of m_PixelBufferThread which it uses for preparing the pixel coords for point in polygon checks
-                float* xStart = m_PixelBufferThread + ThreadIndex * PATCH_SIZE * 9;
+                float* xStart = m_PixelBufferThread.data() + ThreadIndex * PATCH_SIZE * 9;
                 float* yStart = xStart + PATCH_SIZE;
 
                 float xPos = static_cast<float>(x * SCREEN_WIDTH) / GRID_RESOLUTION;
@@ -206,10 +217,8 @@ uint8_t NodeMemoryPool::AllocateNode(int index, GameObject* obj, uint16_t selfMa
     if (InUseBitArray[index] == 0xFFFFFFFF) return 255;
     Node* startNode = Memory + index * NUMBER_OF_NODES;
 
-    if (Gamestate::instance->GetPhaseIndex() == 3)
-    {
-        startNode = 0;
-    }
+    // the grid is only read while collisions are resolved, nothing should be inserting then
+    assert(!Gamestate::instance->IsResolvingCollisions());
 
     uint32_t bitArray = InUseBitArray[index].load();
     for (int i = 0; i < 32; ++i)
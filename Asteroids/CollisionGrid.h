@@ -50,15 +50,19 @@ private:
     thread_safe_set<std::pair<int,int>> m_CompletedCollisionsThisFrame;
 #if USE_CPU_FOR_OCCLUDERS
     // store 8 duplicates of the y values and 1 of each x, faster load into mm256
-    float m_PixelBufferThread[PATCH_SIZE * NUM_THREADS * 9];
+    std::vector<float> m_PixelBufferThread;
 #endif
 public:
     ObjectCollisionGrid();
+    // sizes the per-thread scratch space, call before any collision job runs
+    void SetThreadCount(int threadCount);
     // insertion/removal
     uint8_t InsertObject(GameObject* obj, int x, int y, uint16_t selfMask, uint16_t otherMask);
     void RemoveObject(uint8_t nodeIndex, int x, int y);
-    // job: checks for collisions in a range specified by pData
-    void ResolveCollisionsOfCells(uintptr_t pData);
+    // parallel loop body: checks for collisions in cells [startCell, endCell)
+    void ResolveCollisionsOfCells(int startCell, int endCell);
+    // cost hint for the above, based on the number of pairs to check in each cell
+    float EstimateCellCost(int startCell, int endCell) const;
     // job: clears m_CompletedCollisionsThisFrame during cleanup phase
     void ClearFrameCollisionPairs(uintptr_t unused);
 };
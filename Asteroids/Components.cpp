@@ -12,10 +12,6 @@ const float CollisionComponent::CELL_SIZE_Y = SCREEN_HEIGHT / GRID_RESOLUTION;
 
 ComponentIdCounter Component::IdCounter{};
 
-std::shared_ptr<GameObject> Component::GetParentSharedPtr()
-{
-	return m_pWeakParent.lock();
-}
 sf::Vector2f CollisionComponent::GetPos()
 {
 	return m_ParentObject->GetPosition();
@@ -25,135 +21,64 @@ float CollisionComponent::GetRot()
 	return m_ParentObject->GetRotation();
 }
 
-std::unique_ptr<Component> CircleCollisionComponent::CloneToUniquePtr(std::shared_ptr<GameObject>& parent)
+std::unique_ptr<Component> CircleCollisionComponent::CloneToUniquePtr(GameObject* parent)
 {
 	return std::make_unique<CircleCollisionComponent>(*this, parent);
 }
-std::unique_ptr<Component> BoxCollisionComponent::CloneToUniquePtr(std::shared_ptr<GameObject>& parent)
+std::unique_ptr<Component> BoxCollisionComponent::CloneToUniquePtr(GameObject* parent)
 {
 	return std::make_unique<BoxCollisionComponent>(*this, parent);
 }
-std::unique_ptr<Component> PolygonCollisionComponent::CloneToUniquePtr(std::shared_ptr<GameObject>& parent)
+std::unique_ptr<Component> PolygonCollisionComponent::CloneToUniquePtr(GameObject* parent)
 {
 	return std::make_unique<PolygonCollisionComponent>(*this, parent);
 }
-std::unique_ptr<Component> PooledObjectComponent::CloneToUniquePtr(std::shared_ptr<GameObject>& parent)
+std::unique_ptr<Component> PooledObjectComponent::CloneToUniquePtr(GameObject* parent)
 {
 	return std::make_unique<PooledObjectComponent>(*this, parent);
 }
 
-Component::Component(const Component& other, std::shared_ptr<GameObject>& parent)
+Component::Component(const Component& other, GameObject* parent)
 {
-	m_ParentObject = parent.get();
-	m_pWeakParent = parent;
+	m_ParentObject = parent;
 }
-CollisionComponent::CollisionComponent(const CollisionComponent& other, std::shared_ptr<GameObject>& parent) : Component(other, parent)
+CollisionComponent::CollisionComponent(const CollisionComponent& other, GameObject* parent) : Component(other, parent)
 {
 	m_CollisionTagsSelf = other.m_CollisionTagsSelf;
 	m_CollisionTagsOther = other.m_CollisionTagsOther;
 }
-CircleCollisionComponent::CircleCollisionComponent(const CircleCollisionComponent& other, std::shared_ptr<GameObject>& parent) : CollisionComponent(other, parent)
+CircleCollisionComponent::CircleCollisionComponent(const CircleCollisionComponent& other, GameObject* parent) : CollisionComponent(other, parent)
 {
 	m_Radius = other.m_Radius;
 }
-BoxCollisionComponent::BoxCollisionComponent(const BoxCollisionComponent& other, std::shared_ptr<GameObject>& parent) : CollisionComponent(other, parent)
+BoxCollisionComponent::BoxCollisionComponent(const BoxCollisionComponent& other, GameObject* parent) : CollisionComponent(other, parent)
 {
 	m_HalfWidth = other.m_HalfWidth;
 	m_HalfHeight = other.m_HalfHeight;
 }
-PolygonCollisionComponent::PolygonCollisionComponent(const PolygonCollisionComponent& other, std::shared_ptr<GameObject>& parent) : CollisionComponent(other, parent)
+PolygonCollisionComponent::PolygonCollisionComponent(const PolygonCollisionComponent& other, GameObject* parent) : CollisionComponent(other, parent)
 {
 	m_Vertices = other.m_Vertices;
 	m_CachedPolygon.resize(m_Vertices.size());
 }
-PooledObjectComponent::PooledObjectComponent(const PooledObjectComponent& other, std::shared_ptr<GameObject>& parent) : Component(other, parent)
+PooledObjectComponent::PooledObjectComponent(const PooledObjectComponent& other, GameObject* parent) : Component(other, parent)
 {
 	m_pObjectPool = other.m_pObjectPool;
 }
 
-void PooledObjectComponent::ReturnToPool(std::shared_ptr<GameObject> self)
+void PooledObjectComponent::ReturnToPool()
 {
-	m_pObjectPool->AddToPool(self);
+	m_pObjectPool->AddToPool(m_ParentObject);
 }
 
-void CircleCollisionComponent::MakeBroadPhaseBox(bool& NoChange)
-{
-	auto centre = m_ParentObject->GetPosition();
-
-	m_CurrentPhaseBox.Left =	std::clamp(static_cast<int>((centre.x - m_Radius) / CELL_SIZE_X), 0, GRID_RESOLUTION - 1);
-	m_CurrentPhaseBox.Right =	std::clamp(static_cast<int>((centre.x + m_Radius) / CELL_SIZE_X), 0, GRID_RESOLUTION - 1);
-	m_CurrentPhaseBox.Top =		std::clamp(static_cast<int>((centre.y - m_Radius) / CELL_SIZE_Y), 0, GRID_RESOLUTION - 1);
-	m_CurrentPhaseBox.Bottom =	std::clamp(static_cast<int>((centre.y + m_Radius) / CELL_SIZE_Y), 0, GRID_RESOLUTION - 1);
-
-	NoChange = m_CurrentPhaseBox == m_PreviousPhaseBox;
-}
-
-// works poorly for a rotated long and thin box, otherwise is a reasonable approximation for insertion into collision grid
-void BoxCollisionComponent::MakeBroadPhaseBox(bool& NoChange)
-{
-	float rotation = m_ParentObject->GetRotation() * TO_RADIANS;
-	sf::Vector2f centre = m_ParentObject->GetPosition();
-
-	if (rotation == 0)
-	{
-		m_CurrentPhaseBox.Left =	std::clamp(static_cast<int>((centre.x - m_HalfWidth) / CELL_SIZE_X), 0, GRID_RESOLUTION - 1);
-		m_CurrentPhaseBox.Right =	std::clamp(static_cast<int>((centre.x + m_HalfWidth) / CELL_SIZE_X), 0, GRID_RESOLUTION - 1);
-		m_CurrentPhaseBox.Top =		std::clamp(static_cast<int>((centre.y - m_HalfHeight) / CELL_SIZE_Y), 0, GRID_RESOLUTION - 1);
-		m_CurrentPhaseBox.Bottom =	std::clamp(static_cast<int>((centre.y + m_HalfHeight) / CELL_SIZE_Y), 0, GRID_RESOLUTION - 1);
-
-		NoChange = m_CurrentPhaseBox == m_PreviousPhaseBox;
-	}
-	else
-	{
-		float corners[] = {  - m_HalfWidth, - m_HalfWidth, m_HalfWidth, m_HalfWidth,
-							 - m_HalfHeight, m_HalfHeight, - m_HalfHeight, m_HalfHeight };
-		RotateBox(corners, std::sin(rotation), std::cos(rotation));
-
-		float minX = corners[0];
-		float maxX = minX;
-		float minY = corners[4];
-		float maxY = minY;
-
-		for (int i=1; i<4; ++i)
-		{
-			if (corners[i] > maxX) maxX = corners[i];
-			else if (corners[i] < minX) minX = corners[i];
-			if (corners[i+4] > maxY) maxY = corners[i+4];
-			else if (corners[i+4] < minY) minY = corners[i+4];
-		}
-
-		m_CurrentPhaseBox.Left =	std::clamp(static_cast<int>((centre.x + minX) / CELL_SIZE_X), 0, GRID_RESOLUTION - 1);
-		m_CurrentPhaseBox.Right =	std::clamp(static_cast<int>((centre.x + maxX) / CELL_SIZE_X), 0, GRID_RESOLUTION - 1);
-		m_CurrentPhaseBox.Top =		std::clamp(static_cast<int>((centre.y + minY) / CELL_SIZE_Y), 0, GRID_RESOLUTION - 1);
-		m_CurrentPhaseBox.Bottom =	std::clamp(static_cast<int>((centre.y + maxY) / CELL_SIZE_Y), 0, GRID_RESOLUTION - 1);
-
-		NoChange = m_CurrentPhaseBox == m_PreviousPhaseBox;
-	}
-}
-void PolygonCollisionComponent::MakeBroadPhaseBox(bool& NoChange)
+float PolygonCollisionComponent::GetBoundingRadius() const
 {
-	sf::Vector2f centre = m_ParentObject->GetPosition();
-	GetPolygon();
-
-	float minX = m_CachedPolygon[0].x;
-	float maxX = minX;
-	float minY = m_CachedPolygon[0].y;
-	float maxY = minY;
-
-	for (auto& vert : m_CachedPolygon)
+	float maxLengthSquared = 0;
+	for (auto& vert : m_Vertices)
 	{
-		if (vert.x > maxX) maxX = vert.x;
-		else if (vert.x < minX) minX = vert.x;
-		if (vert.y > maxY) maxY = vert.y;
-		else if (vert.y < minY) minY = vert.y;
+		maxLengthSquared = std::max(maxLengthSquared, vert.lengthSquared());
 	}
-
-	m_CurrentPhaseBox.Left =	std::clamp(static_cast<int>((minX) / CELL_SIZE_X), 0, GRID_RESOLUTION - 1);
-	m_CurrentPhaseBox.Right =	std::clamp(static_cast<int>((maxX) / CELL_SIZE_X), 0, GRID_RESOLUTION - 1);
-	m_CurrentPhaseBox.Top =		std::clamp(static_cast<int>((minY) / CELL_SIZE_Y), 0, GRID_RESOLUTION - 1);
-	m_CurrentPhaseBox.Bottom =	std::clamp(static_cast<int>((maxY) / CELL_SIZE_Y), 0, GRID_RESOLUTION - 1);
-
-	NoChange = m_CurrentPhaseBox == m_PreviousPhaseBox;
+	return std::sqrtf(maxLengthSquared);
 }
 
 // use double dispatch to handle collisions of various derived collision components
@@ -370,59 +295,46 @@ void CollisionComponent::RotateBox(float* coords, float sinAngle, float cosAngle
 	_mm_storeu_ps(coords + 4, y1);
 }
 
-// called in object's update function, if position has changed sufficiently and the object has a new phase box, update its position in the collision grid
+// called by the entity systems when the object's phase box changed (or its tags might have), if either really did, move it in the collision grid
 // store offsets for the nodes in each cell
-void CollisionComponent::UpdateInCollisionGrid()
+void CollisionComponent::UpdateInCollisionGrid(const PhaseBox& box)
 {
-	m_PolygonCalculated = false;
-	bool noChange = !m_bTagsWereUpdated;
-	if (m_bTagsWereUpdated) m_bTagsWereUpdated = false;
-
-	auto pos = GetPos();
-	auto rot = GetRot();
-	if (abs(pos.x - m_LastUpdatedX) < .1f && abs(pos.y - m_LastUpdatedY) < .1f && abs(rot - m_LastUpdatedRot) < .1f && noChange)
+	if (!m_bTagsWereUpdated && !m_CollisionGridNodeIndices.empty() && m_PreviousPhaseBox == box)
 	{
 		return;
 	}
+	m_bTagsWereUpdated = false;
 
-	m_LastUpdatedX = pos.x;
-	m_LastUpdatedY = pos.y;
-	m_LastUpdatedRot = rot;
-	MakeBroadPhaseBox(noChange);
-
-	if (!noChange)
+	if (m_CollisionGridNodeIndices.size() > 0)
 	{
-		if (m_CollisionGridNodeIndices.size() > 0)
+		int boxSize = m_PreviousPhaseBox.Right - m_PreviousPhaseBox.Left + 1;
+		for (int i = m_PreviousPhaseBox.Top; i <= m_PreviousPhaseBox.Bottom; ++i)
 		{
-			int boxSize = m_PreviousPhaseBox.Right - m_PreviousPhaseBox.Left + 1;
-			for (int i = m_PreviousPhaseBox.Top; i <= m_PreviousPhaseBox.Bottom; ++i)
+			for (int j = m_PreviousPhaseBox.Left; j <= m_PreviousPhaseBox.Right; ++j)
 			{
-				for (int j = m_PreviousPhaseBox.Left; j <= m_PreviousPhaseBox.Right; ++j)
-				{
-					Gamestate::instance->RemoveFromCollisionGrid(m_CollisionGridNodeIndices[(i - m_PreviousPhaseBox.Top) * boxSize + j - m_PreviousPhaseBox.Left], j, i);
-				}
+				Gamestate::instance->RemoveFromCollisionGrid(m_CollisionGridNodeIndices[(i - m_PreviousPhaseBox.Top) * boxSize + j - m_PreviousPhaseBox.Left], j, i);
 			}
 		}
+	}
 
-		uint16_t selfTag = m_CollisionTagsSelf;
-		// use the last bit to signify whether the object exists in more than one cell in the grid to save on checks for duplicate concurrent collisions
-		if (m_CurrentPhaseBox.Bottom != m_CurrentPhaseBox.Top || m_CurrentPhaseBox.Right != m_CurrentPhaseBox.Left)
-		{
-			selfTag |= 0b01;
-		}
+	uint16_t selfTag = m_CollisionTagsSelf;
+	// use the last bit to signify whether the object exists in more than one cell in the grid to save on checks for duplicate concurrent collisions
+	if (box.Bottom != box.Top || box.Right != box.Left)
+	{
+		selfTag |= 0b01;
+	}
 
-		uint16_t selfTagEdge = selfTag | 0b10;
-		m_NewGridIndices.clear();
-		for (int i = m_CurrentPhaseBox.Top; i <= m_CurrentPhaseBox.Bottom; ++i)
+	uint16_t selfTagEdge = selfTag | 0b10;
+	m_NewGridIndices.clear();
+	for (int i = box.Top; i <= box.Bottom; ++i)
+	{
+		for (int j = box.Left; j <= box.Right; ++j)
 		{
-			for (int j = m_CurrentPhaseBox.Left; j <= m_CurrentPhaseBox.Right; ++j)
-			{
-				m_NewGridIndices.push_back(Gamestate::instance->AddToCollisionGrid(m_ParentObject, j, i, (i - m_CurrentPhaseBox.Top <= 1 || i - m_CurrentPhaseBox.Bottom >= -1 || j - m_CurrentPhaseBox.Right <= 1 || j - m_CurrentPhaseBox.Left >= -1) ? selfTagEdge : selfTag, m_CollisionTagsOther));
-			}
+			m_NewGridIndices.push_back(Gamestate::instance->AddToCollisionGrid(m_ParentObject, j, i, (i - box.Top <= 1 || i - box.Bottom >= -1 || j - box.Right <= 1 || j - box.Left >= -1) ? selfTagEdge : selfTag, m_CollisionTagsOther));
 		}
-		m_PreviousPhaseBox = m_CurrentPhaseBox;
-		m_CollisionGridNodeIndices = m_NewGridIndices;
 	}
+	m_PreviousPhaseBox = box;
+	m_CollisionGridNodeIndices = m_NewGridIndices;
 }
 
 void CollisionComponent::ClearFromGrid()
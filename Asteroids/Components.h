@@ -77,24 +77,23 @@ public:
 	}
 };
 
-// extensible component system, stored in a map in each GameObject
+// extensible component system, stored in each GameObject in a slot indexed by the component's id
 class Component
 {
 private:
 	static ComponentIdCounter IdCounter;
 protected:
-	// parent - store raw pointer for quicker access, and weak to give a sharedptr to the object when needed (avoids passing sharedptr everywhere)
-	std::weak_ptr<GameObject> m_pWeakParent;
+	// parent - owns the component, so always outlives it (use the parent's handle to refer to it from anywhere which might not)
 	GameObject* m_ParentObject;
 	template<typename T>
 	static int GetIdOfComponent() { return IdCounter.getId<T>(); }
 public:
 	// construct with parent only (either default or copy constructor)
-	Component(std::shared_ptr<GameObject>& parent) : m_pWeakParent(parent), m_ParentObject(parent.get()) {}
-	Component(const Component& other, std::shared_ptr<GameObject>& parent);
-	std::shared_ptr<GameObject> GetParentSharedPtr();
+	Component(GameObject* parent) : m_ParentObject(parent) {}
+	Component(const Component& other, GameObject* parent);
+	GameObject* GetParent() const { return m_ParentObject; }
 	// clone used when copying a game object
-	virtual std::unique_ptr<Component> CloneToUniquePtr(std::shared_ptr<GameObject>& parent) = 0;
+	virtual std::unique_ptr<Component> CloneToUniquePtr(GameObject* parent) = 0;
 	virtual ~Component() {}
 };
 // for objects which come from a pool and should be returned there - assumes pool's lifetime will always outlast its own
@@ -104,13 +103,13 @@ private:
 	// will return to this pool on inactive
 	ObjectPool* m_pObjectPool;
 public:
-	PooledObjectComponent(const PooledObjectComponent& other, std::shared_ptr<GameObject>& parent);
-	PooledObjectComponent(std::shared_ptr<GameObject>& parent, ObjectPool* pool) : m_pObjectPool(pool), Component(parent) {}
+	PooledObjectComponent(const PooledObjectComponent& other, GameObject* parent);
+	PooledObjectComponent(GameObject* parent, ObjectPool* pool) : m_pObjectPool(pool), Component(parent) {}
 
-	void ReturnToPool(std::shared_ptr<GameObject> self);
+	void ReturnToPool();
 	void SetPool(ObjectPool* pool) { m_pObjectPool = pool; }
 
-	std::unique_ptr<Component> CloneToUniquePtr(std::shared_ptr<GameObject>& parent) override;
+	std::unique_ptr<Component> CloneToUniquePtr(GameObject* parent) override;
 	static int GetId() { return GetIdOfComponent<PooledObjectComponent>(); }
 };
 
@@ -125,18 +124,12 @@ protected:
 	static const float CELL_SIZE_X;
 	static const float CELL_SIZE_Y;
 
-	// Position and rotation tracking
-	float m_LastUpdatedX=0;
-	float m_LastUpdatedY=0;
-	float m_LastUpdatedRot=0;
-
 	// Collision tags
 	uint16_t m_CollisionTagsSelf = 0;
 	uint16_t m_CollisionTagsOther = 0;
 
-	// Phase boxes for collision grid
+	// the phase box this is stored under in the collision grid
 	PhaseBox m_PreviousPhaseBox;
-	PhaseBox m_CurrentPhaseBox;
 
 	// stores the node offsets for where this is stored in the collision grid - allows faster removal
 	std::vector<uint8_t> m_CollisionGridNodeIndices;
@@ -161,19 +154,21 @@ protected:
 	static bool GJKCirclePolygon(Vector2D circleCentre, float radius, const Polygon& polygon);
 
 public:
-	CollisionComponent(const CollisionComponent& other, std::shared_ptr<GameObject>& parent);
-	CollisionComponent(std::shared_ptr<GameObject>& parent, uint16_t selfTag, uint16_t otherTag): Component(parent), m_CollisionTagsSelf(selfTag), m_CollisionTagsOther(otherTag) {}
+	CollisionComponent(const CollisionComponent& other, GameObject* parent);
+	CollisionComponent(GameObject* parent, uint16_t selfTag, uint16_t otherTag): Component(parent), m_CollisionTagsSelf(selfTag), m_CollisionTagsOther(otherTag) {}
 
 	// Getters and setters
 	auto GetTags() const { return std::pair<uint16_t, uint16_t>(m_CollisionTagsSelf, m_CollisionTagsOther); }
 	auto GetSelfTag() const { return m_CollisionTagsSelf; }
-	void SetSelfTag(uint16_t tag) { m_CollisionTagsSelf = tag; }
+	void SetSelfTag(uint16_t tag) { m_CollisionTagsSelf = tag; m_bTagsWereUpdated = true; }
 	std::mutex& GetMutex() { return m_CollisionMutex; }
 	sf::Vector2f GetPos();
 	float GetRot();
 
-	// called every update and updates grid if either moved/rotated to new phase box or tags changed
-	void UpdateInCollisionGrid();
+	// called from the entity systems with the object's new phase box, updates the grid if either the box or the tags changed
+	void UpdateInCollisionGrid(const PhaseBox& box);
+	// the object has moved, so the cached polygon is recalculated the next time it's asked for
+	void InvalidateShape() { m_PolygonCalculated = false; }
 	void ClearFromGrid();
 
 	// virtuals
@@ -183,7 +178,8 @@ public:
 	virtual bool Intersects(CircleCollisionComponent* other) = 0;
 	virtual bool Intersects(BoxCollisionComponent* other) = 0;
 	virtual bool Intersects(PolygonCollisionComponent* other) = 0;
-	virtual void MakeBroadPhaseBox(bool& NoChange) = 0;
+	// distance from the centre to the furthest point of the shape at any rotation, the entity systems build the phase box from this
+	virtual float GetBoundingRadius() const = 0;
 	virtual const Polygon& GetPolygon() = 0;
 #if USE_CPU_FOR_OCCLUDERS
 	virtual bool CheckPointsInCollider(int* grid, float* xPoints, float* yPoints) = 0;
@@ -196,8 +192,8 @@ class CircleCollisionComponent : public CollisionComponent
 private:
 	float m_Radius = 1;
 public:
-	CircleCollisionComponent(std::shared_ptr<GameObject>& parent, float rad, uint16_t selfTag, uint16_t otherTag): CollisionComponent(parent, selfTag, otherTag), m_Radius(rad) {}
-	CircleCollisionComponent(const CircleCollisionComponent& other, std::shared_ptr<GameObject>& parent);
+	CircleCollisionComponent(GameObject* parent, float rad, uint16_t selfTag, uint16_t otherTag): CollisionComponent(parent, selfTag, otherTag), m_Radius(rad) {}
+	CircleCollisionComponent(const CircleCollisionComponent& other, GameObject* parent);
 
 	float GetRadius() const { return m_Radius; }
 	// overrides
@@ -205,9 +201,9 @@ public:
 	bool Intersects(CircleCollisionComponent* other) override;
 	bool Intersects(BoxCollisionComponent* other) override;
 	bool Intersects(PolygonCollisionComponent* other) override;
-	void MakeBroadPhaseBox(bool& NoChange)  override;
+	float GetBoundingRadius() const override { return m_Radius; }
 	const Polygon& GetPolygon() override { return m_CachedPolygon; }
-	std::unique_ptr<Component> CloneToUniquePtr(std::shared_ptr<GameObject>& parent) override;
+	std::unique_ptr<Component> CloneToUniquePtr(GameObject* parent) override;
 #if USE_CPU_FOR_OCCLUDERS
 	bool CheckPointsInCollider(int* grid, float* xPoints, float* yPoints) override;
 #endif
@@ -219,17 +215,17 @@ private:
 	float m_HalfWidth = 1;
 	float m_HalfHeight = 1;
 public:
-	BoxCollisionComponent(std::shared_ptr<GameObject>& parent, float halfWidth, float halfHeight, uint16_t selfTag, uint16_t otherTag) : CollisionComponent(parent, selfTag, otherTag), m_HalfWidth(halfWidth), m_HalfHeight(halfHeight) {}
-	BoxCollisionComponent(const BoxCollisionComponent& other, std::shared_ptr<GameObject>& parent);
+	BoxCollisionComponent(GameObject* parent, float halfWidth, float halfHeight, uint16_t selfTag, uint16_t otherTag) : CollisionComponent(parent, selfTag, otherTag), m_HalfWidth(halfWidth), m_HalfHeight(halfHeight) {}
+	BoxCollisionComponent(const BoxCollisionComponent& other, GameObject* parent);
 
 	// overrides
 	bool CheckCollisionWith(CollisionComponent* other, uint16_t otherTags) override;
 	bool Intersects(CircleCollisionComponent* other) override;
 	bool Intersects(BoxCollisionComponent* other) override;
 	bool Intersects(PolygonCollisionComponent* other) override;
-	void MakeBroadPhaseBox(bool& NoChange) override;
+	float GetBoundingRadius() const override { return std::sqrtf(m_HalfWidth * m_HalfWidth + m_HalfHeight * m_HalfHeight); }
 	const Polygon& GetPolygon() override;
-	std::unique_ptr<Component> CloneToUniquePtr(std::shared_ptr<GameObject>& parent) override;
+	std::unique_ptr<Component> CloneToUniquePtr(GameObject* parent) override;
 #if USE_CPU_FOR_OCCLUDERS
 	bool CheckPointsInCollider(int* grid, float* xPoints, float* yPoints) override;
 #endif
@@ -244,19 +240,19 @@ private:
 	float m_VertRegY[48];
 #endif
 public:
-	PolygonCollisionComponent(std::shared_ptr<GameObject>& parent, Polygon vertices, uint16_t selfTag, uint16_t otherTag) : CollisionComponent(parent, selfTag, otherTag), m_Vertices(vertices)
+	PolygonCollisionComponent(GameObject* parent, Polygon vertices, uint16_t selfTag, uint16_t otherTag) : CollisionComponent(parent, selfTag, otherTag), m_Vertices(vertices)
 	{
 		m_CachedPolygon.resize(m_Vertices.size());
 	}
-	PolygonCollisionComponent(const PolygonCollisionComponent& other, std::shared_ptr<GameObject>& parent);
+	PolygonCollisionComponent(const PolygonCollisionComponent& other, GameObject* parent);
 	// overrides
 	bool CheckCollisionWith(CollisionComponent* other, uint16_t otherTags) override;
 	bool Intersects(CircleCollisionComponent* other) override;
 	bool Intersects(BoxCollisionComponent* other) override;
 	bool Intersects(PolygonCollisionComponent* other) override;
-	void MakeBroadPhaseBox(bool& NoChange) override;
+	float GetBoundingRadius() const override;
 	const Polygon& GetPolygon() override;
-	std::unique_ptr<Component> CloneToUniquePtr(std::shared_ptr<GameObject>& parent) override;
+	std::unique_ptr<Component> CloneToUniquePtr(GameObject* parent) override;
 #if USE_CPU_FOR_OCCLUDERS
 	bool CheckPointsInCollider(int* grid, float* xPoints, float* yPoints) override;
 #endif
@@ -0,0 +1,49 @@
+#include "CpuFeatures.h"
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    bool DetectAvx2()
+    {
+#if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+        {
+            return false;
+        }
+        // OSXSAVE and AVX, and the os has to save the ymm registers on a context switch, not just the cpu have them
+        __cpuid(info, 1);
+        const int osxsaveAndAvx = (1 << 27) | (1 << 28);
+        if ((info[2] & osxsaveAndAvx) != osxsaveAndAvx || (_xgetbv(0) & 6) != 6)
+        {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        // checks the os support as well
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+
+    // static initialisation, so it's settled before main and reading it is just a load
+    bool g_HasAvx2 = DetectAvx2();
+}
+
+namespace CpuFeatures
+{
+    bool HasAvx2()
+    {
+        return g_HasAvx2;
+    }
+
+    void DisableAvx2()
+    {
+        g_HasAvx2 = false;
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+// the instruction sets kernels can be built for beyond the SSE2 the rest of the binary needs, checked once at startup so a kernel is only
+// picked on a cpu which has what it was built for - e.g. the AVX2 entity systems and particles (see USE_AVX2_SYSTEMS) fall back to their
+// scalar loops without it
+namespace CpuFeatures
+{
+    // the cpu has AVX2 and the os saves the ymm registers, and it hasn't been turned off
+    bool HasAvx2();
+    // use the scalar kernels even if the cpu has AVX2, for comparison (--no-avx2 on the command line) - call before BeginPlay
+    void DisableAvx2();
+}
+
+// marks a function built for AVX2 - gcc and clang only compile the function itself for it, so nothing else can pick up AVX2 instructions
+// (lambdas inside don't inherit it, make those functions of their own), msvc compiles intrinsics wherever they're used anyway
+#if defined(_MSC_VER) && !defined(__clang__)
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
@@ -0,0 +1,121 @@
+#include "EntityStore.h"
+#include "GameObject.h"
+#include "Components.h"
+
+EntityStore::EntityStore()
+{
+	using namespace EntityComponent;
+	// update costs are relative, an asteroid's polygon collider can span several grid cells
+	m_Archetypes[static_cast<int>(EntityArchetype::Ship)].Components = Transform | Velocity | Drag | Collider | ScreenWrap | PlayerControlled;
+	m_Archetypes[static_cast<int>(EntityArchetype::Asteroid)].Components = Transform | Velocity | Spin | Lifetime | Collider | ScreenWrap;
+	m_Archetypes[static_cast<int>(EntityArchetype::Asteroid)].UpdateCost = 3.f;
+	m_Archetypes[static_cast<int>(EntityArchetype::Projectile)].Components = Transform | Velocity | Collider | ScreenBound;
+}
+
+void EntityStore::Add(GameObject* obj)
+{
+	assert(obj->GetEntityChunk() == nullptr);
+	int archetype = static_cast<int>(obj->GetArchetype());
+	ArchetypeStorage& storage = m_Archetypes[archetype];
+	int chunkIndex = storage.Count / EntityChunk::CAPACITY;
+	if (chunkIndex == static_cast<int>(storage.Chunks.size()))
+	{
+		storage.Chunks.push_back(std::make_unique<EntityChunk>());
+		storage.Chunks.back()->Components = storage.Components;
+		storage.Chunks.back()->Archetype = static_cast<EntityArchetype>(archetype);
+	}
+	EntityChunk& chunk = *storage.Chunks[chunkIndex];
+	int row = chunk.Count++;
+	++storage.Count;
+
+	// the transform comes from the object, the rest of the row is zero unless the object fills it in
+	sf::Vector2f pos = obj->GetPosition();
+	chunk.LivePosX()[row] = pos.x;
+	chunk.LivePosY()[row] = pos.y;
+	chunk.LiveRot()[row] = obj->GetRotation();
+	// it's only just appeared, so there's nothing to interpolate from
+	chunk.LivePrevPosX()[row] = pos.x;
+	chunk.LivePrevPosY()[row] = pos.y;
+	chunk.LivePrevRot()[row] = chunk.LiveRot()[row];
+	chunk.VelX[row] = 0;
+	chunk.VelY[row] = 0;
+	chunk.Spin[row] = 0;
+	chunk.Lifetime[row] = 0;
+	chunk.Drag[row] = 0;
+	chunk.BoxLeft[row] = -1;
+	chunk.BoxRight[row] = -1;
+	chunk.BoxTop[row] = -1;
+	chunk.BoxBottom[row] = -1;
+	chunk.Colliders[row] = obj->GetComponent<CollisionComponent>();
+	chunk.Extent[row] = chunk.Colliders[row] != nullptr ? chunk.Colliders[row]->GetBoundingRadius() : 0;
+	chunk.Objects[row] = obj;
+	assert(chunk.Colliders[row] != nullptr || (chunk.Components & EntityComponent::Collider) == 0);
+	obj->InitialiseEntity(chunk, row);
+	obj->SetEntityLocation(&chunk, row);
+}
+
+void EntityStore::Remove(GameObject* obj)
+{
+	EntityChunk* chunk = obj->GetEntityChunk();
+	if (chunk == nullptr)
+	{
+		return;
+	}
+	int row = obj->GetEntityRow();
+	obj->LeaveEntityStore();
+
+	// the archetype's last entity fills the gap, so only its last chunk is ever part full
+	ArchetypeStorage& storage = m_Archetypes[static_cast<int>(chunk->Archetype)];
+	--storage.Count;
+	EntityChunk& last = *storage.Chunks[storage.Count / EntityChunk::CAPACITY];
+	int lastRow = --last.Count;
+	if (&last != chunk || lastRow != row)
+	{
+		MoveRow(last, lastRow, *chunk, row);
+		chunk->Objects[row]->SetEntityLocation(chunk, row);
+	}
+}
+
+int EntityStore::FlipTransforms()
+{
+	int frozen = EntityChunk::LiveBuffer;
+	EntityChunk::LiveBuffer = 1 - frozen;
+	return frozen;
+}
+
+void EntityStore::RebuildChunkList()
+{
+	m_ChunkList.clear();
+	for (ArchetypeStorage& storage : m_Archetypes)
+	{
+		for (auto& chunk : storage.Chunks)
+		{
+			if (chunk->Count > 0)
+			{
+				m_ChunkList.push_back(chunk.get());
+			}
+		}
+	}
+}
+
+void EntityStore::MoveRow(EntityChunk& from, int fromRow, EntityChunk& to, int toRow)
+{
+	to.LivePosX()[toRow] = from.LivePosX()[fromRow];
+	to.LivePosY()[toRow] = from.LivePosY()[fromRow];
+	to.LiveRot()[toRow] = from.LiveRot()[fromRow];
+	to.LivePrevPosX()[toRow] = from.LivePrevPosX()[fromRow];
+	to.LivePrevPosY()[toRow] = from.LivePrevPosY()[fromRow];
+	to.LivePrevRot()[toRow] = from.LivePrevRot()[fromRow];
+	to.VelX[toRow] = from.VelX[fromRow];
+	to.VelY[toRow] = from.VelY[fromRow];
+	to.Spin[toRow] = from.Spin[fromRow];
+	to.Lifetime[toRow] = from.Lifetime[fromRow];
+	to.Drag[toRow] = from.Drag[fromRow];
+	to.Extent[toRow] = from.Extent[fromRow];
+	to.BoxLeft[toRow] = from.BoxLeft[fromRow];
+	to.BoxRight[toRow] = from.BoxRight[fromRow];
+	to.BoxTop[toRow] = from.BoxTop[fromRow];
+	to.BoxBottom[toRow] = from.BoxBottom[fromRow];
+	to.Colliders[toRow] = from.Colliders[fromRow];
+	to.Objects[toRow] = from.Objects[fromRow];
+}
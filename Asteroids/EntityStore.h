@@ -0,0 +1,123 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class GameObject;
+class CollisionComponent;
+
+// the columns an entity can have, an archetype is a fixed set of these and a query asks for a set and gets every chunk whose archetype has all of them
+namespace EntityComponent
+{
+	enum : uint32_t
+	{
+		// PosX, PosY, Rot
+		Transform = 1 << 0,
+		// VelX, VelY, in pixels per second
+		Velocity = 1 << 1,
+		// degrees per second
+		Spin = 1 << 2,
+		// seconds since the entity was spawned
+		Lifetime = 1 << 3,
+		// velocity lost per second, towards zero on each axis
+		Drag = 1 << 4,
+		Collider = 1 << 5,
+		// wraps round to the other side of the screen (after WRAP_DELAY if the archetype has a lifetime, since they spawn off screen)
+		ScreenWrap = 1 << 6,
+		// killed on leaving the screen
+		ScreenBound = 1 << 7,
+		// steered by the player's inputs
+		PlayerControlled = 1 << 8
+	};
+}
+
+enum class EntityArchetype : uint8_t { Ship, Asteroid, Projectile, Count };
+
+// a fixed block of entities of one archetype, each column contiguous so a system runs down the rows of a chunk touching only the columns it reads,
+// and aligned so they can be loaded 8 at a time (rows past Count in the last 8 hold junk, which the systems are free to update but not act on) - every archetype has all the columns, the ones its components don't cover just go unused
+struct EntityChunk
+{
+	static const int CAPACITY = 16;
+	// the transform columns are double buffered, the live half is what the systems update and GetPosition etc. read, the frozen half is the
+	// last frame's, drawn while the live one is updated - the same half is live in every chunk, see EntityStore::FlipTransforms
+	static inline int LiveBuffer = 0;
+
+	alignas(32) float PosX[2][CAPACITY];
+	alignas(32) float PosY[2][CAPACITY];
+	alignas(32) float Rot[2][CAPACITY];
+	// the transform at the start of the step, so a frozen half has both ends of the step it covers and drawing can interpolate between them
+	alignas(32) float PrevPosX[2][CAPACITY];
+	alignas(32) float PrevPosY[2][CAPACITY];
+	alignas(32) float PrevRot[2][CAPACITY];
+	alignas(32) float VelX[CAPACITY];
+	alignas(32) float VelY[CAPACITY];
+	alignas(32) float Spin[CAPACITY];
+	alignas(32) float Lifetime[CAPACITY];
+	alignas(32) float Drag[CAPACITY];
+	// the collider's bounding radius, so the phase box can be made without touching the collider
+	alignas(32) float Extent[CAPACITY];
+	// the phase box (in grid cells) from the last update, -1 until the first so a new entity is always put in the grid
+	alignas(32) int32_t BoxLeft[CAPACITY];
+	alignas(32) int32_t BoxRight[CAPACITY];
+	alignas(32) int32_t BoxTop[CAPACITY];
+	alignas(32) int32_t BoxBottom[CAPACITY];
+	CollisionComponent* Colliders[CAPACITY];
+	GameObject* Objects[CAPACITY];
+
+	// rows whose phase box changed this update, written by the motion systems for the grid update to run down
+	uint8_t ChangedRows[CAPACITY];
+	int ChangedCount = 0;
+
+	int Count = 0;
+	uint32_t Components = 0;
+	EntityArchetype Archetype = EntityArchetype::Count;
+
+	float* LivePosX() { return PosX[LiveBuffer]; }
+	float* LivePosY() { return PosY[LiveBuffer]; }
+	float* LiveRot() { return Rot[LiveBuffer]; }
+	float* LivePrevPosX() { return PrevPosX[LiveBuffer]; }
+	float* LivePrevPosY() { return PrevPosY[LiveBuffer]; }
+	float* LivePrevRot() { return PrevRot[LiveBuffer]; }
+};
+
+// transforms, velocities and colliders of every active object, grouped into chunks by archetype - each archetype's entities are packed into
+// its chunks with only the last one part full, so removing one moves the last entity of the archetype into the gap (and tells its object)
+// objects join in Gamestate::CleanUp, when they're added to the active objects, and leave when they're removed, taking their transform back
+// with them - while an object is in here its GetPosition etc. read its row, so the store is the only copy any system has to update
+// adding, removing and moving rows only touches the live transforms, so the frozen ones stay where the last snapshot's draw list expects them
+// not thread-safe to add or remove, that's only done by CleanUp, but each chunk can be updated by a different thread
+class EntityStore
+{
+public:
+	EntityStore();
+
+	void Add(GameObject* obj);
+	// nothing happens if the object isn't in the store
+	void Remove(GameObject* obj);
+
+	// every chunk with anything in it, in archetype order - only valid until the next add or remove
+	void RebuildChunkList();
+	int GetChunkCount() const { return static_cast<int>(m_ChunkList.size()); }
+	EntityChunk& GetChunk(int index) { return *m_ChunkList[index]; }
+	// the live transforms become the frozen ones (for drawing) and the old frozen half becomes live, returns the half which is now frozen
+	// O(1), the new live half is brought up to date by each chunk's first system in the next update, so until then GetPosition etc. read stale
+	// transforms - only done in the snapshot stage, once everything which reads them this frame has
+	static int FlipTransforms();
+	// rough cost of updating a row of the archetype relative to the others, used to balance the update loop between threads
+	float GetUpdateCost(const EntityChunk& chunk) const { return chunk.Count * m_Archetypes[static_cast<int>(chunk.Archetype)].UpdateCost; }
+
+private:
+	struct ArchetypeStorage
+	{
+		uint32_t Components = 0;
+		float UpdateCost = 1.f;
+		int Count = 0;
+		// never freed, so a chunk's address is stable and an emptied one is reused by the next add
+		std::vector<std::unique_ptr<EntityChunk>> Chunks;
+	};
+	ArchetypeStorage m_Archetypes[static_cast<int>(EntityArchetype::Count)];
+	std::vector<EntityChunk*> m_ChunkList;
+
+	static void MoveRow(EntityChunk& from, int fromRow, EntityChunk& to, int toRow);
+};
+
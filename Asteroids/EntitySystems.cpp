@@ -0,0 +1,350 @@
+#include "EntitySystems.h"
+#include "GameObject.h"
+#include "Components.h"
+#include "PlayerShip.h"
+#include "Gamestate.h"
+
+#include "CpuFeatures.h"
+
+#include <algorithm>
+#include <bit>
+#if USE_AVX2_SYSTEMS
+#include <immintrin.h>
+#endif
+
+// asteroids spawn off screen, so they get this long to drift on before they wrap
+static const float WRAP_DELAY = 3.f;
+// projectiles are killed this close to the edge
+static const float SCREEN_BOUND_MARGIN = 5.f;
+static const float CELL_SIZE_X = SCREEN_WIDTH / GRID_RESOLUTION;
+static const float CELL_SIZE_Y = SCREEN_HEIGHT / GRID_RESOLUTION;
+
+// every row is active when the update starts (CleanUp takes out anything made inactive last frame), so the systems don't check
+// with USE_AVX2_SYSTEMS the systems which do the same sum on every row have a version taking 8 rows at a time, used if the cpu has AVX2 -
+// the scalar versions do exactly the same sums (no fma, division rather than a reciprocal) so either gives the same positions and phase boxes
+
+#if USE_AVX2_SYSTEMS
+// bit per row in use of the 8 starting at first
+static int RowMask(const EntityChunk& chunk, int first)
+{
+	int rows = chunk.Count - first;
+	return rows >= 8 ? 0xFF : (1 << rows) - 1;
+}
+#endif
+
+// the frozen transforms are the last step's, which is where this step starts from (and so what it's interpolated from when drawn)
+static void CarryOverTransforms(EntityChunk& chunk, float /*deltaTime*/)
+{
+	int frozen = 1 - EntityChunk::LiveBuffer;
+	std::copy_n(chunk.PosX[frozen], chunk.Count, chunk.LivePosX());
+	std::copy_n(chunk.PosY[frozen], chunk.Count, chunk.LivePosY());
+	std::copy_n(chunk.Rot[frozen], chunk.Count, chunk.LiveRot());
+	std::copy_n(chunk.PosX[frozen], chunk.Count, chunk.LivePrevPosX());
+	std::copy_n(chunk.PosY[frozen], chunk.Count, chunk.LivePrevPosY());
+	std::copy_n(chunk.Rot[frozen], chunk.Count, chunk.LivePrevRot());
+}
+
+// inputs, timers and firing - sets the ship's rotation and velocity for the systems below to move it
+static void SteerPlayer(EntityChunk& chunk, float deltaTime)
+{
+	for (int i = 0; i < chunk.Count; ++i)
+	{
+		static_cast<PlayerShip*>(chunk.Objects[i])->Steer(deltaTime, chunk.LiveRot()[i], chunk.VelX[i], chunk.VelY[i]);
+		// the ship's tags change with its invulnerability, which only gets into the grid through UpdateInCollisionGrid, so it's always
+		// listed as changed (and UpdateInCollisionGrid does nothing if neither the box nor the tags really did)
+		chunk.BoxLeft[i] = -1;
+	}
+}
+
+// queued for removal and stopped where it is, so it's still in the grid at the edge until it's cleaned up
+static void Kill(EntityChunk& chunk, int row)
+{
+	chunk.Objects[row]->SetInactive();
+	Gamestate::instance->AddToCleanupObjectsDelayed(chunk.Objects[row]->GetHandle());
+	chunk.VelX[row] = 0;
+	chunk.VelY[row] = 0;
+}
+
+static void KillOffScreen(EntityChunk& chunk, float /*deltaTime*/)
+{
+	float* posX = chunk.LivePosX();
+	float* posY = chunk.LivePosY();
+	for (int i = 0; i < chunk.Count; ++i)
+	{
+		if (posX[i] < SCREEN_BOUND_MARGIN || posX[i] > SCREEN_WIDTH - SCREEN_BOUND_MARGIN ||
+			posY[i] < SCREEN_BOUND_MARGIN || posY[i] > SCREEN_HEIGHT - SCREEN_BOUND_MARGIN)
+		{
+			Kill(chunk, i);
+		}
+	}
+}
+
+#if USE_AVX2_SYSTEMS
+AVX2_TARGET static void KillOffScreenAvx2(EntityChunk& chunk, float /*deltaTime*/)
+{
+	float* posX = chunk.LivePosX();
+	float* posY = chunk.LivePosY();
+	const __m256 lowBound = _mm256_set1_ps(SCREEN_BOUND_MARGIN);
+	const __m256 highBoundX = _mm256_set1_ps(SCREEN_WIDTH - SCREEN_BOUND_MARGIN);
+	const __m256 highBoundY = _mm256_set1_ps(SCREEN_HEIGHT - SCREEN_BOUND_MARGIN);
+	for (int i = 0; i < chunk.Count; i += 8)
+	{
+		__m256 x = _mm256_load_ps(posX + i);
+		__m256 y = _mm256_load_ps(posY + i);
+		__m256 outX = _mm256_or_ps(_mm256_cmp_ps(x, lowBound, _CMP_LT_OQ), _mm256_cmp_ps(x, highBoundX, _CMP_GT_OQ));
+		__m256 outY = _mm256_or_ps(_mm256_cmp_ps(y, lowBound, _CMP_LT_OQ), _mm256_cmp_ps(y, highBoundY, _CMP_GT_OQ));
+		// hardly ever more than one or two, so the kills themselves are scalar
+		unsigned int killed = _mm256_movemask_ps(_mm256_or_ps(outX, outY)) & RowMask(chunk, i);
+		for (; killed != 0; killed &= killed - 1)
+		{
+			Kill(chunk, i + std::countr_zero(killed));
+		}
+	}
+}
+#endif
+
+static void Move(EntityChunk& chunk, float deltaTime)
+{
+	float* posX = chunk.LivePosX();
+	float* posY = chunk.LivePosY();
+	for (int i = 0; i < chunk.Count; ++i)
+	{
+		posX[i] += chunk.VelX[i] * deltaTime;
+		posY[i] += chunk.VelY[i] * deltaTime;
+	}
+}
+
+#if USE_AVX2_SYSTEMS
+AVX2_TARGET static void MoveAvx2(EntityChunk& chunk, float deltaTime)
+{
+	float* posX = chunk.LivePosX();
+	float* posY = chunk.LivePosY();
+	const __m256 dt = _mm256_set1_ps(deltaTime);
+	for (int i = 0; i < chunk.Count; i += 8)
+	{
+		_mm256_store_ps(posX + i, _mm256_add_ps(_mm256_load_ps(posX + i), _mm256_mul_ps(_mm256_load_ps(chunk.VelX + i), dt)));
+		_mm256_store_ps(posY + i, _mm256_add_ps(_mm256_load_ps(posY + i), _mm256_mul_ps(_mm256_load_ps(chunk.VelY + i), dt)));
+	}
+}
+#endif
+
+static void WrapToScreen(EntityChunk& chunk, float /*deltaTime*/)
+{
+	float* posX = chunk.LivePosX();
+	float* posY = chunk.LivePosY();
+	bool delayed = (chunk.Components & EntityComponent::Lifetime) != 0;
+	for (int i = 0; i < chunk.Count; ++i)
+	{
+		if (delayed && chunk.Lifetime[i] <= WRAP_DELAY)
+		{
+			continue;
+		}
+		if (posX[i] < 0)
+		{
+			posX[i] += SCREEN_WIDTH;
+		}
+		else if (posX[i] > SCREEN_WIDTH)
+		{
+			posX[i] -= SCREEN_WIDTH;
+		}
+		if (posY[i] < 0)
+		{
+			posY[i] += SCREEN_HEIGHT;
+		}
+		else if (posY[i] > SCREEN_HEIGHT)
+		{
+			posY[i] -= SCREEN_HEIGHT;
+		}
+	}
+}
+
+#if USE_AVX2_SYSTEMS
+AVX2_TARGET static void WrapToScreenAvx2(EntityChunk& chunk, float /*deltaTime*/)
+{
+	float* posX = chunk.LivePosX();
+	float* posY = chunk.LivePosY();
+	bool delayed = (chunk.Components & EntityComponent::Lifetime) != 0;
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 width = _mm256_set1_ps(SCREEN_WIDTH);
+	const __m256 height = _mm256_set1_ps(SCREEN_HEIGHT);
+	const __m256 delay = _mm256_set1_ps(WRAP_DELAY);
+	const __m256 all = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+	for (int i = 0; i < chunk.Count; i += 8)
+	{
+		__m256 wraps = delayed ? _mm256_cmp_ps(_mm256_load_ps(chunk.Lifetime + i), delay, _CMP_GT_OQ) : all;
+		__m256 x = _mm256_load_ps(posX + i);
+		__m256 y = _mm256_load_ps(posY + i);
+		// below and above can't both be set, and adding or taking away 0 leaves the rest where they are
+		__m256 belowX = _mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_LT_OQ), wraps);
+		__m256 aboveX = _mm256_and_ps(_mm256_cmp_ps(x, width, _CMP_GT_OQ), wraps);
+		__m256 belowY = _mm256_and_ps(_mm256_cmp_ps(y, zero, _CMP_LT_OQ), wraps);
+		__m256 aboveY = _mm256_and_ps(_mm256_cmp_ps(y, height, _CMP_GT_OQ), wraps);
+		x = _mm256_sub_ps(_mm256_add_ps(x, _mm256_and_ps(belowX, width)), _mm256_and_ps(aboveX, width));
+		y = _mm256_sub_ps(_mm256_add_ps(y, _mm256_and_ps(belowY, height)), _mm256_and_ps(aboveY, height));
+		_mm256_store_ps(posX + i, x);
+		_mm256_store_ps(posY + i, y);
+	}
+}
+#endif
+
+static void ApplySpin(EntityChunk& chunk, float deltaTime)
+{
+	float* rot = chunk.LiveRot();
+	for (int i = 0; i < chunk.Count; ++i)
+	{
+		rot[i] += chunk.Spin[i] * deltaTime;
+	}
+}
+
+#if USE_AVX2_SYSTEMS
+AVX2_TARGET static void ApplySpinAvx2(EntityChunk& chunk, float deltaTime)
+{
+	float* rot = chunk.LiveRot();
+	const __m256 dt = _mm256_set1_ps(deltaTime);
+	for (int i = 0; i < chunk.Count; i += 8)
+	{
+		_mm256_store_ps(rot + i, _mm256_add_ps(_mm256_load_ps(rot + i), _mm256_mul_ps(_mm256_load_ps(chunk.Spin + i), dt)));
+	}
+}
+#endif
+
+static void Age(EntityChunk& chunk, float deltaTime)
+{
+	for (int i = 0; i < chunk.Count; ++i)
+	{
+		chunk.Lifetime[i] += deltaTime;
+	}
+}
+
+#if USE_AVX2_SYSTEMS
+AVX2_TARGET static void AgeAvx2(EntityChunk& chunk, float deltaTime)
+{
+	const __m256 dt = _mm256_set1_ps(deltaTime);
+	for (int i = 0; i < chunk.Count; i += 8)
+	{
+		_mm256_store_ps(chunk.Lifetime + i, _mm256_add_ps(_mm256_load_ps(chunk.Lifetime + i), dt));
+	}
+}
+#endif
+
+static void ApplyDrag(EntityChunk& chunk, float deltaTime)
+{
+	for (int i = 0; i < chunk.Count; ++i)
+	{
+		chunk.VelX[i] -= (chunk.VelX[i] > 0 ? 1 : -1) * chunk.Drag[i] * deltaTime;
+		chunk.VelY[i] -= (chunk.VelY[i] > 0 ? 1 : -1) * chunk.Drag[i] * deltaTime;
+	}
+}
+
+// once everything has moved - the box (in grid cells) round each entity's bounding circle, compared with last update's so only rows whose
+// box changed are listed for UpdateColliders, which is most of the work of putting things in the grid and so only done for those
+static void UpdatePhaseBoxes(EntityChunk& chunk, float /*deltaTime*/)
+{
+	float* posX = chunk.LivePosX();
+	float* posY = chunk.LivePosY();
+	chunk.ChangedCount = 0;
+	auto cellOf = [](float coord, float cellSize) { return std::clamp(static_cast<int>(coord / cellSize), 0, GRID_RESOLUTION - 1); };
+	for (int i = 0; i < chunk.Count; ++i)
+	{
+		int left = cellOf(posX[i] - chunk.Extent[i], CELL_SIZE_X);
+		int right = cellOf(posX[i] + chunk.Extent[i], CELL_SIZE_X);
+		int top = cellOf(posY[i] - chunk.Extent[i], CELL_SIZE_Y);
+		int bottom = cellOf(posY[i] + chunk.Extent[i], CELL_SIZE_Y);
+		if (left != chunk.BoxLeft[i] || right != chunk.BoxRight[i] || top != chunk.BoxTop[i] || bottom != chunk.BoxBottom[i])
+		{
+			chunk.ChangedRows[chunk.ChangedCount++] = static_cast<uint8_t>(i);
+		}
+		chunk.BoxLeft[i] = left;
+		chunk.BoxRight[i] = right;
+		chunk.BoxTop[i] = top;
+		chunk.BoxBottom[i] = bottom;
+	}
+}
+
+#if USE_AVX2_SYSTEMS
+// a lambda wouldn't be compiled for AVX2 along with the function it's in
+AVX2_TARGET static __m256i CellOf(__m256 coord, __m256 cellSize)
+{
+	return _mm256_min_epi32(_mm256_max_epi32(_mm256_cvttps_epi32(_mm256_div_ps(coord, cellSize)), _mm256_setzero_si256()), _mm256_set1_epi32(GRID_RESOLUTION - 1));
+}
+AVX2_TARGET static void UpdatePhaseBoxesAvx2(EntityChunk& chunk, float /*deltaTime*/)
+{
+	float* posX = chunk.LivePosX();
+	float* posY = chunk.LivePosY();
+	chunk.ChangedCount = 0;
+	const __m256 cellX = _mm256_set1_ps(CELL_SIZE_X);
+	const __m256 cellY = _mm256_set1_ps(CELL_SIZE_Y);
+	for (int i = 0; i < chunk.Count; i += 8)
+	{
+		__m256 x = _mm256_load_ps(posX + i);
+		__m256 y = _mm256_load_ps(posY + i);
+		__m256 extent = _mm256_load_ps(chunk.Extent + i);
+		__m256i left = CellOf(_mm256_sub_ps(x, extent), cellX);
+		__m256i right = CellOf(_mm256_add_ps(x, extent), cellX);
+		__m256i top = CellOf(_mm256_sub_ps(y, extent), cellY);
+		__m256i bottom = CellOf(_mm256_add_ps(y, extent), cellY);
+
+		__m256i same = _mm256_and_si256(
+			_mm256_and_si256(_mm256_cmpeq_epi32(left, _mm256_load_si256(reinterpret_cast<const __m256i*>(chunk.BoxLeft + i))),
+							 _mm256_cmpeq_epi32(right, _mm256_load_si256(reinterpret_cast<const __m256i*>(chunk.BoxRight + i)))),
+			_mm256_and_si256(_mm256_cmpeq_epi32(top, _mm256_load_si256(reinterpret_cast<const __m256i*>(chunk.BoxTop + i))),
+							 _mm256_cmpeq_epi32(bottom, _mm256_load_si256(reinterpret_cast<const __m256i*>(chunk.BoxBottom + i)))));
+		_mm256_store_si256(reinterpret_cast<__m256i*>(chunk.BoxLeft + i), left);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(chunk.BoxRight + i), right);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(chunk.BoxTop + i), top);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(chunk.BoxBottom + i), bottom);
+
+		unsigned int changed = ~_mm256_movemask_ps(_mm256_castsi256_ps(same)) & RowMask(chunk, i);
+		for (; changed != 0; changed &= changed - 1)
+		{
+			chunk.ChangedRows[chunk.ChangedCount++] = static_cast<uint8_t>(i + std::countr_zero(changed));
+		}
+	}
+}
+#endif
+
+// every collider's cached polygon is stale now it's moved, but only the listed rows need to move in the grid
+static void UpdateColliders(EntityChunk& chunk, float /*deltaTime*/)
+{
+	for (int i = 0; i < chunk.Count; ++i)
+	{
+		chunk.Colliders[i]->InvalidateShape();
+	}
+	for (int i = 0; i < chunk.ChangedCount; ++i)
+	{
+		int row = chunk.ChangedRows[i];
+		chunk.Colliders[row]->UpdateInCollisionGrid({ chunk.BoxLeft[row], chunk.BoxRight[row], chunk.BoxTop[row], chunk.BoxBottom[row] });
+	}
+}
+
+#if USE_AVX2_SYSTEMS
+#define AVX2_SYSTEM(run) run
+#else
+#define AVX2_SYSTEM(run) nullptr
+#endif
+// in the order they run, e.g. an asteroid moves, wraps (checking its lifetime before it's aged), spins, ages, works out its phase box and then updates its place in the grid if that changed
+static const EntitySystem Systems[] =
+{
+	{ EntityComponent::Transform, CarryOverTransforms, nullptr },
+	{ EntityComponent::PlayerControlled, SteerPlayer, nullptr },
+	{ EntityComponent::Transform | EntityComponent::ScreenBound, KillOffScreen, AVX2_SYSTEM(KillOffScreenAvx2) },
+	{ EntityComponent::Transform | EntityComponent::Velocity, Move, AVX2_SYSTEM(MoveAvx2) },
+	{ EntityComponent::Transform | EntityComponent::ScreenWrap, WrapToScreen, AVX2_SYSTEM(WrapToScreenAvx2) },
+	{ EntityComponent::Transform | EntityComponent::Spin, ApplySpin, AVX2_SYSTEM(ApplySpinAvx2) },
+	{ EntityComponent::Lifetime, Age, AVX2_SYSTEM(AgeAvx2) },
+	{ EntityComponent::Velocity | EntityComponent::Drag, ApplyDrag, nullptr },
+	{ EntityComponent::Transform | EntityComponent::Collider, UpdatePhaseBoxes, AVX2_SYSTEM(UpdatePhaseBoxesAvx2) },
+	{ EntityComponent::Transform | EntityComponent::Collider, UpdateColliders, nullptr }
+};
+
+void EntitySystems::RunOnChunk(EntityChunk& chunk, float deltaTime)
+{
+	const bool useAvx2 = CpuFeatures::HasAvx2();
+	for (const EntitySystem& system : Systems)
+	{
+		if ((chunk.Components & system.Query) == system.Query)
+		{
+			(useAvx2 && system.RunAvx2 != nullptr ? system.RunAvx2 : system.Run)(chunk, deltaTime);
+		}
+	}
+}
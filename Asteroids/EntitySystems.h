@@ -0,0 +1,17 @@
+#pragma once
+#include "EntityStore.h"
+
+// game logic which runs down the rows of a chunk, on every chunk whose archetype has all of the components in Query
+struct EntitySystem
+{
+	uint32_t Query;
+	void (*Run)(EntityChunk& chunk, float deltaTime);
+	// the same taking 8 rows at a time, run instead if the cpu has AVX2 (nullptr if there isn't one)
+	void (*RunAvx2)(EntityChunk& chunk, float deltaTime);
+};
+
+namespace EntitySystems
+{
+	// runs each system whose query matches the chunk's archetype, in the order they're listed in EntitySystems.cpp - the object update for a chunk
+	void RunOnChunk(EntityChunk& chunk, float deltaTime);
+}
@@ -0,0 +1,257 @@
+#include "FrameGraph.h"
+#include "JobTrace.h"
+
+// writes are exclusive, shared access can overlap other shared access but not a read (the reader would see a partial update)
+bool FrameGraph::StagesConflict(const Stage& a, const Stage& b)
+{
+    return (a.Writes & (b.Reads | b.Writes | b.Shared)) != 0
+        || (b.Writes & (a.Reads | a.Shared)) != 0
+        || (a.Shared & b.Reads) != 0
+        || (a.Reads & b.Shared) != 0;
+}
+
+int FrameGraph::AddStage(std::unique_ptr<Stage> stage)
+{
+    JobTrace::SetPhaseName(static_cast<int>(m_Stages.size()), stage->Name);
+    m_Stages.push_back(std::move(stage));
+    return static_cast<int>(m_Stages.size()) - 1;
+}
+
+int FrameGraph::AddWorkerStage(const std::string& name, ResourceMask reads, ResourceMask writes, ResourceMask shared, const std::vector<JobSystem::Declaration>& jobs)
+{
+    std::unique_ptr<Stage> stage = std::make_unique<Stage>();
+    stage->Name = name;
+    stage->Reads = reads;
+    stage->Writes = writes;
+    stage->Shared = shared;
+    stage->Jobs = jobs;
+    return AddStage(std::move(stage));
+}
+
+int FrameGraph::AddMainThreadStage(const std::string& name, ResourceMask reads, ResourceMask writes, ResourceMask shared, const JobSystem::Declaration& job)
+{
+    std::unique_ptr<Stage> stage = std::make_unique<Stage>();
+    stage->Name = name;
+    stage->Reads = reads;
+    stage->Writes = writes;
+    stage->Shared = shared;
+    stage->MainThread = true;
+    stage->MainThreadJob = job;
+    return AddStage(std::move(stage));
+}
+
+void FrameGraph::Build()
+{
+    for (size_t i = 0; i < m_Stages.size(); ++i)
+    {
+        m_Stages[i]->Dependencies.clear();
+        m_Stages[i]->Dependents.clear();
+    }
+    // edges only ever go from an earlier stage to a later one, so the graph can't have cycles, and main thread stages running in
+    // order can never wait on something which is waiting on a later main thread stage
+    for (size_t later = 0; later < m_Stages.size(); ++later)
+    {
+        for (size_t earlier = 0; earlier < later; ++earlier)
+        {
+            if (StagesConflict(*m_Stages[earlier], *m_Stages[later]))
+            {
+                m_Stages[later]->Dependencies.push_back(static_cast<int>(earlier));
+                m_Stages[earlier]->Dependents.push_back(static_cast<int>(later));
+            }
+        }
+    }
+}
+
+void FrameGraph::AddJobToStage(int stage, const JobSystem::Declaration& decl)
+{
+    Stage& target = *m_Stages[stage];
+    assert(!target.MainThread && target.State.load() == StageState::WAITING && target.pCounter != nullptr);
+    JobSystem::Declaration added = decl;
+    added.m_pCounter = target.pCounter;
+    target.AddedJobs.Push(added);
+}
+
+void FrameGraph::StartWorkerStage(int stageIndex)
+{
+    Stage& stage = *m_Stages[stageIndex];
+    stage.StartTime = std::chrono::steady_clock::now();
+    stage.State.store(StageState::RUNNING);
+
+    // every stage which could add jobs to this one is complete, so the added jobs can be kicked straight out of the buffer
+    // one extra count holds the stage open until that's done and the buffer is reset, so the stage (and frame) can't finish and have next
+    // frame's jobs added while it's still being emptied - it also means a stage with no jobs completes through the same path
+    int ownJobs = stage.Skipped ? 0 : static_cast<int>(stage.Jobs.size());
+    stage.pCounter->count.store(ownJobs + stage.AddedJobs.Size() + 1);
+    if (ownJobs > 0)
+    {
+        JobSystem::KickJobs(static_cast<int>(stage.Jobs.size()), stage.Jobs.data());
+    }
+    stage.AddedJobs.Consume([](int count, const JobSystem::Declaration aDecl[]) { JobSystem::KickJobs(count, aDecl); });
+    if (stage.pCounter->count.fetch_sub(1) == 1)
+    {
+        CompleteStage(static_cast<uintptr_t>(stageIndex));
+    }
+}
+
+void FrameGraph::CompleteStage(uintptr_t stageIndex)
+{
+    Stage& stage = *m_Stages[stageIndex];
+    stage.EndTime = std::chrono::steady_clock::now();
+    stage.State.store(StageState::DONE);
+    if (stage.pCounter != nullptr)
+    {
+        // every job of the stage has finished with the counter, this also makes the stage's handle stale
+        JobSystem::FreeCounter(stage.pCounter);
+        stage.pCounter = nullptr;
+    }
+    for (int dependent : stage.Dependents)
+    {
+        // main thread stages are picked up by the main thread itself in RunFrame
+        if (m_Stages[dependent]->PendingDependencies.fetch_sub(1) == 1 && !m_Stages[dependent]->MainThread)
+        {
+            StartWorkerStage(dependent);
+        }
+    }
+    m_StagesRemaining.fetch_sub(1);
+}
+
+void FrameGraph::RunFrame()
+{
+    auto frameStart = std::chrono::steady_clock::now();
+#if USE_JOB_TRACE
+    long long frameTraceBegin = JobTrace::Now();
+#endif
+    for (auto& stage : m_Stages)
+    {
+        stage->PendingDependencies.store(static_cast<int>(stage->Dependencies.size()));
+        stage->State.store(StageState::WAITING);
+        if (!stage->MainThread)
+        {
+            // fresh counter every frame, so a handle from last frame can't be confused with this one
+            stage->pCounter = JobSystem::AllocCounter();
+            stage->pCounter->onComplete = { this, &JobSystem::MemberFunctionDispatcher<FrameGraph, &FrameGraph::CompleteStage> };
+            stage->pCounter->onCompleteParam = static_cast<uintptr_t>(&stage - &m_Stages[0]);
+            stage->pCounter->phase = static_cast<int16_t>(&stage - &m_Stages[0]);
+            stage->Handle = JobSystem::GetCounterHandle(stage->pCounter);
+            for (JobSystem::Declaration& decl : stage->Jobs)
+            {
+                decl.m_pCounter = stage->pCounter;
+            }
+        }
+    }
+    m_StagesRemaining.store(static_cast<int>(m_Stages.size()));
+
+    for (size_t i = 0; i < m_Stages.size(); ++i)
+    {
+        if (!m_Stages[i]->MainThread && m_Stages[i]->Dependencies.empty())
+        {
+            StartWorkerStage(static_cast<int>(i));
+        }
+    }
+
+    for (size_t i = 0; i < m_Stages.size(); ++i)
+    {
+        Stage& stage = *m_Stages[i];
+        if (!stage.MainThread)
+        {
+            continue;
+        }
+#if USE_JOB_TRACE
+        // time spent here is the main thread stalled on (or helping with) this stage's dependencies, jobs it helps with show up inside it
+        long long traceBegin = JobTrace::Now();
+#endif
+        auto waitStart = std::chrono::steady_clock::now();
+        JobSystem::HelpUntil([&stage] { return stage.PendingDependencies.load() == 0; });
+#if USE_JOB_TRACE
+        long long traceRun = JobTrace::Now();
+        JobTrace::Record(traceBegin, traceRun, "Wait for dependencies", static_cast<int>(i));
+#endif
+        stage.StartTime = std::chrono::steady_clock::now();
+        stage.DependencyWaitTimes.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(stage.StartTime - waitStart).count());
+        stage.State.store(StageState::RUNNING);
+        if (!stage.Skipped)
+        {
+            stage.MainThreadJob.Invoke();
+        }
+#if USE_JOB_TRACE
+        JobTrace::Record(traceRun, JobTrace::Now(), stage.Name.c_str(), static_cast<int>(i));
+#endif
+        CompleteStage(i);
+    }
+
+#if USE_JOB_TRACE
+    long long traceBegin = JobTrace::Now();
+#endif
+    auto waitStart = std::chrono::steady_clock::now();
+    JobSystem::HelpUntil([this] { return m_StagesRemaining.load() == 0; });
+    auto frameEnd = std::chrono::steady_clock::now();
+#if USE_JOB_TRACE
+    JobTrace::Record(traceBegin, JobTrace::Now(), "Wait for end of frame");
+#endif
+    m_EndOfFrameWaitTimes.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(frameEnd - waitStart).count());
+
+    // everything has completed, so every stage's times are visible to this thread
+    for (auto& stage : m_Stages)
+    {
+        if (stage->Skipped)
+        {
+            continue;
+        }
+        ++stage->Runs;
+        long long spanNs = std::chrono::duration_cast<std::chrono::nanoseconds>(stage->EndTime - stage->StartTime).count();
+        stage->SpanNs += spanNs;
+        if (stage->MainThread)
+        {
+            stage->MainThreadBusyNs += spanNs;
+        }
+        stage->SpanTimes.Record(spanNs);
+        if (stage->BudgetNs > 0 && spanNs > stage->BudgetNs)
+        {
+            ++stage->OverBudget;
+        }
+    }
+    long long frameNs = std::chrono::duration_cast<std::chrono::nanoseconds>(frameEnd - frameStart).count();
+    m_FrameTimes.Record(frameNs);
+    if (m_FrameBudgetNs > 0 && frameNs > m_FrameBudgetNs)
+    {
+        ++m_FramesOverBudget;
+#if USE_JOB_TRACE
+        JobTrace::Record(frameTraceBegin, JobTrace::Now(), "Over budget");
+#endif
+    }
+    ++m_FramesRun;
+}
+
+FrameGraph::StageTiming FrameGraph::GetStageTiming(int stage) const
+{
+    const Stage& timed = *m_Stages[stage];
+    // worker stage jobs are labelled with the stage index (see RunFrame), so the job system keeps their time
+    return { timed.SpanNs, timed.MainThread ? timed.MainThreadBusyNs : JobSystem::GetPhaseBusyNs(stage), timed.Runs };
+}
+
+FrameGraph::StageReport FrameGraph::GetStageReport(int stageIndex, bool reset)
+{
+    Stage& stage = *m_Stages[stageIndex];
+    LatencyHistogram::Summary none = { 0, 0, 0, 0 };
+    StageReport report = {
+        stage.SpanTimes.Summarise(reset),
+        stage.MainThread ? stage.DependencyWaitTimes.Summarise(reset) : none,
+        stage.MainThread ? none : JobSystem::SummariseJobTimes(stageIndex, reset),
+        stage.OverBudget
+    };
+    if (reset)
+    {
+        stage.OverBudget = 0;
+    }
+    return report;
+}
+
+FrameGraph::FrameReport FrameGraph::GetFrameReport(bool reset)
+{
+    FrameReport report = { m_FrameTimes.Summarise(reset), m_EndOfFrameWaitTimes.Summarise(reset), m_FramesOverBudget };
+    if (reset)
+    {
+        m_FramesOverBudget = 0;
+    }
+    return report;
+}
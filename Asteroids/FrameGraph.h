@@ -0,0 +1,162 @@
+#pragma once
+#include "JobSystemConfig.h"
+#include "JobSystem.h"
+#include "JobCoroutine.h"
+#include "LatencyHistogram.h"
+#include "SubmissionBuffer.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+// one bit per piece of shared state, stages declare how they touch each one
+typedef uint32_t ResourceMask;
+
+// declarative replacement for a hard-wired ring of phases
+// stages are added in the order they would run on a single thread, each declares what it reads, writes (exclusively) and shares (mutates
+// concurrently with other sharers, e.g. partitioned or internally synchronised like the collision grid), and Build() adds an edge from every
+// earlier stage it conflicts with - so a stage starts as soon as the stages it actually depends on are done, rather than at a global barrier
+// worker stages are a set of jobs kicked when their dependencies complete, main thread stages are run by the main thread inside RunFrame in
+// the order they were added (helping with worker jobs while their dependencies finish)
+class FrameGraph
+{
+public:
+    FrameGraph() = default;
+    FrameGraph(const FrameGraph&) = delete;
+    FrameGraph& operator=(const FrameGraph&) = delete;
+
+    // returns the index of the stage, the counter of each declaration is replaced with the stage's own (a pooled counter allocated each frame)
+    int AddWorkerStage(const std::string& name, ResourceMask reads, ResourceMask writes, ResourceMask shared, const std::vector<JobSystem::Declaration>& jobs);
+    // the job of a main thread stage is run directly by RunFrame, its priority and counter are ignored
+    int AddMainThreadStage(const std::string& name, ResourceMask reads, ResourceMask writes, ResourceMask shared, const JobSystem::Declaration& job);
+    // works out the edges, call once after all stages are added
+    void Build();
+
+    // main thread only - runs one frame of the graph to completion
+    void RunFrame();
+    // main thread only, between frames - a skipped stage completes as soon as its dependencies have, without running its own jobs (jobs
+    // added to it still run) and without counting towards its timings, so a frame can leave out e.g. the simulation and only draw
+    // stays skipped until it's unskipped
+    void SetStageSkipped(int stage, bool skipped) { m_Stages[stage]->Skipped = skipped; }
+
+    // add a job to a worker stage which hasn't started yet this frame, thread-safe and lock-free
+    // only call from a stage the target depends on (i.e. one which writes/shares something the target reads), otherwise it could be too late
+    void AddJobToStage(int stage, const JobSystem::Declaration& decl);
+
+    // co_await graph.ResumeInStage(stage) - the rest of the coroutine runs as one of the stage's jobs this frame, so it's covered by that stage's
+    // resource declarations and the stage isn't complete until it's done (same rules as AddJobToStage for which stages can do this)
+    struct StageAwaiter
+    {
+        FrameGraph* pGraph;
+        int Stage;
+        JobSystem::Priority ResumePriority;
+
+        bool await_ready() const { return false; }
+        void await_suspend(std::coroutine_handle<> coroutine) const
+        {
+            pGraph->AddJobToStage(Stage, JobSystem::MakeResumeJob(coroutine, ResumePriority));
+        }
+        void await_resume() const {}
+    };
+    StageAwaiter ResumeInStage(int stage, JobSystem::Priority priority = JobSystem::Priority::NORMAL) { return { this, stage, priority }; }
+
+    bool IsStageRunning(int stage) const { return m_Stages[stage]->State.load() == StageState::RUNNING; }
+    // handle to this frame's counter for a worker stage, lets something wait on just that stage - the counter is freed when the stage
+    // completes so the handle goes stale (and waiting on it returns) rather than dangling
+    JobSystem::CounterHandle GetStageCounter(int stage) const { return m_Stages[stage]->Handle; }
+    int GetStageCount() const { return static_cast<int>(m_Stages.size()); }
+    const std::string& GetStageName(int stage) const { return m_Stages[stage]->Name; }
+    // stages which must complete before this one can start
+    const std::vector<int>& GetStageDependencies(int stage) const { return m_Stages[stage]->Dependencies; }
+
+    // timing of a stage summed over every frame it ran in (wasn't skipped) so far - span is from the stage starting to it completing, busy is the time spent running
+    // its jobs summed over every thread (the same as the span for a main thread stage), so busy / span is how parallel the stage ran and
+    // comparing against a SERIAL run gives the speedup
+    struct StageTiming
+    {
+        long long SpanNs;
+        long long BusyNs;
+        int Runs;
+    };
+    StageTiming GetStageTiming(int stage) const;
+    int GetFramesRun() const { return m_FramesRun; }
+
+    // distributions for periodic reports, recorded every frame (see LatencyHistogram for the cost) - reset starts the next report from now
+    // a stage or frame which takes longer than its budget (0 for none) is counted as over budget, and a frame over budget is marked in the trace
+    void SetStageBudget(int stage, long long budgetNs) { m_Stages[stage]->BudgetNs = budgetNs; }
+    long long GetStageBudget(int stage) const { return m_Stages[stage]->BudgetNs; }
+    void SetFrameBudget(long long budgetNs) { m_FrameBudgetNs = budgetNs; }
+    long long GetFrameBudget() const { return m_FrameBudgetNs; }
+    struct StageReport
+    {
+        LatencyHistogram::Summary Span;
+        // main thread stages, how long the main thread waited on (helping with) the stage's dependencies before it could start it
+        LatencyHistogram::Summary DependencyWait;
+        // worker stages, each job of the stage on its own
+        LatencyHistogram::Summary Jobs;
+        int OverBudget;
+    };
+    StageReport GetStageReport(int stage, bool reset);
+    struct FrameReport
+    {
+        // RunFrame from start to finish
+        LatencyHistogram::Summary Frame;
+        // after the last main thread stage, waiting for the worker stages still running
+        LatencyHistogram::Summary EndOfFrameWait;
+        int OverBudget;
+    };
+    FrameReport GetFrameReport(bool reset);
+
+private:
+    enum class StageState { WAITING, RUNNING, DONE };
+
+    struct Stage
+    {
+        std::string Name;
+        ResourceMask Reads = 0;
+        ResourceMask Writes = 0;
+        ResourceMask Shared = 0;
+        bool MainThread = false;
+        bool Skipped = false;
+
+        // worker stage - the jobs kicked every frame, plus any added during the frame by earlier stages
+        std::vector<JobSystem::Declaration> Jobs;
+        SubmissionBuffer<JobSystem::Declaration> AddedJobs{ 1024 };
+        JobSystem::Counter* pCounter = nullptr;
+        JobSystem::CounterHandle Handle;
+
+        // main thread stage
+        JobSystem::Declaration MainThreadJob{};
+
+        std::vector<int> Dependencies;
+        std::vector<int> Dependents;
+        std::atomic<int> PendingDependencies{ 0 };
+        std::atomic<StageState> State{ StageState::WAITING };
+
+        // this frame's start and end, set by whichever thread starts/completes the stage and added up by the main thread at the end of the frame
+        std::chrono::steady_clock::time_point StartTime;
+        std::chrono::steady_clock::time_point EndTime;
+        long long SpanNs = 0;
+        long long MainThreadBusyNs = 0;
+        int Runs = 0;
+
+        // per frame, only touched by the main thread
+        LatencyHistogram SpanTimes;
+        LatencyHistogram DependencyWaitTimes;
+        long long BudgetNs = 0;
+        int OverBudget = 0;
+    };
+    std::vector<std::unique_ptr<Stage>> m_Stages;
+    std::atomic<int> m_StagesRemaining{ 0 };
+    int m_FramesRun = 0;
+
+    LatencyHistogram m_FrameTimes;
+    LatencyHistogram m_EndOfFrameWaitTimes;
+    long long m_FrameBudgetNs = 0;
+    int m_FramesOverBudget = 0;
+
+    static bool StagesConflict(const Stage& a, const Stage& b);
+    int AddStage(std::unique_ptr<Stage> stage);
+    void StartWorkerStage(int stage);
+    // counter continuation, called by whichever thread finishes the last job of the stage
+    void CompleteStage(uintptr_t stage);
+};
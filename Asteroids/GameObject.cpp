@@ -19,21 +19,33 @@ GameObject::GameObject(const GameObject& other)
 	m_ID = NextId.fetch_add(1);
 }
 
-void GameObject::CreateSnapshot()
+void GameObject::LeaveEntityStore()
 {
-	m_Sprite.setRotation(m_Rotation);
-	m_Sprite.setPosition(m_Position);
+	m_Position = GetPosition();
+	m_Rotation = GetRotation();
+	m_EntityChunk = nullptr;
 }
 
 void GameObject::SetBothRotations(float rot)
 {
 	m_Rotation = rot;
-	m_Sprite.setRotation(rot);
+	if (m_EntityChunk)
+	{
+		// set rather than moved to, so it isn't interpolated
+		m_EntityChunk->LiveRot()[m_EntityRow] = rot;
+		m_EntityChunk->LivePrevRot()[m_EntityRow] = rot;
+	}
 }
 void GameObject::SetBothPositions(const sf::Vector2f& pos)
 {
 	m_Position = pos;
-	m_Sprite.setPosition(pos);
+	if (m_EntityChunk)
+	{
+		m_EntityChunk->LivePosX()[m_EntityRow] = pos.x;
+		m_EntityChunk->LivePosY()[m_EntityRow] = pos.y;
+		m_EntityChunk->LivePrevPosX()[m_EntityRow] = pos.x;
+		m_EntityChunk->LivePrevPosY()[m_EntityRow] = pos.y;
+	}
 }
 void GameObject::SetSpriteTexture(sf::Texture& _tex)
 {
@@ -41,19 +53,22 @@ void GameObject::SetSpriteTexture(sf::Texture& _tex)
 	m_Sprite.setOrigin((sf::Vector2f)_tex.getSize() / 2.f);
 }
 
-void GameObject::ReinitialiseObject(const sf::Vector2f& newPos, const float& newRot, const std::shared_ptr<GameObject>& obj)
+void GameObject::ReinitialiseObject(const sf::Vector2f& newPos, const float& newRot)
 {
 	SetBothPositions(newPos);
 	SetBothRotations(newRot);
-	Gamestate::instance->AddToActiveObjects(obj);
+	Gamestate::instance->AddToActiveObjects(m_Handle);
 	Reinitialise();
 }
 
-void GameObject::CloneComponentsFromOther(std::shared_ptr<GameObject>& self, GameObject* other)
+void GameObject::CloneComponentsFromOther(GameObject* other)
 {
-	for (auto itr = other->m_Components.begin(); itr != other->m_Components.end(); ++itr)
+	for (int i = 0; i < MAX_COMPONENT_TYPES; ++i)
 	{
-		self->m_Components[itr->first] = itr->second->CloneToUniquePtr(self);
+		if (other->m_Components[i])
+		{
+			m_Components[i] = other->m_Components[i]->CloneToUniquePtr(this);
+		}
 	}
 }
 
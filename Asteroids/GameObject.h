@@ -1,23 +1,40 @@
 #pragma once
 #include "Top.h"
 #include "ThreadSafeSet.h"
-#include <unordered_map>
+#include "SlotMap.h"
+#include "EntityStore.h"
+#include "ObjectRegistry.h"
 
 class Component;
 
+// one slot per component type, see ComponentIdCounter
+const int MAX_COMPONENT_TYPES = 4;
+
 // base class from which all objects should inherit, acts as a wrapper of sorts for sf::Sprite and also owns the components e.g. collision for that object
-// the position and rotation in the sprite is used to store a snapshot of the object's state at the end of the previous frame, the main thread
-// can then draw using that, whilst the other threads are updating each object's m_Rotation and m_Position
+// the sprite only holds the texture and origin, what's drawn is the object's transform from the frozen half of its entity row (see RenderObject),
+// so nothing is copied out of the object for the main thread to draw it whilst the other threads are updating the live half
+// the per-frame logic isn't here, it runs as systems over the entity store's chunks (see EntitySystems.cpp), this is what's left - spawning,
+// collision handling and anything else which needs the object rather than its row
 class GameObject
 {
 private:
 	static std::atomic<int> NextId;
 	int m_ID;
-	std::unordered_map<int, std::unique_ptr<Component>> m_Components;
+	// given by the registry which owns the object, see ObjectRegistry
+	ObjectHandle m_Handle;
+	// indexed by component id, so a lookup is an array index rather than a hash
+	std::unique_ptr<Component> m_Components[MAX_COMPONENT_TYPES];
+	// where the object is in the game's active objects, stale whenever it isn't in them (see Gamestate::CleanUp)
+	SlotHandle m_ActiveHandle;
+	// the object's row in the entity store while it's active, which holds its transform and motion - null while it isn't in the store, and
+	// they're in the members below instead
+	EntityChunk* m_EntityChunk = nullptr;
+	int m_EntityRow = 0;
 
 protected:
 	sf::Sprite m_Sprite;
 	bool m_Active = true;
+	// only while out of the entity store, use GetPosition etc.
 	float m_Rotation = 0;
 	sf::Vector2f m_Position = { 0,0 };
 
@@ -31,19 +48,28 @@ public:
 	void SetInactive() { m_Active = false; }
 	bool GetActive() const { return m_Active; }
 	int getId() const {	return m_ID; }
-	float GetRotation() const { return m_Rotation; }
-	sf::Vector2f GetPosition() const { return m_Position; }
+	ObjectHandle GetHandle() const { return m_Handle; }
+	void SetHandle(ObjectHandle handle) { m_Handle = handle; }
+	SlotHandle GetActiveHandle() const { return m_ActiveHandle; }
+	void SetActiveHandle(SlotHandle handle) { m_ActiveHandle = handle; }
+	float GetRotation() const { return m_EntityChunk ? m_EntityChunk->LiveRot()[m_EntityRow] : m_Rotation; }
+	sf::Vector2f GetPosition() const { return m_EntityChunk ? sf::Vector2f(m_EntityChunk->LivePosX()[m_EntityRow], m_EntityChunk->LivePosY()[m_EntityRow]) : m_Position; }
 	virtual bool GetOccluder() const { return false; }
 	void SetBothRotations(float rot);
 	void SetBothPositions(const sf::Vector2f& pos);
 
-	// used for double buffering
-	void CreateSnapshot();
-	// called every frame in parallel with all other updates
-	virtual void Update(float deltaTime) = 0;
+	// entity store, see EntityStore::Add/Remove
+	virtual EntityArchetype GetArchetype() const = 0;
+	// fills in the rest of the object's row when it joins the store, the transform is already copied in
+	virtual void InitialiseEntity(EntityChunk& /*chunk*/, int /*row*/) {}
+	EntityChunk* GetEntityChunk() const { return m_EntityChunk; }
+	int GetEntityRow() const { return m_EntityRow; }
+	void SetEntityLocation(EntityChunk* chunk, int row) { m_EntityChunk = chunk; m_EntityRow = row; }
+	// takes its transform back out of the store
+	void LeaveEntityStore();
 
 	// called when object is returned from an object pool
-	void ReinitialiseObject(const sf::Vector2f& newPos, const float& newRot, const std::shared_ptr<GameObject>& obj);
+	void ReinitialiseObject(const sf::Vector2f& newPos, const float& newRot);
 	// called in above function, implements class specific reinitialisation
 	virtual void Reinitialise() = 0;
 
@@ -64,8 +90,8 @@ public:
 	virtual sf::Vector2f GetTextureAtlasOffsetBR() const { return { 0,0 }; }
 
 	// clone function used in object pool
-	virtual std::shared_ptr<GameObject> CloneToSharedPtr() = 0;
-	void CloneComponentsFromOther(std::shared_ptr<GameObject>& self, GameObject* other);
+	virtual std::unique_ptr<GameObject> CloneToUniquePtr() = 0;
+	void CloneComponentsFromOther(GameObject* other);
 
 	// access and add components by type, no RTTI, uses class specific int to key the map, allows forwarding of args to component constructor
 	template<typename T, typename... Args>
@@ -81,6 +107,7 @@ T* GameObject::AddComponent(Args&&... args)
 	static_assert(std::is_base_of<Component, T>::value, "T must derive from Component");
 	auto uComponent = std::make_unique<T>(std::forward<Args>(args)...);
 	auto pComponent = uComponent.get();
+	assert(T::GetId() < MAX_COMPONENT_TYPES);
 	m_Components[T::GetId()] = std::move(uComponent);
 	return pComponent;
 }
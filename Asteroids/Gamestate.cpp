@@ -8,38 +8,31 @@
 #include "Projectile.h"
 #include "CollisionGrid.h"
 #include "Particles.h"
+#include "JobTrace.h"
+#include "EntitySystems.h"
+#include "Random.h"
+#include "CpuFeatures.h"
 #include <immintrin.h>
 
-thread_local int ThreadIndex;
 Gamestate* Gamestate::instance{ nullptr };
 
-bool TextureAndIDComparator::operator()(const std::shared_ptr<GameObject>& lhs, const std::shared_ptr<GameObject>& rhs) const
-{
-	if (lhs->GetSprite().getTexture() != rhs->GetSprite().getTexture())
-	{
-		return lhs->GetSprite().getTexture() < rhs->GetSprite().getTexture();
-	}
-	return lhs->getId() < rhs->getId();
-}
-
-int random_int(int range_lower, int range_upper)
-{
-	if (range_lower > range_upper) throw std::out_of_range("rand int bad");
-	if (range_upper == range_lower) return range_lower;
-	std::random_device rd;
-	std::mt19937 rng(rd());
-	std::uniform_int_distribution<std::mt19937::result_type> rnd_dist(range_lower, range_upper);
-	return rnd_dist(rng);
-}
-
 Gamestate::Gamestate()
 {
 	if (instance == nullptr) instance = this;
-	m_PoolManager = std::make_shared<ObjectPoolManager>();
+	m_PoolManager = std::make_shared<ObjectPoolManager>(m_Objects);
 	m_CollisionGrid = std::make_shared<ObjectCollisionGrid>();
 
-	m_ObjectsToAdd = std::vector<std::vector<std::shared_ptr<GameObject>>>(NUM_THREADS, std::vector<std::shared_ptr<GameObject>>());
-	m_ObjectsToCleanUp = std::vector<std::vector<std::shared_ptr<GameObject>>>(NUM_THREADS, std::vector<std::shared_ptr<GameObject>>());
+	// parallel loops for the frame's stages, grains are the smallest range worth a job of its own (a whole chunk for the update, 128 blocks of
+	// 8 particles as a block only takes a few nanoseconds), the chunk and cell loops have cost hints since asteroids cost more to update than
+	// projectiles and crowded cells much more to resolve than empty ones
+	m_UpdateLoop = std::make_unique<JobSystem::ParallelForLoop>(
+		JobSystem::RangeFunctionWrapper{ this, &JobSystem::RangeFunctionDispatcher<Gamestate, &Gamestate::UpdateEntityChunkRange> }, 1, JobSystem::Priority::HIGH,
+		JobSystem::RangeCostWrapper{ this, &JobSystem::RangeCostDispatcher<Gamestate, &Gamestate::GetUpdateCostOfRange> });
+	m_ParticleLoop = std::make_unique<JobSystem::ParallelForLoop>(
+		JobSystem::RangeFunctionWrapper{ this, &JobSystem::RangeFunctionDispatcher<Gamestate, &Gamestate::UpdateParticleRange> }, 128, JobSystem::Priority::NORMAL);
+	m_CollisionLoop = std::make_unique<JobSystem::ParallelForLoop>(
+		JobSystem::RangeFunctionWrapper{ m_CollisionGrid.get(), &JobSystem::RangeFunctionDispatcher<ObjectCollisionGrid, &ObjectCollisionGrid::ResolveCollisionsOfCells> }, 8, JobSystem::Priority::HIGH,
+		JobSystem::RangeCostWrapper{ m_CollisionGrid.get(), &JobSystem::RangeCostDispatcher<ObjectCollisionGrid, &ObjectCollisionGrid::EstimateCellCost> });
 
 #if USE_CPU_FOR_OCCLUDERS
 	m_PixelPrep = (int*)std::malloc(SCREEN_HEIGHT * SCREEN_WIDTH * sizeof(int));
@@ -52,21 +45,13 @@ Gamestate::Gamestate()
 	}
 #endif
 
-	m_PhaseCounter = JobSystem::AllocCounter();
-	m_UnusedTransitionCounter = JobSystem::AllocCounter();
-	m_ParticleSystem = std::make_shared<ParticleSystem>(2000);
-
-	m_CurrentTransitionData = nullptr;
-	m_PhaseTransitionDecl = { nullptr, nullptr, 0, JobSystem::Priority::NORMAL, nullptr };
+	m_ParticleSystem = std::make_shared<ParticleSystem>(PARTICLE_COUNT);
 }
 Gamestate::~Gamestate()
 {
 #if USE_CPU_FOR_OCCLUDERS
 	std::free(m_PixelPrep);
 #endif
-
-	JobSystem::FreeCounter(m_PhaseCounter);
-	JobSystem::FreeCounter(m_UnusedTransitionCounter);
 }
 
 // update for asteroids spawning and overdrive
@@ -86,7 +71,7 @@ void Gamestate::Update(uintptr_t unused)
 		m_Player->SetProjectileCD(m_OverdriveProjectileCD);
 		m_OverdriveTimer = 0;
 		m_Overdrive = true;
-		m_GlowColourChange = GlowColourChange::RED;
+		PostToMainThread(JobSystem::MakeJob([this] { SetGlowColour(m_OverdriveGlowColor); }));
 	}
 	else if (m_OverdriveTimer > 10 && m_Overdrive)
 	{
@@ -94,7 +79,7 @@ void Gamestate::Update(uintptr_t unused)
 		m_Player->SetProjectileCD(m_BaseProjectileCD);
 		m_OverdriveTimer = 0;
 		m_Overdrive = false;
-		m_GlowColourChange = GlowColourChange::BLUE;
+		PostToMainThread(JobSystem::MakeJob([this] { SetGlowColour(m_BaseGlowColor); }));
 	}
 }
 
@@ -209,9 +194,10 @@ void Gamestate::InitialiseShaders()
 #if USE_CPU_FOR_OCCLUDERS
 void Gamestate::Draw(sf::RenderWindow& window)
 {
+	const RenderSnapshot& snapshot = m_RenderSnapshots[m_SnapshotRead];
 	m_BufferRenderTexture1.clear();
 
-	m_GlowShader.setUniform("shipPosition", m_Player->GetPosition());
+	m_GlowShader.setUniform("shipPosition", snapshot.PlayerPosition);
 	m_GlowShader.setUniform("occupancyTex", m_MainTexture);
 	m_BufferRenderTexture1.draw(m_FullScreenQuad, &m_GlowShader);
 	m_BufferRenderTexture1.display();
@@ -228,25 +214,27 @@ void Gamestate::Draw(sf::RenderWindow& window)
 	sf::Sprite sp2(m_BufferRenderTexture2.getTexture());
 	m_BlurShader.setUniform("texture", m_BufferRenderTexture2.getTexture());
 
-	m_FogShader.setUniform("center", m_Player->GetPosition());
+	m_FogShader.setUniform("center", snapshot.PlayerPosition);
 
 	window.draw(sp1, &m_BlurShader);
 	
 	// Draw all Game Objects
-	for (auto& obj : m_AllActiveGameObjects)
+	sf::Sprite sprite;
+	for (const RenderObject& obj : *snapshot.Objects)
 	{
-		window.draw(obj->GetSprite(), &m_FogShader);
+		obj.PlaceSprite(sprite, snapshot.Transforms, m_RenderAlpha);
+		window.draw(sprite, &m_FogShader);
 	}
 
 	// Set values for screen text and draw
-	ScreenText[1].setString(std::to_string(m_TotalScore));
-	ScreenText[3].setString(std::to_string(m_Player->GetLives()));
+	ScreenText[1].setString(std::to_string(snapshot.Score));
+	ScreenText[3].setString(std::to_string(snapshot.Lives));
 	for (size_t i = 0; i < ScreenText.size(); ++i)
 	{
 		window.draw(ScreenText[i]);
 	}
 
-	if (m_Overdrive)
+	if (snapshot.Overdrive)
 	{
 		window.draw(m_OverdriveText);
 	}
@@ -279,35 +267,35 @@ float Gamestate::CalculateDistanceSquared(const sf::Vector2f& point1, const sf::
 	return dx * dx + dy * dy;
 }
 
-void Gamestate::SortObjectsByDistance(std::vector<std::pair<std::shared_ptr<GameObject>, float>>& objs) 
+void Gamestate::SortObjectsByDistance(std::vector<std::pair<const RenderObject*, float>>& objs) 
 {
 	// Sort in descending order so that closer objects are rendered last
-	std::sort(objs.begin(), objs.end(), [](const std::pair<std::shared_ptr<GameObject>, float>& a, const std::pair<std::shared_ptr<GameObject>, float>& b) 
+	std::sort(objs.begin(), objs.end(), [](const std::pair<const RenderObject*, float>& a, const std::pair<const RenderObject*, float>& b) 
 	{
 		return a.second > b.second; 
 	});
 }
-void Gamestate::DrawAsteroidVertexArray(sf::VertexArray& vertices, sf::RenderStates& states, std::vector<std::pair<std::shared_ptr<GameObject>, float>>& objs, sf::RenderTexture& tex, sf::Shader& shader)
+void Gamestate::DrawAsteroidVertexArray(sf::VertexArray& vertices, sf::RenderStates& states, std::vector<std::pair<const RenderObject*, float>>& objs, int transforms, float alpha, sf::RenderTexture& tex, sf::Shader& shader)
 {
 	SortObjectsByDistance(objs);
 	const int spriteCount = objs.size();
 
-	const sf::Texture* texture = objs[0].first->GetSprite().getTexture();
+	const sf::Texture* texture = objs[0].first->Texture;
 
 	for (int i = 0; i < spriteCount; ++i)
 	{
-		sf::Vector2f atlasOffsetTL = objs[i].first->GetTextureAtlasOffsetTL();
-		sf::Vector2f atlasOffsetBR = objs[i].first->GetTextureAtlasOffsetBR();
+		sf::Vector2f atlasOffsetTL = objs[i].first->AtlasOffsetTL;
+		sf::Vector2f atlasOffsetBR = objs[i].first->AtlasOffsetBR;
 
 		float halfWidth = (atlasOffsetBR.x - atlasOffsetTL.x)/2;
 		float halfHeight = (atlasOffsetBR.y - atlasOffsetTL.y)/2;
 
 		float coords[8] = {-halfWidth,halfWidth,halfWidth,-halfWidth, -halfHeight,-halfHeight,halfHeight,halfHeight};
-		float angle = objs[i].first->GetSprite().getRotation();
+		float angle = objs[i].first->GetRotation(transforms, alpha);
 
 		RotateBox(coords, std::sin(angle * TO_RADIANS), std::cos(angle * TO_RADIANS));
 
-		sf::Vector2f position = objs[i].first->GetSprite().getPosition();
+		sf::Vector2f position = objs[i].first->GetPosition(transforms, alpha);
 
 		sf::Color color(255 * (i + 1) / spriteCount,255, 0);
 		sf::Vertex quad[4];
@@ -343,6 +331,8 @@ void Gamestate::DrawAsteroidVertexArray(sf::VertexArray& vertices, sf::RenderSta
 }
 void Gamestate::Draw(sf::RenderWindow& window)
 {
+	const RenderSnapshot& snapshot = m_RenderSnapshots[m_SnapshotRead];
+
 	// clear previous
 	window.clear();
 	m_BufferRenderTexture1.clear();
@@ -356,7 +346,7 @@ void Gamestate::Draw(sf::RenderWindow& window)
 	}
 
 	// update pulse position
-	m_PulsePosition += m_DeltaTime * m_PulseSpeed;
+	m_PulsePosition += m_FrameTime * m_PulseSpeed;
 	m_GlowShader.setUniform("radialPulseStart", m_PulsePosition);
 
 	// ideally should be storing a vertex array and updating it each frame instead of making a new one
@@ -364,18 +354,18 @@ void Gamestate::Draw(sf::RenderWindow& window)
 	sf::RenderStates states;
 
 	// need occluders to be rendered in order, starting with closest to player, for shadows to look ok
-	std::vector<std::pair<std::shared_ptr<GameObject>, float>> occludersWithDistanceToPlayer;
-	for (auto& obj : m_AllActiveGameObjects)
+	std::vector<std::pair<const RenderObject*, float>> occludersWithDistanceToPlayer;
+	for (const RenderObject& obj : *snapshot.Objects)
 	{
-		if (obj->GetOccluder())
+		if (obj.Occluder)
 		{
-			occludersWithDistanceToPlayer.push_back({ obj, CalculateDistanceSquared(obj->GetSprite().getPosition(), m_LastShipPos) });
+			occludersWithDistanceToPlayer.push_back({ &obj, CalculateDistanceSquared(obj.GetPosition(snapshot.Transforms, m_RenderAlpha), m_LastShipPos) });
 		}
 	}
 	if (!occludersWithDistanceToPlayer.empty())
 	{
 		// adds all asteroids to a vertex array, draws each with a unique solid colour, gives an effective occluder/occupancy texture
-		DrawAsteroidVertexArray(vertices, states, occludersWithDistanceToPlayer, m_BufferRenderTexture1, m_LightenShader);
+		DrawAsteroidVertexArray(vertices, states, occludersWithDistanceToPlayer, snapshot.Transforms, m_RenderAlpha, m_BufferRenderTexture1, m_LightenShader);
 	}
 
 	// update uniform if needed
@@ -401,11 +391,13 @@ void Gamestate::Draw(sf::RenderWindow& window)
 	m_FogShader.setUniform("alphaMap", m_BufferRenderTexture2.getTexture());
 
 	// draw all objects non occluders normally
-	for (auto& obj : m_AllActiveGameObjects)
+	sf::Sprite sprite;
+	for (const RenderObject& obj : *snapshot.Objects)
 	{
-		if (!obj->GetOccluder())
+		if (!obj.Occluder)
 		{
-			window.draw(obj->GetSprite());
+			obj.PlaceSprite(sprite, snapshot.Transforms, m_RenderAlpha);
+			window.draw(sprite);
 		}
 	}
 	// draw asteroids still stored in the vertex array using the fog shader
@@ -413,13 +405,13 @@ void Gamestate::Draw(sf::RenderWindow& window)
 	window.draw(vertices, states);
 
 	// Set values for screen text and draw
-	ScreenText[1].setString(std::to_string(m_TotalScore));
-	ScreenText[3].setString(std::to_string(m_Player->GetLives()));
+	ScreenText[1].setString(std::to_string(snapshot.Score));
+	ScreenText[3].setString(std::to_string(snapshot.Lives));
 	for (size_t i = 0; i < ScreenText.size(); ++i)
 	{
 		window.draw(ScreenText[i]);
 	}
-	if (m_Overdrive)
+	if (snapshot.Overdrive)
 	{
 		window.draw(m_OverdriveText);
 	}
@@ -427,27 +419,34 @@ void Gamestate::Draw(sf::RenderWindow& window)
 #endif
 void Gamestate::SpawnLargeAsteroidOffscreen()
 {
-	std::shared_ptr<GameObject> ast = GetPooledObject(Asteroid::AsteroidLargePoolName);
+	GameObject* ast = GetPooledObject(Asteroid::AsteroidLargePoolName);
+	RandomStream rng = MakeObjectStream(Random::Purpose::AsteroidSpawn, *ast);
 	sf::Vector2f newPos;
-	switch (random_int(0, 3))
+	switch (rng.Int(0, 3))
 	{
 	case 0:
-		newPos = { static_cast<float>(random_int(0, SCREEN_WIDTH)), -5.f };
+		newPos = { static_cast<float>(rng.Int(0, SCREEN_WIDTH)), -5.f };
 		break;
 	case 1:
-		newPos = { static_cast<float>(random_int(0, SCREEN_WIDTH)), SCREEN_HEIGHT + 5.f };
+		newPos = { static_cast<float>(rng.Int(0, SCREEN_WIDTH)), SCREEN_HEIGHT + 5.f };
 		break;
 	case 2:
-		newPos = { -5.f, static_cast<float>(random_int(0, SCREEN_HEIGHT)) };
+		newPos = { -5.f, static_cast<float>(rng.Int(0, SCREEN_HEIGHT)) };
 		break;
 	case 3:
-		newPos = { SCREEN_WIDTH + 5.f, static_cast<float>(random_int(0, SCREEN_HEIGHT)) };
+		newPos = { SCREEN_WIDTH + 5.f, static_cast<float>(rng.Int(0, SCREEN_HEIGHT)) };
 		break;
 	}
-	ast->ReinitialiseObject(newPos, 0, ast);
+	ast->ReinitialiseObject(newPos, 0);
+}
+
+RandomStream Gamestate::MakeObjectStream(Random::Purpose purpose, const GameObject& obj) const
+{
+	ObjectHandle handle = obj.GetHandle();
+	return Random::MakeStream(purpose, static_cast<uint64_t>(m_StepsRun), (static_cast<uint64_t>(handle.Generation) << 32) | handle.Index);
 }
 
-void Gamestate::AddToActiveObjects(const std::shared_ptr<GameObject>& obj)
+void Gamestate::AddToActiveObjects(ObjectHandle obj)
 {
 	m_ObjectsToAdd[ThreadIndex].push_back(obj);
 }
@@ -461,246 +460,306 @@ uint8_t Gamestate::AddToCollisionGrid(GameObject* obj, int newX, int newY, uint1
 	return m_CollisionGrid->InsertObject(obj, newX, newY, selfMask, otherMask);
 }
 
-void Gamestate::AddToCleanupObjects(std::shared_ptr<GameObject> obj)
+void Gamestate::AddToCleanupObjects(ObjectHandle obj)
 {
-	m_ObjectsToCleanUp[ThreadIndex].push_back(obj);
-	auto x = JobData_Indices(ThreadIndex, static_cast<uint16_t>(m_ObjectsToCleanUp[ThreadIndex].size() - 1));
-	JobSystem::AddJobToBuffer({
-	{ instance, &JobSystem::MemberFunctionDispatcher<Gamestate, &Gamestate::ProcessInactiveObjects> },
-		static_cast<uintptr_t>(x.value),
-		JobSystem::Priority::HIGH,
-		m_PhaseCounter
-	});
+	CleanUpObject(obj);
 }
-void Gamestate::AddToCleanupObjectsDelayed(std::shared_ptr<GameObject> obj)
+// queued now for CleanUp to take out of the active set and return to its pool, taking it out of the collision grid runs in the process inactive
+// objects stage once collisions are resolved (the object can't have been destroyed by then, it's not back in its pool until CleanUp)
+JobSystem::Coroutine Gamestate::CleanUpObject(ObjectHandle handle)
 {
-	m_ObjectsToCleanUp[ThreadIndex].push_back(obj);
-	auto x = JobData_Indices(ThreadIndex, static_cast<uint16_t>(m_ObjectsToCleanUp[ThreadIndex].size() - 1));
-	JobSystem::AddJobToDelayedBuffer({
-	{ instance, &JobSystem::MemberFunctionDispatcher<Gamestate, &Gamestate::ProcessInactiveObjects> },
-		static_cast<uintptr_t>(x.value),
-		JobSystem::Priority::HIGH,
-		m_PhaseCounter
-	});
+	m_ObjectsToCleanUp[ThreadIndex].push_back(handle);
+	co_await m_FrameGraph.ResumeInStage(m_ProcessInactiveObjectsStage);
+	GameObject* obj = m_Objects.Get(handle);
+	assert(obj != nullptr);
+	if (obj)
+	{
+		ProcessInactiveObject(obj);
+	}
+}
+// the process inactive objects stage always runs after collisions are resolved, so this is now the same as AddToCleanupObjects, kept so
+// callers can still say the object has to survive until after collision resolution
+void Gamestate::AddToCleanupObjectsDelayed(ObjectHandle obj)
+{
+	AddToCleanupObjects(obj);
 }
 
-void Gamestate::MakeUpdateJobData()
+void Gamestate::RebuildActiveObjectIndices()
 {
-	int numObjects = m_AllActiveGameObjects.size();
-	int numThreads = std::min(NUM_THREADS, numObjects);
-	int baseInterval = numObjects / numThreads;
-	int remainingObjects = numObjects % numThreads;
+	m_Entities.RebuildChunkList();
+	int chunkCount = m_Entities.GetChunkCount();
+	m_ChunkCostPrefix.resize(chunkCount + 1);
+	m_ChunkCostPrefix[0] = 0.f;
+	for (int i = 0; i < chunkCount; ++i)
+	{
+		m_ChunkCostPrefix[i + 1] = m_ChunkCostPrefix[i] + m_Entities.GetUpdateCost(m_Entities.GetChunk(i));
+	}
+	m_UpdateLoop->SetCount(chunkCount);
 
-	GameObjectMultiset::iterator startItr = m_AllActiveGameObjects.begin();
-	GameObjectMultiset::iterator endItr = startItr;
-		
-	for (int i = 0; i < NUM_THREADS; ++i)
+	int count = m_ActiveObjects.Size();
+	m_DrawOrder.resize(count);
+	for (int i = 0; i < count; ++i)
+	{
+		m_DrawOrder[i] = i;
+	}
+	// grouped by texture, then by id so the order is the same every frame however the objects were packed
+	std::sort(m_DrawOrder.begin(), m_DrawOrder.end(), [this](int lhs, int rhs)
 	{
-		if (startItr == m_AllActiveGameObjects.end())
+		const sf::Texture* lhsTexture = m_ActiveObjects[lhs]->GetSprite().getTexture();
+		const sf::Texture* rhsTexture = m_ActiveObjects[rhs]->GetSprite().getTexture();
+		if (lhsTexture != rhsTexture)
 		{
-			m_JobIterators[i] = { m_AllActiveGameObjects.end(), m_AllActiveGameObjects.end() };
+			return lhsTexture < rhsTexture;
 		}
-		else
-		{
-			int interval = baseInterval;
-			if (i < remainingObjects)
-			{
-				interval++;
-			}
-			for (int i = 0; i < interval; ++i)
-			{
-				++endItr;
-			}
-			m_JobIterators[i] = { startItr, endItr };
-			startItr = endItr;
-		}
-	}
+		return m_ActiveObjects[lhs]->getId() < m_ActiveObjects[rhs]->getId();
+	});
+	RebuildDrawList();
 }
 
-void Gamestate::MakeCollisionJobData()
+// every object is in the entity store by now, so the rows are where the transforms this snapshot draws will be
+void Gamestate::RebuildDrawList()
 {
-	int numCells = GRID_RESOLUTION * GRID_RESOLUTION;
-	int numThreads = std::min(NUM_THREADS, numCells);
-	int baseInterval = numCells / numThreads;
-	int remainingObjects = numCells % numThreads;
-
-	int startIndex = 0;
-	int endIndex = 0;
-	for (int i = 0; i < numThreads; ++i)
+	std::vector<RenderObject>& drawList = m_DrawLists[1 - m_DrawListInSnapshot];
+	// capacity only grows, so this stops allocating once the object count has peaked
+	drawList.resize(m_DrawOrder.size());
+	for (size_t i = 0; i < m_DrawOrder.size(); ++i)
 	{
-		int interval = baseInterval;
-		if (i < remainingObjects)
-		{
-			interval++;
-		}
-
-		endIndex = startIndex + interval - 1;
-		m_JobInts[i] = { startIndex, endIndex };
-		startIndex = endIndex + 1;
+		GameObject* obj = m_ActiveObjects[m_DrawOrder[i]];
+		const sf::Sprite& sprite = obj->GetSprite();
+		drawList[i] = { sprite.getTexture(), sprite.getOrigin(), obj->GetEntityChunk(), obj->GetEntityRow(),
+			obj->GetTextureAtlasOffsetTL(), obj->GetTextureAtlasOffsetBR(), obj->GetOccluder() };
 	}
+	m_DrawListRebuilt = true;
 }
 
-void Gamestate::UpdateGameObjectSection(uintptr_t pData)
+void RenderObject::PlaceSprite(sf::Sprite& sprite, int transforms, float alpha) const
 {
-	JobData_Iterators* data = reinterpret_cast<JobData_Iterators*>(pData);
-	GameObjectMultiset::iterator startItr = data->start;
-	GameObjectMultiset::iterator endItr = data->end;
-	while(startItr != endItr)
-	{
-		(*startItr++)->Update(m_DeltaTime);
-	}
+	sprite.setTexture(*Texture, true);
+	sprite.setOrigin(Origin);
+	sprite.setPosition(GetPosition(transforms, alpha));
+	sprite.setRotation(GetRotation(transforms, alpha));
 }
 
-void Gamestate::UpdateParticleSystem(uintptr_t data)
+void Gamestate::UpdateEntityChunkRange(int begin, int end)
 {
-	JobData_Indices iData(data);
-	float angle = m_Player->GetSprite().getRotation() - 270;
-	int offsetMult = 25;
-	if (iData.indices.first == 0)
+	for (int i = begin; i < end; ++i)
 	{
-		m_ParticleSystem->SetEmitter(m_Player->GetSprite().getPosition() + sf::Vector2f(std::cos(angle* TO_RADIANS)* offsetMult, std::sin(angle*TO_RADIANS)* offsetMult));
+		EntitySystems::RunOnChunk(m_Entities.GetChunk(i), m_DeltaTime);
 	}
-	m_ParticleSystem->Update(m_Elapsed, iData.indices.first, iData.indices.second,angle);
 }
 
-
-void Gamestate::CreateUpdateJobs()
+float Gamestate::GetUpdateCostOfRange(int begin, int end) const
 {
-	int particleJobs = 4;
-	JobPrepataionData prepData(NUM_THREADS + 1 + particleJobs, m_PhaseCounter);
-	MakeUpdateJobData();
-
-	for (int i = 0; i < NUM_THREADS; ++i)
-	{
-		prepData.Declarations[i] = {
-			{ instance, &JobSystem::MemberFunctionDispatcher<Gamestate, &Gamestate::UpdateGameObjectSection> },
-			reinterpret_cast<uintptr_t>(&m_JobIterators[i]),
-			JobSystem::Priority::HIGH,
-			prepData.Counter
-		};
-	}
+	return m_ChunkCostPrefix[end] - m_ChunkCostPrefix[begin];
+}
 
-	prepData.Declarations[NUM_THREADS] = {
-		{ instance, &JobSystem::MemberFunctionDispatcher<Gamestate, &Gamestate::Update> },
-		0,
-		JobSystem::Priority::HIGH,
-		prepData.Counter
-	};
+void Gamestate::UpdateParticleRange(int begin, int end)
+{
+	const RenderSnapshot& snapshot = m_RenderSnapshots[m_SnapshotRead];
+	float angle = snapshot.PlayerRotation - 270;
+	int offsetMult = 25;
+	sf::Vector2f emitter = snapshot.PlayerPosition + sf::Vector2f(std::cos(angle* TO_RADIANS)* offsetMult, std::sin(angle*TO_RADIANS)* offsetMult);
+	// a stream for this range of this step, so what's drawn from it doesn't depend on the thread the range landed on or what else ran there
+	RandomStream rng = Random::MakeStream(Random::Purpose::Particles, static_cast<uint64_t>(m_StepsRun), static_cast<uint64_t>(begin));
+	m_ParticleSystem->Update(m_Elapsed.asSeconds(), begin, end, emitter, angle, rng);
+}
 
-	int interval = m_ParticleSystem->GetParticleCount() / particleJobs;
-	assert(m_ParticleSystem->GetParticleCount() % particleJobs == 0);
 
-	for (int i = NUM_THREADS + 1; i < NUM_THREADS + 1 + particleJobs; ++i)
-	{
-		auto x = JobData_Indices((i - NUM_THREADS - 1) * interval, (i - NUM_THREADS) * interval - 1);
-		prepData.Declarations[i] = {
-			{ instance, &JobSystem::MemberFunctionDispatcher<Gamestate, &Gamestate::UpdateParticleSystem> },
-			static_cast<uintptr_t>(x.value),
-			JobSystem::Priority::HIGH,
-			prepData.Counter
-		};
-	}
-	m_JobPrepData.push_back(std::make_unique<JobPrepataionData>(prepData));
-	m_JobPhaseTransitions.push_back(std::make_unique<ThreadPhaseTransitionData>(&m_JobPrepData.back()->Declarations, false));
+// each parallel stage is a single job running a ParallelFor loop, which splits itself between threads as they become free
+std::vector<JobSystem::Declaration> Gamestate::CreateUpdateJobs()
+{
+	return { m_UpdateLoop->MakeJob() };
 }
 
-void Gamestate::CreateCollisionJobs()
+std::vector<JobSystem::Declaration> Gamestate::CreateParticleJobs()
 {
-	JobPrepataionData prepData(NUM_THREADS, m_PhaseCounter);
-	MakeCollisionJobData();
-
-	for (int i = 0; i < NUM_THREADS; ++i)
-	{
-		prepData.Declarations[i] = {
-			{ m_CollisionGrid.get(), &JobSystem::MemberFunctionDispatcher<ObjectCollisionGrid, &ObjectCollisionGrid::ResolveCollisionsOfCells> },
-			reinterpret_cast<uintptr_t>(&m_JobInts[i]),
-			JobSystem::Priority::HIGH,
-			prepData.Counter
-		};
-	}
-	m_JobPrepData.push_back(std::make_unique<JobPrepataionData>(prepData));
-	m_JobPhaseTransitions.push_back(std::make_unique<ThreadPhaseTransitionData>(&m_JobPrepData.back()->Declarations, true));
+	m_ParticleLoop->SetCount(m_ParticleSystem->GetBlockCount());
+	return { m_ParticleLoop->MakeJob() };
 }
 
-void Gamestate::CreateCleanupJobs()
+std::vector<JobSystem::Declaration> Gamestate::CreateCollisionJobs()
 {
-	JobPrepataionData prepData(1 , m_PhaseCounter);
-
-	prepData.Declarations[0] = {
-		{ m_CollisionGrid.get(), &JobSystem::MemberFunctionDispatcher<ObjectCollisionGrid, &ObjectCollisionGrid::ClearFrameCollisionPairs>},
-		0,
-		JobSystem::Priority::HIGH,
-		prepData.Counter
-	};
-	
-	m_JobPrepData.push_back(std::make_unique<JobPrepataionData>(prepData));
-	m_JobPhaseTransitions.push_back(std::make_unique<ThreadPhaseTransitionData>(&m_JobPrepData.back()->Declarations, true));
+	m_CollisionLoop->SetCount(GRID_RESOLUTION * GRID_RESOLUTION);
+	return { m_CollisionLoop->MakeJob() };
 }
 
-void Gamestate::CreateSnapshotJobs()
+std::vector<JobSystem::Declaration> Gamestate::CreateSnapshotJobs()
 {
-	JobPrepataionData prepData(NUM_THREADS, m_PhaseCounter);
-	MakeUpdateJobData();
-
-	for (int i = 0; i < NUM_THREADS; ++i)
-	{
-		prepData.Declarations[i] = {
-			{ instance, &JobSystem::MemberFunctionDispatcher<Gamestate, &Gamestate::CreateSnapshotForGameObjectSection> },
-			reinterpret_cast<uintptr_t>(&m_JobIterators[i]),
-			JobSystem::Priority::HIGH,
-			prepData.Counter
-		};
-	}
-	m_JobPrepData.push_back(std::make_unique<JobPrepataionData>(prepData));
-	m_JobPhaseTransitions.push_back(std::make_unique<ThreadPhaseTransitionData>(&m_JobPrepData.back()->Declarations, true));
+	// nothing is copied per object, so this is one small job however many there are
+	return { JobSystem::MakeJob([this] { TakeRenderSnapshot(); }, JobSystem::Priority::HIGH, nullptr, &m_RenderSnapshots) };
 }
 
 void Gamestate::CreateUpkeepJobs()
 {
-	JobSystem::AddJobToUpkeep({
-		{ m_PoolManager.get(), &JobSystem::MemberFunctionDispatcher<ObjectPoolManager, &ObjectPoolManager::MaintainPoolBuffers>},
-		0,
-		JobSystem::Priority::LOW,
-		nullptr
-	});
+	// pools are topped up every frame so spawns in the next one find objects waiting, falling behind by a few frames is fine
+	JobSystem::UpkeepSchedule poolSchedule;
+	poolSchedule.EveryFrames = 1;
+	poolSchedule.DeadlineNs = 50000000;
+	JobSystem::AddJobToUpkeep(JobSystem::MakeMemberJob<ObjectPoolManager, &ObjectPoolManager::MaintainPoolBuffers>(m_PoolManager.get(),
+		JobSystem::Priority::LOW), poolSchedule);
 }
 
-void Gamestate::ManageThreadPhaseTransition(uintptr_t data)
+// the whole frame, listed in the order the stages would run on a single thread - the graph works out which stages can overlap from what each
+// one reads, writes and shares, so adding a stage is just adding it here with honest resource declarations
+// priorities: object update, collision and snapshot are HIGH, cosmetic (particles) and per-object cleanup are NORMAL, pool upkeep is LOW
+void Gamestate::CreateFrameGraph(sf::RenderWindow& window)
 {
-	ThreadPhaseTransitionData* transitionData = reinterpret_cast<pTPTD*>(data)->pData;
-	m_CurrentTransitionData = m_JobPhaseTransitions[IncrementAndGetPhaseIndex()].get();
-
-	JobSystem::SetIncludeMainThread(transitionData->IncludeMainThread);
-	JobSystem::AddJobsToBuffer(*(transitionData->NextDeclarations));
-	JobSystem::AddJobToBuffer(m_PhaseTransitionDecl);
+	using namespace FrameResource;
+	sf::RenderWindow* pWindow = &window;
+
+	// Update: run the entity systems over every chunk of the store, moving every object and updating its place in the collision grid, objects can
+	// spawn others from the pools and queue themselves for removal
+	int updateStage = m_FrameGraph.AddWorkerStage("UpdateObjects", ObjectList, 0, ObjectState | CollisionGrid | PendingAdds | PendingRemovals | ObjectPools | MainThreadJobs,
+		CreateUpdateJobs());
+	// asteroid spawning and overdrive
+	int gameStage = m_FrameGraph.AddWorkerStage("UpdateGame", 0, 0, ObjectState | PendingAdds | ObjectPools | MainThreadJobs,
+		{ JobSystem::MakeMemberJob<Gamestate, &Gamestate::Update>(instance, JobSystem::Priority::HIGH) });
+	// the emitter follows the ship as of the last snapshot, so this only reads the snapshot and can overlap everything until the snapshot is retaken
+	int particleStage = m_FrameGraph.AddWorkerStage("UpdateParticles", Snapshots, Particles, 0, CreateParticleJobs());
+
+	// when pipelining the main thread draws last frame's snapshot, so its stages don't wait on any of this frame's simulation
+	const ResourceMask drawnSnapshot = m_Pipelined ? PreviousSnapshot : Snapshots;
+
+	// Main thread: create vertex array for asteroids, draw all but particles, complete glow, blur and fog effects
+	int drawStage = m_FrameGraph.AddMainThreadStage("Draw", drawnSnapshot, Render, 0,
+		JobSystem::MakeJob([this, pWindow] { Draw(*pWindow); }));
+
+	// Main thread: run jobs posted by the update stages (e.g. glow changes), anything over budget is left for EndFrame or the next frame
+	// (when pipelining it doesn't wait for this frame's updates, their posts are picked up by EndFrame instead)
+	m_FrameGraph.AddMainThreadStage("MainThreadJobs", m_Pipelined ? NoResources : MainThreadJobs, Render, 0,
+		JobSystem::MakeJob([this] { JobSystem::RunMainThreadJobs(m_MainThreadJobBudgetNs); }));
+
+	// Collision resolution: only reads the grid, objects hit are damaged/split (splitting positions pooled objects which aren't drawn yet,
+	// so this doesn't count as touching the snapshots), destroyed objects are queued for removal
+	m_CollisionStage = m_FrameGraph.AddWorkerStage("ResolveCollisions", CollisionGrid, 0,
+		ObjectState | CollisionPairs | PendingAdds | PendingRemovals | ObjectPools | OccluderMap, CreateCollisionJobs());
+
+	// Main thread: draw particle system, display window
+	int drawParticlesStage = m_FrameGraph.AddMainThreadStage("DrawParticles", drawnSnapshot, Render, 0,
+		JobSystem::MakeJob([this, pWindow] { DrawParticlesAndDisplay(*pWindow); }));
+
+	// Cleanup: no jobs of its own, filled by AddToCleanupObjects during update and collision resolution
+	m_ProcessInactiveObjectsStage = m_FrameGraph.AddWorkerStage("ProcessInactiveObjects", PendingRemovals, 0, ObjectState | CollisionGrid,
+		{});
+	int clearPairsStage = m_FrameGraph.AddWorkerStage("ClearCollisionPairs", 0, CollisionPairs, 0,
+		{ JobSystem::MakeMemberJob<ObjectCollisionGrid, &ObjectCollisionGrid::ClearFrameCollisionPairs>(m_CollisionGrid.get(), JobSystem::Priority::HIGH) });
+	// handle added or removed objects which were queued during previous stages and return the removed ones to their pools, drawing only uses
+	// the snapshot so this can overlap it
+	int cleanUpStage = m_FrameGraph.AddWorkerStage("CleanUp", PendingRemovals, ObjectList | PendingAdds | PendingRemovals, ObjectPools,
+		{ JobSystem::MakeJob([this] { CleanUp(); }, JobSystem::Priority::HIGH, nullptr, &m_ActiveObjects) });
+
+	// Snapshot: freeze the transforms and particle vertices updated this frame (and the draw list, if CleanUp rebuilt it) for drawing next
+	// frame, flipping which half of the entity store's transforms is live counts as writing the object state since GetPosition etc. change
+	// with it, and flipping the particle vertices as writing the particles
+	int snapshotStage = m_FrameGraph.AddWorkerStage("Snapshot", ObjectList, Snapshots | ObjectState | Particles, 0, CreateSnapshotJobs());
+
+	// Main thread: run what's left of the main thread jobs, upload the occluder texture if used
+	// (collision resolution posts too, e.g. the ship dimming the glow, which is picked up here rather than ordering it before Draw)
+	m_FrameGraph.AddMainThreadStage("EndFrame", OccluderMap, MainThreadJobs | Render, 0,
+		JobSystem::MakeJob([this] { EndFrame(); }));
+
+	m_FrameGraph.Build();
+
+	// skipped in a frame which only draws or only simulates (see RunFrames), the main thread jobs and EndFrame run every frame
+	m_SimulationStages = { updateStage, gameStage, particleStage, m_CollisionStage, m_ProcessInactiveObjectsStage, clearPairsStage, cleanUpStage, snapshotStage };
+	m_RenderStages = { drawStage, drawParticlesStage };
+
+	m_FrameGraph.SetFrameBudget(m_FrameBudgetNs);
+	m_FrameGraph.SetStageBudget(updateStage, m_FrameBudgetNs / 4);
+	m_FrameGraph.SetStageBudget(m_CollisionStage, m_FrameBudgetNs / 4);
+	m_FrameGraph.SetStageBudget(drawStage, m_FrameBudgetNs / 4);
+
+	// names for the job trace, main thread stages are named after the stage and the rest by their trace key, or function if they don't have one
+	JobTrace::SetName(m_UpdateLoop.get(), "UpdateObjects");
+	JobTrace::SetName(&m_RenderSnapshots, "Snapshot");
+	JobTrace::SetName(&m_ActiveObjects, "CleanUp");
+	JobTrace::SetName(m_ParticleLoop.get(), "UpdateParticles");
+	JobTrace::SetName(m_CollisionLoop.get(), "ResolveCollisions");
+	JobTrace::SetName(&JobSystem::MemberFunctionDispatcher<Gamestate, &Gamestate::Update>, "UpdateGame");
+	JobTrace::SetName(&JobSystem::MemberFunctionDispatcher<ObjectCollisionGrid, &ObjectCollisionGrid::ClearFrameCollisionPairs>, "ClearCollisionPairs");
+	JobTrace::SetName(&JobSystem::MemberFunctionDispatcher<ObjectPoolManager, &ObjectPoolManager::MaintainPoolBuffers>, "MaintainPoolBuffers");
 }
 
-void Gamestate::CreatePhaseTransitionDeclaration()
+void Gamestate::TakeRenderSnapshot()
 {
-	m_CurrentTransitionData = m_JobPhaseTransitions[GetPhaseIndex()].get();
-	m_PhaseTransitionDecl = {
-		{ instance, &JobSystem::MemberFunctionDispatcher<Gamestate, &Gamestate::ManageThreadPhaseTransition> },
-			reinterpret_cast<uintptr_t>(&m_CurrentTransitionData),
-			JobSystem::Priority::HIGH,
-			m_PhaseCounter
-	};
+	RenderSnapshot& snapshot = m_RenderSnapshots[m_SnapshotWrite];
+	if (m_DrawListRebuilt)
+	{
+		m_DrawListInSnapshot = 1 - m_DrawListInSnapshot;
+		m_DrawListRebuilt = false;
+	}
+	snapshot.Objects = &m_DrawLists[m_DrawListInSnapshot];
+	EntityChunk* playerChunk = m_Player->GetEntityChunk();
+	int playerRow = m_Player->GetEntityRow();
+	snapshot.PlayerPreviousPosition = { playerChunk->LivePrevPosX()[playerRow], playerChunk->LivePrevPosY()[playerRow] };
+	snapshot.PlayerPosition = m_Player->GetPosition();
+	snapshot.PlayerPreviousRotation = playerChunk->LivePrevRot()[playerRow];
+	snapshot.PlayerRotation = m_Player->GetRotation();
+	// the transforms updated this frame are frozen as they are, and next frame updates the other half
+	snapshot.Transforms = EntityStore::FlipTransforms();
+	snapshot.Score = m_TotalScore;
+	snapshot.Lives = m_Player->GetLives();
+	snapshot.Overdrive = m_Overdrive;
+	snapshot.ParticleVertices = m_ParticleSystem->FlipVertices();
 }
 
-void Gamestate::CreateSnapshotForGameObjectSection(uintptr_t pData)
+// every stage is done once RunFrame returns, so the snapshot just written becomes the one drawn and the one drawn is free to write over
+void Gamestate::FlipRenderSnapshots()
 {
-	JobData_Iterators* data = reinterpret_cast<JobData_Iterators*>(pData);
-	GameObjectMultiset::iterator startItr = data->start;
-	GameObjectMultiset::iterator endItr = data->end;
-	while (startItr != endItr)
+	if (m_Pipelined)
 	{
-		(*startItr++)->CreateSnapshot();
+		std::swap(m_SnapshotWrite, m_SnapshotRead);
 	}
 }
 
-void Gamestate::BeginPlay()
+void Gamestate::BeginPlay(int numWorkers, bool pinWorkers, bool serial, bool pipelined, int simulationRate, uint64_t seed)
 {
+	m_Serial = serial;
+	m_Pipelined = pipelined;
+	// a serial run always steps at a fixed rate, so it plays out the same however long its frames take
+	m_SimulationRate = m_Serial && simulationRate <= 0 ? 60 : simulationRate;
+	if (m_SimulationRate > 0)
+	{
+		m_StepTime = 1.f / m_SimulationRate;
+		m_DeltaTime = m_StepTime;
+		m_Elapsed = sf::seconds(m_StepTime);
+	}
+	m_SnapshotWrite = 0;
+	m_SnapshotRead = m_Pipelined ? 1 : 0;
+	// the main thread is index 0 (workers are numbered by the job system), it runs jobs while waiting so needs its own slot
+	ThreadIndex = 0;
+
 	// initialise the job system
-	JobSystem::InitJobSystem(NUM_THREADS);
+	numWorkers = m_Serial ? 0 : JobSystem::ChooseWorkerCount(numWorkers);
+	JobSystem::SchedulerMode mode = USE_WORK_STEALING ? JobSystem::SchedulerMode::WORK_STEALING : JobSystem::SchedulerMode::GLOBAL_QUEUE;
+	JobSystem::InitJobSystem(numWorkers, m_Serial ? JobSystem::SchedulerMode::SERIAL : mode, pinWorkers);
+	if (m_Serial)
+	{
+		std::cout << "Running serially on the main thread" << std::endl;
+	}
+	else
+	{
+		std::cout << "Running with " << numWorkers << " worker threads" << (pinWorkers ? " (pinned)" : "") << std::endl;
+	}
+	if (m_Pipelined)
+	{
+		std::cout << "Pipelined, drawing each frame while the next is simulated" << std::endl;
+	}
+	if (m_SimulationRate > 0)
+	{
+		std::cout << "Simulating at a fixed " << m_SimulationRate << " steps per second" << std::endl;
+	}
+	std::cout << (USE_AVX2_SYSTEMS && CpuFeatures::HasAvx2() ? "Using the AVX2 kernels" : "Using the scalar kernels") << std::endl;
+	// seeded before anything (e.g. spawning the first asteroids) draws - a serial run keeps to one fixed seed unless given another so every
+	// run is the same
+	Random::Seed(seed == 0 && m_Serial ? 12345 : seed);
+	std::cout << "Random seed " << Random::GetMasterSeed() << std::endl;
+
+	// per-thread containers, one per worker plus one for the main thread, which also runs jobs while it waits on the workers
+	// workers don't run anything until the first frame so these are in place in time
+	m_ObjectsToAdd = std::vector<std::vector<ObjectHandle>>(numWorkers + 1, std::vector<ObjectHandle>());
+	m_ObjectsToCleanUp = std::vector<std::vector<ObjectHandle>>(numWorkers + 1, std::vector<ObjectHandle>());
+	m_CollisionGrid->SetThreadCount(numWorkers + 1);
 
 	InitialiseTextures();
 	InitialiseScreenText();
@@ -712,37 +771,26 @@ void Gamestate::BeginPlay()
 	m_BufferRenderTexture1.create(SCREEN_WIDTH, SCREEN_HEIGHT);
 	m_BufferRenderTexture2.create(SCREEN_WIDTH, SCREEN_HEIGHT);
 
-	// setup job data with default values
-	m_JobIterators.reserve(NUM_THREADS);
-	m_JobInts.reserve(NUM_THREADS);
-	for (int i = 0; i < NUM_THREADS; ++i)
-	{
-		m_JobInts.emplace_back();
-		m_JobIterators.emplace_back(m_AllActiveGameObjects.begin(), m_AllActiveGameObjects.begin());
-	}
+	// size the object loops for the objects created so far, and snapshot them so the first frame has something to draw
+	RebuildActiveObjectIndices();
+	TakeRenderSnapshot();
+	FlipRenderSnapshots();
 	
-	// create all repeated jobs and job data
+	// create all repeated jobs and job data, and the stages of a frame
+	sf::RenderWindow window(sf::VideoMode(SCREEN_WIDTH, SCREEN_HEIGHT), "");
 	CreateUpkeepJobs();
-	CreateUpdateJobs();
-	CreateCollisionJobs();
-	CreateCleanupJobs();
-	CreateSnapshotJobs();
-	CreatePhaseTransitionDeclaration();
+	CreateFrameGraph(window);
 
-	// kickoff
-	sf::RenderWindow window(sf::VideoMode(SCREEN_WIDTH, SCREEN_HEIGHT), "");
-	m_PhaseCounter->count.store(0);
-	// call the phase transition job a single time to begin
-	m_PhaseTransitionDecl.m_MemberFunction.func(m_PhaseTransitionDecl.m_MemberFunction.instance, m_PhaseTransitionDecl.m_Param);
-	JobSystem::NextPhase(m_PhaseCounter);
+	sf::Clock runClock;
+	int frameCount = 0;
 	
 	// Main game loop
 	while(window.isOpen())
 	{
+		// Work out how many simulation steps are due and how far between snapshots to draw
+		int steps = AdvanceClock();
 		// Check ship position for significant change to decide whether to update shader uniforms
 		CheckShipPosition();
-		// Set the delta time for the game update
-		RestartClock();
 
 		// Poll for window being closed
 		sf::Event event;
@@ -750,44 +798,27 @@ void Gamestate::BeginPlay()
 		{
 			if (event.type == sf::Event::Closed)
 				window.close();
+			// dump the trace of the last few seconds without stopping
+			if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F9)
+				JobTrace::WriteChromeTrace("job_trace.json");
 		}
 
-		// Rendering, Input & Update -------------------------------
-		// Main thread: Create vertex array for asteroids, draw all but particles, complete glow, blur and fog effects
-		// Other threads: Handle inputs, then update each game object and update collision grid with new positions, update particle system
-		Draw(window);
-
-		// ensure main thread doesn't get in between the two phases used by the other threads (this very rarely incurs any wait time since
-		// Draw(window) almost always takes longer than the input/update phase of other threads)
-		while (GetPhaseIndex()!=3)
+		// Update, draw, collision resolution, cleanup and snapshot - see CreateFrameGraph, the main thread runs its own stages and helps
+		// with everything else in between
+#if USE_JOB_TRACE
+		long long frameBegin = JobTrace::Now();
+#endif
+		RunFrames(steps);
+#if USE_JOB_TRACE
+		JobTrace::Record(frameBegin, JobTrace::Now(), "Frame");
+#endif
+		++frameCount;
+		if (m_ReportClock.getElapsedTime().asSeconds() >= m_ReportIntervalSeconds)
 		{
-			std::this_thread::yield();
+			ReportFrameStats();
+			m_ReportClock.restart();
 		}
-
-		// More Rendering, Collision Resolution --------------------
-		// Main thread: Draw particle system, display window
-		// Other threads: Test intersections and resolve collisions
-		window.draw(*m_ParticleSystem);
-		window.display();
-		SyncWithOtherThreads();
-
-		// Cleanup -------------------------------------------------
-		// Main thread: Handle added or removed objects which were queued during previous phases
-		// Other threads: Clear collision grid pair tracker
-		CleanUp();
-		SyncWithOtherThreads();
-
-		// Snapshot ------------------------------------------------
-		// Main thread: Clear temp object containers and check for glow changes queued in earlier phases and update shaders
-		// Other threads: Set the rot and pos of the sprite in each game object to be used as a snapshot for drawing next frame
-		ClearCleanUpObjects();
-		CheckGlowShaderUniforms();
-	#if USE_CPU_FOR_OCCLUDERS
-		// update the texture whilst the other threads create the snapshot, only needed for alternate glow method
-		m_MainTexture.update(reinterpret_cast<sf::Uint8*>(m_PixelPrep));
-	#endif
 		if (m_Player->GetLives() < 0) break;
-		SyncWithOtherThreads();
 
 		sf::Time frameTime = m_GameClock.getElapsedTime();
 
@@ -797,21 +828,128 @@ void Gamestate::BeginPlay()
 			sf::sleep(MIN_FRAME_TIME - frameTime);
 		}
 	}
-	std::cout << "FINAL SCORE: " << GetScore();
-
-	JobSystem::ClearBuffer();
-	m_PhaseCounter->count.fetch_sub(1);
+	std::cout << "FINAL SCORE: " << GetScore() << std::endl;
+	std::cout << "Peak queued jobs (LOW/NORMAL/HIGH/CRITICAL): "
+		<< JobSystem::GetPeakQueueDepth(JobSystem::Priority::LOW) << "/"
+		<< JobSystem::GetPeakQueueDepth(JobSystem::Priority::NORMAL) << "/"
+		<< JobSystem::GetPeakQueueDepth(JobSystem::Priority::HIGH) << "/"
+		<< JobSystem::GetPeakQueueDepth(JobSystem::Priority::CRITICAL) << std::endl;
+
+	// utilisation - workers are busy whenever they aren't asleep, the main thread is busy whenever it isn't parked or sleeping off the frame limit
+	JobSystem::WaitStats waitStats = JobSystem::GetWaitStats();
+	double runNs = runClock.getElapsedTime().asMicroseconds() * 1000.0;
+	std::cout << "Frames: " << frameCount << " in " << runNs / 1e9 << "s" << std::endl;
+	std::cout << "Simulation steps: " << m_StepsRun << " (" << m_StepsDropped << " dropped to catch up)" << std::endl;
+	std::cout << "Worker utilisation: " << 100.0 * (1.0 - waitStats.WorkerIdleNs / (runNs * JobSystem::GetNumWorkers())) << "%" << std::endl;
+	std::cout << "Main thread parked: " << 100.0 * waitStats.ParkedNs / runNs << "% of run time, "
+		<< waitStats.HelpedJobs << " jobs run while waiting" << std::endl;
+	JobSystem::UpkeepStats upkeepStats = JobSystem::GetUpkeepStats();
+	std::cout << "Upkeep runs: " << upkeepStats.Runs << " (" << upkeepStats.LateRuns << " past their deadline)" << std::endl;
+	PrintStageTimings();
+	ReportFrameStats();
 
 	JobSystem::ShutdownJobSystem();
+#if USE_JOB_TRACE
+	if (JobTrace::WriteChromeTrace("job_trace.json"))
+	{
+		std::cout << "Job trace written to job_trace.json" << std::endl;
+	}
+#endif
+}
+
+// average time per frame of each stage, one line per stage so runs with different thread counts (or --serial, which gives the single threaded
+// cost) can be lined up - speedup of a stage is its serial busy time over its span here, efficiency is that over the number of threads
+void Gamestate::PrintStageTimings() const
+{
+	int frames = m_FrameGraph.GetFramesRun();
+	if (frames == 0) return;
+	int threads = JobSystem::GetNumWorkers() + 1;
+	std::cout << "Stage timings over " << frames << " frames, " << threads << " thread(s) - stage, span ms, busy ms, busy/span (per frame the stage ran in)" << std::endl;
+	for (int i = 0; i < m_FrameGraph.GetStageCount(); ++i)
+	{
+		FrameGraph::StageTiming timing = m_FrameGraph.GetStageTiming(i);
+		int runs = std::max(timing.Runs, 1);
+		double spanMs = timing.SpanNs / 1e6 / runs;
+		double busyMs = timing.BusyNs / 1e6 / runs;
+		std::cout << m_FrameGraph.GetStageName(i) << ", " << spanMs << ", " << busyMs << ", " << (spanMs > 0.0 ? busyMs / spanMs : 0.0) << std::endl;
+	}
 }
-void Gamestate::SyncWithOtherThreads()
+
+// p50/p99/max in the given unit, - if nothing was recorded
+static void WritePercentiles(std::ostream& out, const LatencyHistogram::Summary& summary, double unitNs)
 {
-	while (m_PhaseCounter->count.load() != 1 || JobSystem::IsBufferEmpty())
+	if (summary.Count == 0)
 	{
-		std::this_thread::yield();
+		out << "-";
+		return;
 	}
-	m_PhaseCounter->count.fetch_sub(1);
-	JobSystem::NextPhase(m_PhaseCounter);
+	out << summary.P50Ns / unitNs << "/" << summary.P99Ns / unitNs << "/" << summary.MaxNs / unitNs;
+}
+
+// distributions since the last report, one line per stage plus one for jobs outside any stage, anything over budget is flagged
+// cheap enough to leave on (a few atomic adds per job, see LatencyHistogram), it's the spikes hidden by PrintStageTimings' averages
+void Gamestate::ReportFrameStats()
+{
+	std::ostream& out = m_ReportFile.is_open() ? static_cast<std::ostream&>(m_ReportFile) : std::cout;
+	FrameGraph::FrameReport frame = m_FrameGraph.GetFrameReport(true);
+	if (frame.Frame.Count == 0) return;
+	out << "Frame report, " << frame.Frame.Count << " frames - frame ms p50/p99/max ";
+	WritePercentiles(out, frame.Frame, 1e6);
+	out << ", waiting for the end of frame ms ";
+	WritePercentiles(out, frame.EndOfFrameWait, 1e6);
+	if (frame.OverBudget > 0)
+	{
+		out << " - OVER BUDGET " << frame.OverBudget << " frame(s) over " << m_FrameBudgetNs / 1e6 << "ms";
+	}
+	out << "\n" << "stage, span ms p50/p99/max, main thread wait ms p50/p99/max, job us p50/p99/max" << "\n";
+	for (int i = 0; i < m_FrameGraph.GetStageCount(); ++i)
+	{
+		FrameGraph::StageReport stage = m_FrameGraph.GetStageReport(i, true);
+		out << m_FrameGraph.GetStageName(i) << ", ";
+		WritePercentiles(out, stage.Span, 1e6);
+		out << ", ";
+		WritePercentiles(out, stage.DependencyWait, 1e6);
+		out << ", ";
+		WritePercentiles(out, stage.Jobs, 1e3);
+		if (stage.OverBudget > 0)
+		{
+			out << " - OVER BUDGET " << stage.OverBudget << " frame(s) over " << m_FrameGraph.GetStageBudget(i) / 1e6 << "ms";
+		}
+		out << "\n";
+	}
+	out << "(other jobs), -, -, ";
+	WritePercentiles(out, JobSystem::SummariseJobTimes(-1, true), 1e3);
+	out << std::endl;
+}
+
+void Gamestate::SetReportFile(const std::string& path)
+{
+	m_ReportFile.open(path);
+	if (!m_ReportFile.is_open())
+	{
+		std::cout << "Couldn't open " << path << " for frame reports, using stdout" << std::endl;
+	}
+}
+
+void Gamestate::SetParticleCount(int count)
+{
+	assert(count >= 0);
+	m_ParticleSystem = std::make_shared<ParticleSystem>(std::max(count, 0));
+}
+
+void Gamestate::DrawParticlesAndDisplay(sf::RenderWindow& window)
+{
+	// the particle system is already updating the other half when pipelining
+	window.draw(m_ParticleSystem->GetVertices(m_RenderSnapshots[m_SnapshotRead].ParticleVertices));
+	window.display();
+}
+void Gamestate::EndFrame()
+{
+	JobSystem::RunMainThreadJobs(m_MainThreadJobBudgetNs);
+#if USE_CPU_FOR_OCCLUDERS
+	// update the texture whilst the other threads create the snapshot, only needed for alternate glow method
+	m_MainTexture.update(reinterpret_cast<sf::Uint8*>(m_PixelPrep));
+#endif
 }
 
 void Gamestate::CleanUp()
@@ -821,47 +959,54 @@ void Gamestate::CleanUp()
 	{
 		for (size_t j{ 0 }; j < m_ObjectsToCleanUp[i].size(); ++j)
 		{
-			++sizeChanged;
-			m_AllActiveGameObjects.erase(m_ObjectsToCleanUp[i][j]);
+			GameObject* obj = m_Objects.Get(m_ObjectsToCleanUp[i][j]);
+			// the active handle is stale if the object was queued more than once
+			if (obj && m_ActiveObjects.Remove(obj->GetActiveHandle()))
+			{
+				m_Entities.Remove(obj);
+				// only now nothing refers to it can it go back to its pool, where it may be handed out again or destroyed
+				if (PooledObjectComponent* poolComp = obj->GetComponent<PooledObjectComponent>())
+				{
+					poolComp->ReturnToPool();
+				}
+				++sizeChanged;
+			}
 		}
 	}
+	ClearCleanUpObjects();
 	for (size_t i{ 0 }; i < m_ObjectsToAdd.size(); ++i)
 	{
 		for (size_t j{ 0 }; j < m_ObjectsToAdd[i].size(); ++j)
 		{
-			++sizeChanged;
-			m_AllActiveGameObjects.insert(m_ObjectsToAdd[i][j]);
+			GameObject* obj = m_Objects.Get(m_ObjectsToAdd[i][j]);
+			if (obj && !m_ActiveObjects.Contains(obj->GetActiveHandle()))
+			{
+				++sizeChanged;
+				obj->SetActiveHandle(m_ActiveObjects.Add(obj));
+				m_Entities.Add(obj);
+			}
 		}
 		m_ObjectsToAdd[i].clear();
 	}
 	if (sizeChanged)
 	{
-		// remake chunks for dividing game objects for threads
-		MakeUpdateJobData();
+		// removing moves objects about in m_ActiveObjects and the entity store, so the chunk list, cost prefix and draw order have to be redone
+		RebuildActiveObjectIndices();
 	}
 }
 
-std::shared_ptr<GameObject> Gamestate::GetPooledObject(const std::string& PoolName)
+GameObject* Gamestate::GetPooledObject(const std::string& PoolName)
 {
 	return m_PoolManager->GetPooledObject(PoolName);
 }
 
-void Gamestate::ProcessInactiveObjects(uintptr_t data)
+void Gamestate::ProcessInactiveObject(GameObject* obj)
 {
-	JobData_Indices iData(data);
-	auto& obj = m_ObjectsToCleanUp[iData.indices.first][iData.indices.second];
-
 	CollisionComponent* collComp = obj->GetComponent<CollisionComponent>();
 	if (collComp)
 	{
 		collComp->ClearFromGrid();
 	}
-
-	PooledObjectComponent* poolComp = obj->GetComponent<PooledObjectComponent>();
-	if (poolComp)
-	{
-		poolComp->ReturnToPool(obj);
-	}
 }
 
 #if USE_CPU_FOR_OCCLUDERS
@@ -871,29 +1016,81 @@ int* Gamestate::GetPixelPrepPtr(int index)
 }
 #endif
 
-void Gamestate::RestartClock()
+// how many steps are due since the last frame, and where between the ends of the drawn snapshot's step the frame is drawn
+int Gamestate::AdvanceClock()
+{
+	m_FrameTime = m_GameClock.restart().asSeconds();
+	if (m_Serial)
+	{
+		// the same step every frame however long the frame really took, so the simulation doesn't depend on timing
+		m_RenderAlpha = 1.f;
+		return 1;
+	}
+	if (m_SimulationRate <= 0)
+	{
+		m_DeltaTime = std::min(m_FrameTime, 0.033f);
+		m_Elapsed = sf::seconds(m_DeltaTime);
+		m_RenderAlpha = 1.f;
+		return 1;
+	}
+
+	m_StepAccumulator += m_FrameTime;
+	int steps = static_cast<int>(m_StepAccumulator / m_StepTime);
+	if (steps > m_MaxStepsPerFrame)
+	{
+		m_StepsDropped += steps - m_MaxStepsPerFrame;
+		steps = m_MaxStepsPerFrame;
+	}
+	m_StepAccumulator = std::min(m_StepAccumulator - steps * m_StepTime, m_StepTime);
+	// what's drawn is one step behind the simulation, a frame which only draws shows the last step, but a frame which also steps draws
+	// while its last step runs, so it only has the step before and extrapolates by one more
+	m_RenderAlpha = m_StepAccumulator / m_StepTime + (steps > 0 ? 1.f : 0.f);
+	return steps;
+}
+
+// a frame graph run per step, the last one drawing too - with no steps due it's run just to draw, with the simulation stages skipped
+void Gamestate::RunFrames(int steps)
 {
-	sf::Time dt = m_GameClock.restart();
-	m_Elapsed = dt;
-	m_DeltaTime = dt.asSeconds();
-	if (m_DeltaTime > 0.033f)
+	int runs = std::max(steps, 1);
+	for (int run = 0; run < runs; ++run)
 	{
-		m_DeltaTime = 0.033f;
+		bool simulate = run < steps;
+		bool draw = run == runs - 1;
+		for (int stage : m_SimulationStages)
+		{
+			m_FrameGraph.SetStageSkipped(stage, !simulate);
+		}
+		for (int stage : m_RenderStages)
+		{
+			m_FrameGraph.SetStageSkipped(stage, !draw);
+		}
+		JobSystem::BeginUpkeepFrame();
+		m_FrameGraph.RunFrame();
+		if (simulate)
+		{
+			FlipRenderSnapshots();
+			++m_StepsRun;
+		}
 	}
 }
 
+// the shaders are only touched by the main thread, so these are posted to it rather than set from the worker which notices the change
 void Gamestate::SignalLightUp()
 { 
-	m_GlowRadiusChange = GlowRadiusChange::FULL;
+	PostToMainThread(JobSystem::MakeJob([this] { SetGlowRadius(true); }));
 }
 void Gamestate::SignalLightDown()
 {
-	m_GlowRadiusChange = GlowRadiusChange::HALF;
+	PostToMainThread(JobSystem::MakeJob([this] { SetGlowRadius(false); }));
 }
 
 void Gamestate::CheckShipPosition()
 {
-	sf::Vector2f lastShipPos = m_Player->GetSprite().getPosition();
+	// where the ship is drawn this frame
+	const RenderSnapshot& snapshot = m_RenderSnapshots[m_SnapshotRead];
+	sf::Vector2f lastShipPos = {
+		RenderObject::Interpolate(snapshot.PlayerPreviousPosition.x, snapshot.PlayerPosition.x, m_RenderAlpha, SCREEN_WIDTH),
+		RenderObject::Interpolate(snapshot.PlayerPreviousPosition.y, snapshot.PlayerPosition.y, m_RenderAlpha, SCREEN_HEIGHT) };
 	float dx = m_LastShipPos.x - lastShipPos.x;
 	float dy = m_LastShipPos.y - lastShipPos.y;
 	if (dx * dx + dy * dy > 4.f)
@@ -915,40 +1112,15 @@ void Gamestate::ClearCleanUpObjects()
 	}
 }
 
-void Gamestate::CheckGlowShaderUniforms()
+void Gamestate::SetGlowColour(const sf::Glsl::Vec4& colour)
 {
-	// I don't like checking this every frame but I don't have a job queue set up for the main thread, and the main thread needs to do this
-	// the changes happen during the update phase and need to be enacted after the main thread is done rendering so they go here
-	if (m_GlowColourChange != GlowColourChange::NOCHANGE)
-	{
-		switch (m_GlowColourChange)
-		{
-		case GlowColourChange::RED:
-			m_GlowShader.setUniform("glowColor", m_OverdriveGlowColor);
-			break;
-		case GlowColourChange::BLUE:
-			m_GlowShader.setUniform("glowColor", m_BaseGlowColor);
-			break;
-		}
-		m_GlowColourChange = GlowColourChange::NOCHANGE;
-	}
-	if (m_GlowRadiusChange != GlowRadiusChange::NOCHANGE)
-	{
-		switch (m_GlowRadiusChange)
-		{
-		case GlowRadiusChange::FULL:
-			m_GlowShader.setUniform("glowRadius", m_HighGlowRadius);
-#if USE_CPU_FOR_OCCLUDERS
-			m_FogShader.setUniform("maxDist", m_FarFogRadius);
-#endif
-			break;
-		case GlowRadiusChange::HALF:
-			m_GlowShader.setUniform("glowRadius", m_LowGlowRadius);
+	m_GlowShader.setUniform("glowColor", colour);
+}
+
+void Gamestate::SetGlowRadius(bool full)
+{
+	m_GlowShader.setUniform("glowRadius", full ? m_HighGlowRadius : m_LowGlowRadius);
 #if USE_CPU_FOR_OCCLUDERS
-			m_FogShader.setUniform("maxDist", m_NearFogRadius);
+	m_FogShader.setUniform("maxDist", full ? m_FarFogRadius : m_NearFogRadius);
 #endif
-			break;
-		}
-		m_GlowRadiusChange = GlowRadiusChange::NOCHANGE;
-	}
 }
@@ -1,6 +1,13 @@
 #pragma once
 #include "Top.h"
 #include "JobSystem.h"
+#include "FrameGraph.h"
+#include "ParallelFor.h"
+#include "SlotMap.h"
+#include "EntityStore.h"
+#include "ObjectRegistry.h"
+#include "Random.h"
+#include <fstream>
 
 class ObjectPool;
 class ObjectPoolManager;
@@ -11,79 +18,86 @@ class PlayerShip;
 class GameObject;
 class ParticleSystem;
 
-struct TextureAndIDComparator
+// shared state touched by the stages of a frame, each stage declares how it uses these and the frame graph orders the stages from that
+// (see Gamestate::CreateFrameGraph)
+namespace FrameResource
 {
-	bool operator()(const std::shared_ptr<GameObject>& lhs, const std::shared_ptr<GameObject>& rhs) const;
-};
-// the multiset orders GameObjecs by texture and then id, such that objects are grouped by texture for more efficient rendering
-typedef std::multiset<std::shared_ptr<GameObject>, TextureAndIDComparator> GameObjectMultiset;
-
-// job data, will be stored and passed to a job through casting JobData_Iterators* to uintptr, stores iterators for dividing game objects
-// into chunks, to split work equally among threads
-struct JobData_Iterators
-{
-	GameObjectMultiset::iterator start;
-	GameObjectMultiset::iterator end;
-
-	JobData_Iterators(GameObjectMultiset::iterator _start, GameObjectMultiset::iterator _end) : start(_start), end(_end) {}
-};
-// job data, will be stored and passed to a job through casting JobData_Ints* to uintptr, stores ints for dividing e.g. collision grid
-// into chunks, to split work equally among threads
-struct JobData_Ints
-{
-	int start;
-	int end;
-
-	JobData_Ints(int a = 0, int b = 0) : start(a), end(b) {}
-};
-
-// similar to above, but no need for storage of data and casting T* to uintptr, instead uses a union to directly store the data,
-// so use 'value' for creating job data, and then 'indices' for extraction
-struct JobData_Indices
-{
-	union
+	enum : ResourceMask
 	{
-		std::pair<uint16_t, uint16_t> alignas(4) indices;
-		uintptr_t value;
+		// for a mask which is only sometimes empty, so both sides of a conditional are the same type
+		NoResources = 0,
+		// m_ActiveObjects, the entity store's layout and the indices built from them (draw order, chunk list, update cost)
+		ObjectList = 1 << 0,
+		// position, rotation, velocity etc. of each game object (and the rows of the entity store holding them)
+		ObjectState = 1 << 1,
+		// the render snapshot written at the end of the frame (and the draw lists and frozen transforms it points to), drawn during the next one
+		Snapshots = 1 << 2,
+		CollisionGrid = 1 << 3,
+		CollisionPairs = 1 << 4,
+		// per-thread lists of objects to add to/remove from m_ActiveObjects
+		PendingAdds = 1 << 5,
+		PendingRemovals = 1 << 6,
+		ObjectPools = 1 << 7,
+		Particles = 1 << 8,
+		// jobs posted for the main thread, posting is thread-safe so this only orders a stage which runs them after the stages whose
+		// posts it should pick up (posts from stages which don't declare it are run at the next point the main thread runs them)
+		MainThreadJobs = 1 << 9,
+		// window, render textures and shaders
+		Render = 1 << 10,
+		// pixels prepared on the cpu for the occluder texture (only with USE_CPU_FOR_OCCLUDERS)
+		OccluderMap = 1 << 11,
+		// the snapshot drawn this frame when pipelining, written last frame so nothing else this frame touches it
+		PreviousSnapshot = 1 << 12
 	};
+}
 
-	JobData_Indices(uint16_t a = 0, uint16_t b = 0) : indices(a,b) {}
-	JobData_Indices(uintptr_t x) : value(x) {}
-};
-
-// used for repeated large batches of jobs for major functions where you want the data to stay in scope between frames (e.g. update calls, collision calls)
-// assumes work should be divided equally among all threads, hence length of NUM_THREADS
-struct JobPrepataionData
+// what the main thread needs to draw one object, rebuilt only when objects are added or removed - the transform isn't copied, it's read from the
+// frozen half of the object's entity row (the half given by the snapshot), which nothing writes until the frame after it's drawn
+struct RenderObject
 {
-	JobSystem::Counter* Counter;
-	std::vector<JobSystem::Declaration> Declarations;
-	JobPrepataionData(size_t size = NUM_THREADS, JobSystem::Counter* counter = nullptr) : Declarations(size), Counter(counter) {}
-};
-
-// used to transition between phases e.g. update->collision, stores all the jobs for the next phase and a flag for whether to sync
-// with the main thread at the end of the next phase
-struct ThreadPhaseTransitionData
-{
-	std::vector<JobSystem::Declaration>* NextDeclarations;
-	bool IncludeMainThread;
-	ThreadPhaseTransitionData(std::vector<JobSystem::Declaration>* decls, bool mainT = false) : NextDeclarations(decls), IncludeMainThread(mainT) {}
+	const sf::Texture* Texture;
+	sf::Vector2f Origin;
+	const EntityChunk* Chunk;
+	int Row;
+	sf::Vector2f AtlasOffsetTL;
+	sf::Vector2f AtlasOffsetBR;
+	bool Occluder;
+
+	// alpha 0 is the start of the step the transforms cover and 1 the end, more than 1 extrapolates (see Gamestate::AdvanceClock)
+	sf::Vector2f GetPosition(int transforms, float alpha) const
+	{
+		return { Interpolate(Chunk->PrevPosX[transforms][Row], Chunk->PosX[transforms][Row], alpha, SCREEN_WIDTH),
+				 Interpolate(Chunk->PrevPosY[transforms][Row], Chunk->PosY[transforms][Row], alpha, SCREEN_HEIGHT) };
+	}
+	float GetRotation(int transforms, float alpha) const { return Chunk->PrevRot[transforms][Row] + (Chunk->Rot[transforms][Row] - Chunk->PrevRot[transforms][Row]) * alpha; }
+	// sprite can be reused for every object, everything drawn is set
+	void PlaceSprite(sf::Sprite& sprite, int transforms, float alpha) const;
+	// a jump of more than half the screen in one step is a wrap round to the other side, which is drawn where it ended up rather than
+	// sliding across the screen
+	static float Interpolate(float from, float to, float alpha, float screenSize)
+	{
+		return std::abs(to - from) > screenSize / 2 ? to : from + (to - from) * alpha;
+	}
 };
-
-// used to better facilitate phase transitions, the thread managing the transition needs to also set up the next transition
-// so giving it T** pA, it can copy T* A, then make pA point to the next transition's data - no need to remake jobs
-struct pTPTD
+// everything the main thread needs to draw a frame, taken by the snapshot stage in O(1) so drawing never reads live objects
+struct RenderSnapshot
 {
-	ThreadPhaseTransitionData* pData;
+	// in m_DrawOrder, so grouped by texture - one of m_DrawLists, which isn't rebuilt until this snapshot is no longer drawn
+	const std::vector<RenderObject>* Objects = nullptr;
+	// which half of the entity store's transforms is frozen for this snapshot
+	int Transforms = 0;
+	// the player's transform at the start and end of the step
+	sf::Vector2f PlayerPreviousPosition;
+	sf::Vector2f PlayerPosition;
+	float PlayerPreviousRotation = 0;
+	float PlayerRotation = 0;
+	// which half of the particle system's vertices is frozen for this snapshot
+	int ParticleVertices = 0;
+	int Score = 0;
+	int Lives = 0;
+	bool Overdrive = false;
 };
 
-// each thread has a unique index, used for certain wait-free functionality
-extern thread_local int ThreadIndex;
-
-// used to signal what would otherwise be a job for the main thread to change the colour of the glow, but the main thread
-// doesn't access the job queue and I don't want other threads interacting with the shaders
-enum class GlowColourChange { RED, BLUE, NOCHANGE};
-enum class GlowRadiusChange { FULL, HALF, NOCHANGE};
-
 class Gamestate {
 public:
 	static Gamestate* instance;
@@ -92,7 +106,23 @@ public:
 	~Gamestate();
 
 	// Game flow
-	void BeginPlay();
+	// numWorkers <= 0 picks one per spare hardware thread
+	// serial runs the whole frame graph on the main thread in a fixed job order with a fixed time step and seeded randoms, so a run with the
+	// same input (e.g. none) plays out identically every time - the single threaded reference for the stage timings printed at exit
+	// pipelined draws the previous frame's snapshot while this frame is simulated, so a frame takes as long as the slower of the two rather
+	// than the render waiting on the simulation (at the cost of showing everything a frame later)
+	// simulationRate is steps per second, each rendered frame runs however many steps are due and draws between the last two (see
+	// AdvanceClock), 0 steps once per rendered frame by however long the frame took (capped) instead
+	// seed is the master seed for the random streams, 0 for a new one each run (see RANDOM_SEED) - a serial run given the same seed plays out
+	// the same, in a threaded one an object draws the same values whenever it's spawned on the same step, but which pooled object is handed
+	// out (and when, with a variable step) can depend on thread timing, so only serial runs are sure to repeat
+	void BeginPlay(int numWorkers = DEFAULT_NUM_THREADS, bool pinWorkers = PIN_WORKER_THREADS, bool serial = false, bool pipelined = PIPELINE_FRAMES,
+		int simulationRate = SIMULATION_RATE, uint64_t seed = RANDOM_SEED);
+	bool IsSerial() const { return m_Serial; }
+	// frame reports go to this file instead of stdout, call before BeginPlay
+	void SetReportFile(const std::string& path);
+	// replaces the exhaust's particle system with one of count particles (PARTICLE_COUNT by default), call before BeginPlay
+	void SetParticleCount(int count);
 
 	// Score management
 	void AddScore(int score) { m_TotalScore += score; }
@@ -103,14 +133,15 @@ public:
 	void RemoveFromCollisionGrid(uint8_t nodeIndex, int prevX, int prevY);
 
 	// GameObject management
-	void AddToActiveObjects(const std::shared_ptr<GameObject>& obj);
-	void AddToCleanupObjects(std::shared_ptr<GameObject> obj);
-	void AddToCleanupObjectsDelayed(std::shared_ptr<GameObject> obj);
-	std::shared_ptr<GameObject> GetPooledObject(const std::string& PoolName);
+	void AddToActiveObjects(ObjectHandle obj);
+	void AddToCleanupObjects(ObjectHandle obj);
+	void AddToCleanupObjectsDelayed(ObjectHandle obj);
+	GameObject* GetPooledObject(const std::string& PoolName);
+	// a stream for what obj draws this step, keyed by the step and its handle (see Random::MakeStream) so it's the same whichever thread asks
+	RandomStream MakeObjectStream(Random::Purpose purpose, const GameObject& obj) const;
 
-	// Indices
-	int ObtainUniqueThreadLocalIndex() { return m_ThreadIndexCounter.fetch_add(1); }
-	int GetPhaseIndex() const { return m_PhaseIndex % m_JobPhaseTransitions.size(); }
+	// Frame stages
+	bool IsResolvingCollisions() const { return m_FrameGraph.IsStageRunning(m_CollisionStage); }
 
 	// Signals
 	void SignalLightUp();
@@ -146,8 +177,6 @@ private:
 	bool m_Overdrive = false;
 
 	// Glow
-	GlowColourChange m_GlowColourChange = GlowColourChange::NOCHANGE;
-	GlowRadiusChange m_GlowRadiusChange = GlowRadiusChange::NOCHANGE;
 	const float m_LowGlowRadius = 500.f;
 	const float m_HighGlowRadius = 1000.f;
 	const float m_PulseWidth = 280.f;
@@ -156,11 +185,48 @@ private:
 	const float m_NearFogRadius = 400.f;
 	const float m_FarFogRadius = 800.f;
 
-	// Delta time for the frame
+	// time the main thread spends on posted jobs at each point it runs them, the rest wait
+	const long long m_MainThreadJobBudgetNs = 1000000;
+
+	// frame reports (see ReportFrameStats) - a frame or stage over its budget is flagged, the frame's is 60fps and the heavy stages get a share
+	const long long m_FrameBudgetNs = 16666667;
+	const float m_ReportIntervalSeconds = 5.f;
+	sf::Clock m_ReportClock;
+	std::ofstream m_ReportFile;
+
+	// Delta time for a simulation step
 	float m_DeltaTime = 0.f;
 
-	// Thread index counter
-	std::atomic<int> m_ThreadIndexCounter;
+	// fixed step simulation, see AdvanceClock - a slow frame runs up to m_MaxStepsPerFrame steps to catch up, any more are dropped so one
+	// slow spell doesn't leave every frame after it catching up
+	int m_SimulationRate = SIMULATION_RATE;
+	float m_StepTime = 1.f / SIMULATION_RATE;
+	const int m_MaxStepsPerFrame = 4;
+	float m_StepAccumulator = 0.f;
+	long long m_StepsRun = 0;
+	long long m_StepsDropped = 0;
+	// how far through the drawn snapshot's step to draw everything, and the real time since the last rendered frame (for what's drawn but
+	// not simulated, e.g. the glow's pulse)
+	float m_RenderAlpha = 1.f;
+	float m_FrameTime = 0.f;
+	// stages skipped in a frame which only simulates or only draws
+	std::vector<int> m_SimulationStages;
+	std::vector<int> m_RenderStages;
+
+	// serial (deterministic) run, see BeginPlay
+	bool m_Serial = false;
+
+	// render snapshots, the snapshot stage writes one while the main thread draws the other when pipelining (see BeginPlay), otherwise
+	// both indices are the same since the frame graph already puts drawing before the snapshot is retaken
+	bool m_Pipelined = false;
+	RenderSnapshot m_RenderSnapshots[2];
+	int m_SnapshotWrite = 0;
+	int m_SnapshotRead = 0;
+	// built by CleanUp when objects are added or removed, into whichever list the last snapshot doesn't point at, the next snapshot then
+	// points at it - otherwise the snapshot keeps pointing at the same list, so a frame with no adds or removes builds nothing
+	std::vector<RenderObject> m_DrawLists[2];
+	int m_DrawListInSnapshot = 0;
+	bool m_DrawListRebuilt = false;
 
 	// Screen text and textures
 	sf::Font ScreenFont;
@@ -173,42 +239,47 @@ private:
 	std::shared_ptr<ObjectCollisionGrid> m_CollisionGrid;
 
 	// GameObject management
-	std::shared_ptr<PlayerShip> m_Player;
+	// owns every object, the pools and lists below refer to them by handle or pointer
+	ObjectRegistry m_Objects;
+	PlayerShip* m_Player = nullptr;
 	std::shared_ptr<ParticleSystem> m_ParticleSystem;
-	GameObjectMultiset m_AllActiveGameObjects;
-	std::vector<std::vector<std::shared_ptr<GameObject>>> m_ObjectsToAdd;
-	std::vector<std::vector<std::shared_ptr<GameObject>>> m_ObjectsToCleanUp;
+	// every active object packed into one array, added and removed in O(1) by CleanUp
+	SlotMap<GameObject*> m_ActiveObjects;
+	// the transforms, velocities and colliders of the active objects in chunks by archetype, joined and left alongside m_ActiveObjects -
+	// the update loop splits its chunks between threads and runs the entity systems over each one
+	EntityStore m_Entities;
+	// indices into m_ActiveObjects ordered by texture and then id, the order objects are drawn in so sprites sharing a texture are together
+	std::vector<int> m_DrawOrder;
+	// running total of each chunk's update cost, the cost hint for the update loop
+	std::vector<float> m_ChunkCostPrefix;
+	std::vector<std::vector<ObjectHandle>> m_ObjectsToAdd;
+	std::vector<std::vector<ObjectHandle>> m_ObjectsToCleanUp;
 
 	// Job system
-	JobSystem::Counter* m_PhaseCounter;
-	JobSystem::Counter* m_UnusedTransitionCounter;
-	JobSystem::Declaration m_PhaseTransitionDecl;
-	ThreadPhaseTransitionData* m_CurrentTransitionData;
-	std::vector<JobData_Ints> m_JobInts;
-	std::vector<JobData_Iterators> m_JobIterators;
-	std::vector<std::unique_ptr<JobPrepataionData>> m_JobPrepData;
-	std::vector<std::unique_ptr<ThreadPhaseTransitionData>> m_JobPhaseTransitions;
-
-	// Phase index
-	int m_PhaseIndex = 0;
-	int IncrementAndGetPhaseIndex() { return ++m_PhaseIndex % m_JobPhaseTransitions.size(); }
+	FrameGraph m_FrameGraph;
+	int m_CollisionStage = -1;
+	int m_ProcessInactiveObjectsStage = -1;
+	std::unique_ptr<JobSystem::ParallelForLoop> m_UpdateLoop;
+	std::unique_ptr<JobSystem::ParallelForLoop> m_ParticleLoop;
+	std::unique_ptr<JobSystem::ParallelForLoop> m_CollisionLoop;
 
 	// Job setup
-	void MakeUpdateJobData();
-	void MakeCollisionJobData();
-	void CreateUpdateJobs();
-	void CreateCollisionJobs();
-	void CreateCleanupJobs();
-	void CreateSnapshotJobs();
+	void RebuildActiveObjectIndices();
+	void RebuildDrawList();
+	std::vector<JobSystem::Declaration> CreateUpdateJobs();
+	std::vector<JobSystem::Declaration> CreateParticleJobs();
+	std::vector<JobSystem::Declaration> CreateCollisionJobs();
+	std::vector<JobSystem::Declaration> CreateSnapshotJobs();
 	void CreateUpkeepJobs();
-	void CreatePhaseTransitionDeclaration();
+	void CreateFrameGraph(sf::RenderWindow& window);
 
-	// Job functions
-	void ManageThreadPhaseTransition(uintptr_t data);
-	void UpdateGameObjectSection(uintptr_t data);
-	void CreateSnapshotForGameObjectSection(uintptr_t data);
-	void ProcessInactiveObjects(uintptr_t data);
-	void UpdateParticleSystem(uintptr_t data);
+	// Job functions, the ranges index the entity store's chunks (or the particles)
+	void UpdateEntityChunkRange(int begin, int end);
+	void TakeRenderSnapshot();
+	float GetUpdateCostOfRange(int begin, int end) const;
+	void ProcessInactiveObject(GameObject* obj);
+	JobSystem::Coroutine CleanUpObject(ObjectHandle handle);
+	void UpdateParticleRange(int begin, int end);
 
 	// Shaders, vertex array and textures
 	sf::Shader m_LightenShader;
@@ -225,10 +296,10 @@ private:
 	// Pixels used to update m_MainTexture
 	int* m_PixelPrep;
 #else 
-	void DrawAsteroidVertexArray(sf::VertexArray& vertices, sf::RenderStates& states, std::vector<std::pair<std::shared_ptr<GameObject>, float>>& objs, sf::RenderTexture& tex, sf::Shader& shader);
+	void DrawAsteroidVertexArray(sf::VertexArray& vertices, sf::RenderStates& states, std::vector<std::pair<const RenderObject*, float>>& objs, int transforms, float alpha, sf::RenderTexture& tex, sf::Shader& shader);
 	
 	// Helper functions for asteroid vertex array
-	static void SortObjectsByDistance(std::vector<std::pair<std::shared_ptr<GameObject>, float>>& objs);
+	static void SortObjectsByDistance(std::vector<std::pair<const RenderObject*, float>>& objs);
 	static float CalculateDistanceSquared(const sf::Vector2f& point1, const sf::Vector2f& point2);
 	static void RotateBox(float* coords, float sinAngle, float cosAngle);
 #endif
@@ -241,15 +312,23 @@ private:
 	void InitialiseShaders();
 
 	// Game flow functions
-	void SyncWithOtherThreads();
-	inline void RestartClock();
+	int AdvanceClock();
+	void RunFrames(int steps);
 	inline void ClearCleanUpObjects();
-	inline void CheckGlowShaderUniforms();
+	void FlipRenderSnapshots();
+	void SetGlowColour(const sf::Glsl::Vec4& colour);
+	void SetGlowRadius(bool full);
+
+	// Main thread stages
+	void DrawParticlesAndDisplay(sf::RenderWindow& window);
+	void CleanUp();
+	void EndFrame();
+	void PrintStageTimings() const;
+	void ReportFrameStats();
 
 	// Main loop functions
 	void Draw(sf::RenderWindow& window);
 	void Update(uintptr_t);
-	void CleanUp();
 	void SpawnLargeAsteroidOffscreen();
 	void CheckShipPosition();
 };
@@ -8,13 +8,15 @@
 
 void Gamestate::InitialisePlayer()
 {
-	m_Player = std::make_shared<PlayerShip>(ObjectTextures[0]);
-	std::shared_ptr<GameObject> player = m_Player;
+	std::unique_ptr<PlayerShip> player = std::make_unique<PlayerShip>(ObjectTextures[0]);
+	m_Player = player.get();
 
 	// note that verts must go round anti-clockwise
 	Polygon verts = { {-4.f, -15.f },{4.f, -15.f},{25.f, 0.f},{4.f, 15.f},{-4.f, 15.f},{-25.f, -0.f} };
-	player->AddComponent<PolygonCollisionComponent>(player, verts, PlayerShip::DefaultCollisionTagsSelf, PlayerShip::DefaultCollisionTagsOther);
-	m_AllActiveGameObjects.insert(m_Player);
+	player->AddComponent<PolygonCollisionComponent>(m_Player, verts, PlayerShip::DefaultCollisionTagsSelf, PlayerShip::DefaultCollisionTagsOther);
+	m_Objects.Register(std::move(player));
+	m_Player->SetActiveHandle(m_ActiveObjects.Add(m_Player));
+	m_Entities.Add(m_Player);
 }
 void Gamestate::InitialiseObjectPools()
 {
@@ -38,11 +40,11 @@ void Gamestate::InitialiseObjectPools()
 	*/
 	
 	// projectile prefab
-	std::shared_ptr<GameObject> projectileBase = std::make_shared<Projectile>(ObjectTextures[1]);
-	projectileBase->AddComponent<PooledObjectComponent>(projectileBase, nullptr);
-	projectileBase->AddComponent<CircleCollisionComponent>(projectileBase, 5.f, Projectile::DefaultCollisionTagsSelf, Projectile::DefaultCollisionTagsOther);
+	std::unique_ptr<GameObject> projectileBase = std::make_unique<Projectile>(ObjectTextures[1]);
+	projectileBase->AddComponent<PooledObjectComponent>(projectileBase.get(), nullptr);
+	projectileBase->AddComponent<CircleCollisionComponent>(projectileBase.get(), 5.f, Projectile::DefaultCollisionTagsSelf, Projectile::DefaultCollisionTagsOther);
 	// make pool - sets the pool pointer in the pooledobjectcomponent
-	m_PoolManager->CreatePool(m_Player->ProjectilePoolName, projectileBase, 3, 10, .5f, 1.f);
+	m_PoolManager->CreatePool(m_Player->ProjectilePoolName, std::move(projectileBase), 3, 10, .5f, 1.f);
 
 #if USE_CPU_FOR_OCCLUDERS
 	// not setup to use texture atlas
@@ -56,24 +58,24 @@ void Gamestate::InitialiseObjectPools()
 	int astLargeTexIndex = 5;
 #endif
 	// large asteroid prefab
-	std::shared_ptr<GameObject> asteroidLarge = std::make_shared<Asteroid>(ObjectTextures[astLargeTexIndex], AST_SIZE::large);
-	asteroidLarge->AddComponent<PooledObjectComponent>(asteroidLarge, nullptr);
+	std::unique_ptr<GameObject> asteroidLarge = std::make_unique<Asteroid>(ObjectTextures[astLargeTexIndex], AST_SIZE::large);
+	asteroidLarge->AddComponent<PooledObjectComponent>(asteroidLarge.get(), nullptr);
 	Polygon verts = { {-29.8f,-55.2f}, {32.8f,-54.6f}, {63.6f,-0.2f}, {31.8f,53.7f}, {-30.7f,53.2f}, {-61.5f,-1.3f} };
-	asteroidLarge->AddComponent<PolygonCollisionComponent>(asteroidLarge, verts, Asteroid::DefaultCollisionTagsSelf, Asteroid::DefaultCollisionTagsOther);
+	asteroidLarge->AddComponent<PolygonCollisionComponent>(asteroidLarge.get(), verts, Asteroid::DefaultCollisionTagsSelf, Asteroid::DefaultCollisionTagsOther);
 	
-	m_PoolManager->CreatePool(Asteroid::AsteroidLargePoolName, asteroidLarge, 5, 10, .5f, 1.f);
+	m_PoolManager->CreatePool(Asteroid::AsteroidLargePoolName, std::move(asteroidLarge), 5, 10, .5f, 1.f);
 
 	// medium asteroid prefab
-	std::shared_ptr<GameObject> asteroidMedium = std::make_shared<Asteroid>(ObjectTextures[astMediumTexIndex], AST_SIZE::medium);
-	asteroidMedium->AddComponent<PooledObjectComponent>(asteroidMedium, nullptr);
-	asteroidMedium->AddComponent<CircleCollisionComponent>(asteroidMedium, 40.f, Asteroid::DefaultCollisionTagsSelf, Asteroid::DefaultCollisionTagsOther);
+	std::unique_ptr<GameObject> asteroidMedium = std::make_unique<Asteroid>(ObjectTextures[astMediumTexIndex], AST_SIZE::medium);
+	asteroidMedium->AddComponent<PooledObjectComponent>(asteroidMedium.get(), nullptr);
+	asteroidMedium->AddComponent<CircleCollisionComponent>(asteroidMedium.get(), 40.f, Asteroid::DefaultCollisionTagsSelf, Asteroid::DefaultCollisionTagsOther);
 	
-	m_PoolManager->CreatePool(Asteroid::AsteroidMediumPoolName, asteroidMedium, 5, 10, .5f, 1.f);
+	m_PoolManager->CreatePool(Asteroid::AsteroidMediumPoolName, std::move(asteroidMedium), 5, 10, .5f, 1.f);
 
 	// small asteroid prefab
-	std::shared_ptr<GameObject> asteroidSmall = std::make_shared<Asteroid>(ObjectTextures[astSmallTexIndex], AST_SIZE::small);
-	asteroidSmall->AddComponent<PooledObjectComponent>(asteroidSmall, nullptr);
-	asteroidSmall->AddComponent<CircleCollisionComponent>(asteroidSmall, 25.f, Asteroid::DefaultCollisionTagsSelf, Asteroid::DefaultCollisionTagsOther);
+	std::unique_ptr<GameObject> asteroidSmall = std::make_unique<Asteroid>(ObjectTextures[astSmallTexIndex], AST_SIZE::small);
+	asteroidSmall->AddComponent<PooledObjectComponent>(asteroidSmall.get(), nullptr);
+	asteroidSmall->AddComponent<CircleCollisionComponent>(asteroidSmall.get(), 25.f, Asteroid::DefaultCollisionTagsSelf, Asteroid::DefaultCollisionTagsOther);
 	
-	m_PoolManager->CreatePool(Asteroid::AsteroidSmallPoolName, asteroidSmall, 5, 10, .5f, 1.f);
+	m_PoolManager->CreatePool(Asteroid::AsteroidSmallPoolName, std::move(asteroidSmall), 5, 10, .5f, 1.f);
 }
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "JobCoroutine.h"
+#include <atomic>
+#include <mutex>
+
+namespace JobSystem
+{
+    // fixed size frame blocks pooled per thread - a block always goes back to the pool of the thread which allocated it, pushed onto that
+    // pool's return list if it's freed on another thread (coroutines usually finish on a different worker than they started on), so a
+    // thread's pool only ever holds the most blocks that thread had in use at once
+    // a thread's blocks are given back when it exits and its pool is handed to the next thread to start, which also picks up anything
+    // returned to it in between
+    static const size_t COROUTINE_FRAME_SIZE = 512;
+
+    struct FramePool;
+
+    // in front of each pooled frame, the size of the default new alignment so the frame is aligned as ::operator new would have it
+    struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) FrameHeader
+    {
+        FramePool* pOwner;
+        FrameHeader* pNext;
+    };
+
+    struct FramePool
+    {
+        // only touched by the owning thread
+        FrameHeader* pFree = nullptr;
+        // pushed to by any other thread, only ever emptied all at once by the owner so there's no ABA
+        std::atomic<FrameHeader*> pReturned{ nullptr };
+        FramePool* pNextUnowned = nullptr;
+    };
+
+    static std::atomic<size_t> g_FrameBlocksAllocated{ 0 };
+    // pools whose threads have exited, never freed as frames may still be returned to them
+    static std::mutex g_UnownedPoolsMutex;
+    static FramePool* g_pUnownedPools = nullptr;
+
+    static void FreeBlocks(FrameHeader* pHeader)
+    {
+        while (pHeader != nullptr)
+        {
+            FrameHeader* pNext = pHeader->pNext;
+            ::operator delete(pHeader);
+            g_FrameBlocksAllocated.fetch_sub(1, std::memory_order_relaxed);
+            pHeader = pNext;
+        }
+    }
+
+    struct ThreadFramePool
+    {
+        FramePool* pPool = nullptr;
+
+        FramePool* Get()
+        {
+            if (pPool == nullptr)
+            {
+                std::lock_guard<std::mutex> lock(g_UnownedPoolsMutex);
+                if (g_pUnownedPools != nullptr)
+                {
+                    pPool = g_pUnownedPools;
+                    g_pUnownedPools = pPool->pNextUnowned;
+                }
+                else
+                {
+                    pPool = new FramePool;
+                }
+            }
+            return pPool;
+        }
+
+        ~ThreadFramePool()
+        {
+            if (pPool == nullptr)
+            {
+                return;
+            }
+            FreeBlocks(pPool->pFree);
+            pPool->pFree = nullptr;
+            FreeBlocks(pPool->pReturned.exchange(nullptr, std::memory_order_acquire));
+            std::lock_guard<std::mutex> lock(g_UnownedPoolsMutex);
+            pPool->pNextUnowned = g_pUnownedPools;
+            g_pUnownedPools = pPool;
+        }
+    };
+    thread_local ThreadFramePool tl_FramePool;
+
+    void* Coroutine::promise_type::operator new(size_t size)
+    {
+        if (size > COROUTINE_FRAME_SIZE)
+        {
+            return ::operator new(size);
+        }
+        FramePool* pPool = tl_FramePool.Get();
+        if (pPool->pFree == nullptr)
+        {
+            pPool->pFree = pPool->pReturned.exchange(nullptr, std::memory_order_acquire);
+        }
+        FrameHeader* pHeader = pPool->pFree;
+        if (pHeader != nullptr)
+        {
+            pPool->pFree = pHeader->pNext;
+        }
+        else
+        {
+            pHeader = static_cast<FrameHeader*>(::operator new(sizeof(FrameHeader) + COROUTINE_FRAME_SIZE));
+            pHeader->pOwner = pPool;
+            g_FrameBlocksAllocated.fetch_add(1, std::memory_order_relaxed);
+        }
+        return pHeader + 1;
+    }
+
+    void Coroutine::promise_type::operator delete(void* pFrame, size_t size)
+    {
+        if (size > COROUTINE_FRAME_SIZE)
+        {
+            ::operator delete(pFrame);
+            return;
+        }
+        FrameHeader* pHeader = static_cast<FrameHeader*>(pFrame) - 1;
+        FramePool* pOwner = pHeader->pOwner;
+        if (pOwner == tl_FramePool.pPool)
+        {
+            pHeader->pNext = pOwner->pFree;
+            pOwner->pFree = pHeader;
+            return;
+        }
+        FrameHeader* pHead = pOwner->pReturned.load(std::memory_order_relaxed);
+        do
+        {
+            pHeader->pNext = pHead;
+        } while (!pOwner->pReturned.compare_exchange_weak(pHead, pHeader, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    size_t GetCoroutineFrameBlocks()
+    {
+        return g_FrameBlocksAllocated.load(std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include "JobSystem.h"
+#include <coroutine>
+#include <exception>
+
+// jobs written as coroutines, so work which has to wait on other jobs (or a later stage, or the main thread) can be straight-line code rather
+// than split by hand into separate jobs - co_await hands the rest of the function back to the job system as a new job for when the wait is over
+// and the thread carries on with other jobs in the meantime, so nothing ever blocks and there are no extra threads
+// e.g.
+//     JobSystem::Coroutine StreamTexture(Texture* pTexture)
+//     {
+//         for (int chunk = 0; chunk < pTexture->ChunkCount(); ++chunk)
+//         {
+//             Decode(pTexture, chunk);                          // on a worker
+//             co_await JobSystem::ResumeOnMainThread();        // the main thread's queue is budgeted, so chunks spread over frames
+//             Upload(pTexture, chunk);
+//             co_await JobSystem::Reschedule(JobSystem::Priority::LOW);
+//         }
+//     }
+// calling a coroutine runs it straight away on the calling thread up to its first co_await, it's fire and forget (the frame frees itself at
+// the end) so anything it needs after that point should be in the frame (parameters are copied in, take shared_ptrs by value)
+// the parts after each co_await are separate jobs, each with a pooled counter of its own
+namespace JobSystem
+{
+    class Coroutine
+    {
+    public:
+        struct promise_type
+        {
+            Coroutine get_return_object() { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            // nowhere to report an exception to once the coroutine is running as a job
+            void unhandled_exception() { std::terminate(); }
+
+            // frames come from per-thread pools of fixed size blocks, so a coroutine started every frame doesn't allocate once they've warmed up
+            // - a block is returned to the pool it came from whichever thread frees it
+            static void* operator new(size_t size);
+            static void operator delete(void* pFrame, size_t size);
+        };
+    };
+
+    // pooled frame blocks allocated and not yet given back (free in a pool or in use), for the benchmarks
+    size_t GetCoroutineFrameBlocks();
+
+    // the job which picks a suspended coroutine back up
+    inline Declaration MakeResumeJob(std::coroutine_handle<> coroutine, Priority priority)
+    {
+        return MakeJob([coroutine] { coroutine.resume(); }, priority);
+    }
+
+    // co_await Await(pCounter) - the rest runs once the counter reaches zero (or, for a pooled counter or handle, is freed), straight away
+    // without suspending if it already has
+    struct CounterAwaiter
+    {
+        Counter* pCounter;
+        CounterHandle Handle;
+        Priority ResumePriority;
+
+        bool await_ready() const
+        {
+            if (pCounter == nullptr)
+            {
+                Counter* pResolved = ResolveCounter(Handle);
+                return pResolved == nullptr || pResolved->count.load() <= 0;
+            }
+            return pCounter->count.load() <= 0;
+        }
+        bool await_suspend(std::coroutine_handle<> coroutine)
+        {
+            Declaration resume = MakeResumeJob(coroutine, ResumePriority);
+            return pCounter != nullptr ? KickWhenDone(pCounter, resume) : KickWhenDone(Handle, resume);
+        }
+        void await_resume() const {}
+    };
+    inline CounterAwaiter Await(Counter* pCounter, Priority resumePriority = Priority::NORMAL)
+    {
+        return { pCounter, CounterHandle(), resumePriority };
+    }
+    inline CounterAwaiter Await(CounterHandle handle, Priority resumePriority = Priority::NORMAL)
+    {
+        return { nullptr, handle, resumePriority };
+    }
+
+    // co_await Reschedule(priority) - the rest is queued as a new job straight away, e.g. to get off a high priority job's back before doing
+    // something slow, or to let other jobs in between the steps of a long task
+    struct RescheduleAwaiter
+    {
+        Priority ResumePriority;
+
+        bool await_ready() const { return false; }
+        void await_suspend(std::coroutine_handle<> coroutine) const
+        {
+            Declaration resume = MakeResumeJob(coroutine, ResumePriority);
+            KickBatch(1, &resume);
+        }
+        void await_resume() const {}
+    };
+    inline RescheduleAwaiter Reschedule(Priority resumePriority = Priority::NORMAL)
+    {
+        return { resumePriority };
+    }
+
+    // co_await ResumeOnMainThread() - the rest runs on the main thread, next time it runs its queue (see PostToMainThread)
+    struct MainThreadAwaiter
+    {
+        bool await_ready() const { return false; }
+        void await_suspend(std::coroutine_handle<> coroutine) const
+        {
+            PostToMainThread(MakeResumeJob(coroutine, Priority::NORMAL));
+        }
+        void await_resume() const {}
+    };
+    inline MainThreadAwaiter ResumeOnMainThread()
+    {
+        return {};
+    }
+}
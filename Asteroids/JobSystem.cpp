@@ -1,180 +1,899 @@
 #include "JobSystem.h"
-#include "Gamestate.h"
-#include "ObjectPool.h"
-#include "CollisionGrid.h"
+#include "WorkStealingDeque.h"
+#include "SubmissionBuffer.h"
+#include "JobTrace.h"
+#include <chrono>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#pragma comment(lib, "Synchronization.lib")
+#else
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
+thread_local int ThreadIndex = 0;
 
 namespace JobSystem
 {
-    // job queue
-    std::queue<Declaration> g_JobQueue;
-    std::queue<Declaration> g_JobBufferQueue;
-    std::queue<Declaration> g_JobDelayedBufferQueue;
-    std::vector<Declaration> g_UpkeepJobs;
+    static const int NUM_PRIORITIES = 4;
+
+    // job queues, one per priority level
+    std::queue<Declaration> g_JobQueues[NUM_PRIORITIES];
+    // deferred jobs - two submission buffers alternate as the next phase's, so a phase change is an index bump rather than a copy, and jobs of
+    // the new phase can add to the other buffer while the old one is still being kicked
+    SubmissionBuffer<Declaration> g_JobBuffers[2];
+    std::atomic<unsigned int> g_JobBufferRotation{ 0 };
+
+    // upkeep tasks, registered during setup and never removed (a deque so their addresses stay put), everything but the stats and the
+    // fast path check is only touched with g_UpkeepMutex held
+    struct UpkeepTask
+    {
+        Declaration Decl;
+        UpkeepSchedule Schedule;
+        // claimed by the thread running it, so a task never runs on two threads at once
+        bool Running = false;
+        long long LastRunFrame = 0;
+        long long LastRunNs = 0;
+    };
+    std::deque<UpkeepTask> g_UpkeepTasks;
+    std::chrono::steady_clock::time_point g_UpkeepEpoch = std::chrono::steady_clock::now();
+    long long g_UpkeepFrame = 0;
+    static const long long DEFAULT_UPKEEP_BUDGET_NS = 500000;
+    std::atomic<long long> g_UpkeepBudgetNs{ DEFAULT_UPKEEP_BUDGET_NS };
+    std::atomic<long long> g_UpkeepUsedNs{ 0 };
+    // earliest time (since g_UpkeepEpoch) any task could be ready, lets workers skip the lock after every job when nothing is
+    std::atomic<long long> g_UpkeepNextCheckNs{ 0 };
+    std::atomic<long long> g_UpkeepRuns{ 0 };
+    std::atomic<long long> g_UpkeepLateRuns{ 0 };
+
+    // jobs posted for the main thread, not many so a locked deque is plenty
+    std::deque<Declaration> g_MainThreadJobs;
+    std::mutex g_MainThreadMutex;
 
     // synchronization primitives
     std::mutex g_JobMutex;
-    std::mutex g_BufferMutex;
-    std::mutex g_DelayedBufferMutex;
     std::mutex g_UpkeepMutex;
     std::condition_variable g_JobCV;
     bool g_Ready = false;
     bool g_IncludeMainThread = false;
     std::atomic<bool> g_Shutdown{ false };
-    std::atomic<int> g_UpkeepJobIndex{ 0 };
+
+    // jobs waiting to be taken at each priority level (includes jobs sitting in worker deques), and the most seen at once
+    std::atomic<int> g_QueueDepth[NUM_PRIORITIES];
+    std::atomic<int> g_PeakQueueDepth[NUM_PRIORITIES];
+
+    // starvation protection - strict priority order, except every Nth job a worker takes it looks at the lower level first
+    static const unsigned int NORMAL_STARVATION_INTERVAL = 8;
+    static const unsigned int LOW_STARVATION_INTERVAL = 32;
+    thread_local unsigned int tl_TakeCount = 0;
+
+    // work stealing - each worker has one deque per priority, g_JobQueues becomes the injection queue for the main thread and any deque overflow
+    struct WorkerQueues
+    {
+        WorkStealingDeque<Declaration, 1024> Deques[NUM_PRIORITIES];
+    };
+    SchedulerMode g_Mode = SchedulerMode::WORK_STEALING;
+    std::vector<std::unique_ptr<WorkerQueues>> g_WorkerQueues;
+    // jobs which have been pushed but not yet taken by a worker, lets workers sleep without taking g_JobMutex on every pop
+    std::atomic<int> g_PendingJobs{ 0 };
+    // size of each of g_JobQueues, so workers only lock the injection queue when there's something in it
+    std::atomic<int> g_InjectedJobs[NUM_PRIORITIES];
+    // pushers only need to lock and notify if someone is actually asleep
+    std::atomic<int> g_SleepingWorkers{ 0 };
+    // index into g_WorkerQueues, -1 for any thread which isn't a worker
+    thread_local int tl_WorkerIndex = -1;
+    thread_local unsigned int tl_StealSeed = 0;
+    // counter of the job being executed on this thread, lets a job add more work to its own counter (see ParallelFor)
+    thread_local Counter* tl_CurrentCounter = nullptr;
+
+    // help-while-waiting - a waiting thread runs queued jobs, and only parks on g_WaitEpoch when there's nothing it can run
+    // anything that could let a waiter make progress (a counter decrement, new jobs) bumps the epoch and wakes, but only if someone is parked
+    std::atomic<uint32_t> g_WaitEpoch{ 0 };
+    std::atomic<int> g_ParkedWaiters{ 0 };
+    std::atomic<long long> g_HelpedJobs{ 0 };
+    std::atomic<long long> g_ParkedNs{ 0 };
+    std::atomic<long long> g_WorkerIdleNs{ 0 };
+    std::atomic<long long> g_PhaseBusyNs[MAX_TIMED_PHASES];
+    // how long each job took, per phase plus one for every job outside a phase (upkeep, batches, coroutine steps...)
+    LatencyHistogram g_JobTimes[MAX_TIMED_PHASES + 1];
+
+    // SERIAL mode's only queue, only ever touched by the main thread since there's nothing else running jobs
+    std::deque<Declaration> g_SerialJobs;
 
     // worker threads
     std::vector<std::thread> g_workerThreads;
+    // set before any worker starts, so jobs can read it without racing g_workerThreads being filled in
+    int g_NumWorkers = 0;
 
-    bool IsBufferEmpty()
+    SchedulerMode GetSchedulerMode()
+    {
+        return g_Mode;
+    }
+
+    int GetQueueDepth(Priority priority)
+    {
+        return g_QueueDepth[static_cast<int>(priority)].load(std::memory_order_relaxed);
+    }
+    int GetPeakQueueDepth(Priority priority)
+    {
+        return g_PeakQueueDepth[static_cast<int>(priority)].load(std::memory_order_relaxed);
+    }
+    WaitStats GetWaitStats()
+    {
+        return { g_HelpedJobs.load(), g_ParkedNs.load(), g_WorkerIdleNs.load() };
+    }
+    long long GetPhaseBusyNs(int phase)
+    {
+        return phase >= 0 && phase < MAX_TIMED_PHASES ? g_PhaseBusyNs[phase].load(std::memory_order_relaxed) : 0;
+    }
+    LatencyHistogram::Summary SummariseJobTimes(int phase, bool reset)
+    {
+        return g_JobTimes[phase >= 0 && phase < MAX_TIMED_PHASES ? phase : MAX_TIMED_PHASES].Summarise(reset);
+    }
+
+    long long NanosecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // PARKING helpers ------------------------------------------------------------------------------------------------------------------------
+
+    // block until g_WaitEpoch no longer holds expected (returns immediately if it already doesn't), spurious wakeups are fine
+    void ParkOnEpoch(uint32_t expected)
+    {
+#ifdef _WIN32
+        WaitOnAddress(&g_WaitEpoch, &expected, sizeof(expected), INFINITE);
+#else
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&g_WaitEpoch), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#endif
+    }
+
+    // called after anything a waiter could be waiting on has changed, free unless a thread is actually parked
+    void WakeWaiters()
+    {
+        if (g_ParkedWaiters.load() == 0)
+        {
+            return;
+        }
+        g_WaitEpoch.fetch_add(1);
+#ifdef _WIN32
+        WakeByAddressAll(&g_WaitEpoch);
+#else
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&g_WaitEpoch), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#endif
+    }
+
+    // PRIORITY helpers -----------------------------------------------------------------------------------------------------------------------
+
+    void IncrementQueueDepth(int level, int count)
+    {
+        int depth = g_QueueDepth[level].fetch_add(count, std::memory_order_relaxed) + count;
+        int peak = g_PeakQueueDepth[level].load(std::memory_order_relaxed);
+        while (depth > peak && !g_PeakQueueDepth[level].compare_exchange_weak(peak, depth, std::memory_order_relaxed)) {}
+    }
+
+    // order in which the calling thread should look at the priority levels for its next job
+    // CRITICAL is always first, so a critical job preempts everything else at the next job boundary
+    void GetTakeOrder(int order[NUM_PRIORITIES])
+    {
+        const int critical = static_cast<int>(Priority::CRITICAL);
+        const int high = static_cast<int>(Priority::HIGH);
+        const int normal = static_cast<int>(Priority::NORMAL);
+        const int low = static_cast<int>(Priority::LOW);
+
+        order[0] = critical;
+        if (tl_TakeCount % LOW_STARVATION_INTERVAL == LOW_STARVATION_INTERVAL - 1)
+        {
+            order[1] = low; order[2] = high; order[3] = normal;
+        }
+        else if (tl_TakeCount % NORMAL_STARVATION_INTERVAL == NORMAL_STARVATION_INTERVAL - 1)
+        {
+            order[1] = normal; order[2] = high; order[3] = low;
+        }
+        else
+        {
+            order[1] = high; order[2] = normal; order[3] = low;
+        }
+    }
+
+    // GLOBAL_QUEUE helpers -------------------------------------------------------------------------------------------------------------------
+
+    // caller must hold g_JobMutex
+    void PushToGlobalQueuesLocked(const Declaration& decl)
+    {
+        int level = static_cast<int>(decl.m_Priority);
+        g_JobQueues[level].push(decl);
+        IncrementQueueDepth(level, 1);
+    }
+
+    // caller must hold g_JobMutex
+    bool TakeFromGlobalQueuesLocked(Declaration& out)
+    {
+        int order[NUM_PRIORITIES];
+        GetTakeOrder(order);
+        for (int i = 0; i < NUM_PRIORITIES; ++i)
+        {
+            int level = order[i];
+            if (!g_JobQueues[level].empty())
+            {
+                out = g_JobQueues[level].front();
+                g_JobQueues[level].pop();
+                g_QueueDepth[level].fetch_sub(1, std::memory_order_relaxed);
+                ++tl_TakeCount;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // WORK_STEALING helpers ------------------------------------------------------------------------------------------------------------------
+
+    // wake sleeping workers after jobs have been published, the empty lock makes sure a worker can't be between checking its predicate and waiting
+    void WakeWorkers(int count)
     {
+        if (g_SleepingWorkers.load() == 0)
+        {
+            return;
+        }
         {
-            std::lock_guard<std::mutex> lock(g_BufferMutex);
-            return g_JobBufferQueue.size() == 0;
+            std::lock_guard<std::mutex> lock(g_JobMutex);
+        }
+        if (count == 1)
+        {
+            g_JobCV.notify_one();
+        }
+        else
+        {
+            g_JobCV.notify_all();
         }
     }
+
+    // push onto the calling worker's own deques, or the injection queues if called from a non-worker or a deque is full
+    void PushJobs(int count, const Declaration aDecl[])
+    {
+        if (count == 0) return;
+        int overflowStart = 0;
+        if (tl_WorkerIndex >= 0)
+        {
+            WorkerQueues& queues = *g_WorkerQueues[tl_WorkerIndex];
+            while (overflowStart < count)
+            {
+                int level = static_cast<int>(aDecl[overflowStart].m_Priority);
+                IncrementQueueDepth(level, 1);
+                if (!queues.Deques[level].Push(aDecl[overflowStart]))
+                {
+                    g_QueueDepth[level].fetch_sub(1, std::memory_order_relaxed);
+                    break;
+                }
+                ++overflowStart;
+            }
+        }
+        if (overflowStart < count)
+        {
+            std::lock_guard<std::mutex> lock(g_JobMutex);
+            for (int i = overflowStart; i < count; ++i)
+            {
+                PushToGlobalQueuesLocked(aDecl[i]);
+                g_InjectedJobs[static_cast<int>(aDecl[i].m_Priority)].fetch_add(1);
+            }
+        }
+        g_PendingJobs.fetch_add(count);
+        WakeWorkers(count);
+        WakeWaiters();
+    }
+
+    // for one priority level: own deque first (LIFO), then the injection queue, then try to steal from the other workers starting from a random victim
+    bool TryTakeJobAtLevel(int level, Declaration& out)
+    {
+        if (tl_WorkerIndex >= 0 && g_WorkerQueues[tl_WorkerIndex]->Deques[level].Pop(out))
+        {
+            return true;
+        }
+        if (g_InjectedJobs[level].load() > 0)
+        {
+            std::lock_guard<std::mutex> lock(g_JobMutex);
+            if (!g_JobQueues[level].empty())
+            {
+                out = g_JobQueues[level].front();
+                g_JobQueues[level].pop();
+                g_InjectedJobs[level].fetch_sub(1);
+                return true;
+            }
+        }
+        int numWorkers = static_cast<int>(g_WorkerQueues.size());
+        if (numWorkers == 0) return false;
+        // cheap xorshift so workers don't all pile onto the same victim
+        tl_StealSeed ^= tl_StealSeed << 13;
+        tl_StealSeed ^= tl_StealSeed >> 17;
+        tl_StealSeed ^= tl_StealSeed << 5;
+        int start = static_cast<int>(tl_StealSeed % numWorkers);
+        for (int i = 0; i < numWorkers; ++i)
+        {
+            int victim = (start + i) % numWorkers;
+            if (victim == tl_WorkerIndex) continue;
+            if (g_WorkerQueues[victim]->Deques[level].Steal(out))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool TryTakeJob(Declaration& out)
+    {
+        int order[NUM_PRIORITIES];
+        GetTakeOrder(order);
+        for (int i = 0; i < NUM_PRIORITIES; ++i)
+        {
+            int level = order[i];
+            // skip levels with nothing in them without touching any deque
+            if (g_QueueDepth[level].load(std::memory_order_relaxed) <= 0)
+            {
+                continue;
+            }
+            if (TryTakeJobAtLevel(level, out))
+            {
+                g_QueueDepth[level].fetch_sub(1, std::memory_order_relaxed);
+                g_PendingJobs.fetch_sub(1);
+                ++tl_TakeCount;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // SERIAL helpers -------------------------------------------------------------------------------------------------------------------------
+
+    void PushSerialJobs(int count, const Declaration aDecl[])
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            g_SerialJobs.push_back(aDecl[i]);
+            IncrementQueueDepth(static_cast<int>(aDecl[i].m_Priority), 1);
+        }
+    }
+
+    bool TakeSerialJob(Declaration& out)
+    {
+        if (g_SerialJobs.empty())
+        {
+            return false;
+        }
+        out = g_SerialJobs.front();
+        g_SerialJobs.pop_front();
+        g_QueueDepth[static_cast<int>(out.m_Priority)].fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // ----------------------------------------------------------------------------------------------------------------------------------------
+
+    SubmissionBuffer<Declaration>& NextPhaseBuffer()
+    {
+        return g_JobBuffers[g_JobBufferRotation.load() % 2];
+    }
+
+    bool IsBufferEmpty()
+    {
+        return NextPhaseBuffer().Empty();
+    }
     void ClearBuffer()
     {
-        while (!g_JobBufferQueue.empty()) g_JobBufferQueue.pop();
+        NextPhaseBuffer().Clear();
     }
     void SetIncludeMainThread(bool inc)
     {
         g_IncludeMainThread = inc;
     }
 
-    Counter* AllocCounter() 
-    { 
-        return new Counter{ 0 };
+    // COUNTER POOL ---------------------------------------------------------------------------------------------------------------------------
+
+    // lock-free free list of pool indices, the head packs the index (low 16 bits) with a tag bumped on every change to avoid ABA
+    // counters which have never been used are handed out from g_CountersCreated instead, so the pool needs no initialisation
+    static const int COUNTER_POOL_SIZE = 512;
+    static const uint16_t NO_COUNTER = 0xFFFF;
+    Counter g_CounterPool[COUNTER_POOL_SIZE];
+    std::atomic<uint16_t> g_NextFreeCounter[COUNTER_POOL_SIZE];
+    std::atomic<uint32_t> g_FreeCounterHead{ NO_COUNTER };
+    std::atomic<int> g_CountersCreated{ 0 };
+    std::atomic<int> g_CountersInUse{ 0 };
+
+    Counter* AllocCounter()
+    {
+        Counter* pCounter = nullptr;
+        uint32_t head = g_FreeCounterHead.load(std::memory_order_acquire);
+        while ((head & 0xFFFF) != NO_COUNTER)
+        {
+            uint16_t index = static_cast<uint16_t>(head & 0xFFFF);
+            uint32_t newHead = (((head >> 16) + 1) << 16) | g_NextFreeCounter[index].load(std::memory_order_relaxed);
+            if (g_FreeCounterHead.compare_exchange_weak(head, newHead, std::memory_order_acquire))
+            {
+                pCounter = &g_CounterPool[index];
+                break;
+            }
+        }
+        if (pCounter == nullptr)
+        {
+            int index = g_CountersCreated.fetch_add(1);
+            if (index >= COUNTER_POOL_SIZE)
+            {
+                // pool exhausted - a counter from anywhere else would have no handle, so anything waiting on it through one would think it
+                // had already finished, better to stop here than run dependents early or drop them
+                std::cerr << "Job system counter pool exhausted (" << COUNTER_POOL_SIZE << " in use), counters are being leaked or COUNTER_POOL_SIZE is too small" << std::endl;
+                std::abort();
+            }
+            pCounter = &g_CounterPool[index];
+            pCounter->poolIndex = static_cast<uint16_t>(index);
+        }
+        pCounter->count.store(0);
+        pCounter->onComplete = { nullptr, nullptr };
+        pCounter->onCompleteParam = 0;
+        pCounter->phase = -1;
+        g_CountersInUse.fetch_add(1, std::memory_order_relaxed);
+        return pCounter;
+    }
+    // see COUNTER WAITERS below
+    void KickFinishedWaiters();
+
+    void FreeCounter(Counter* pCounter)
+    {
+        if (pCounter->poolIndex == NO_COUNTER)
+        {
+            // not from AllocCounter
+            assert(false);
+            return;
+        }
+        // invalidate outstanding handles before the counter can be handed out again
+        pCounter->generation.fetch_add(1);
+        g_CountersInUse.fetch_sub(1, std::memory_order_relaxed);
+        KickFinishedWaiters();
+        uint16_t index = pCounter->poolIndex;
+        uint32_t head = g_FreeCounterHead.load(std::memory_order_relaxed);
+        uint32_t newHead;
+        do
+        {
+            g_NextFreeCounter[index].store(static_cast<uint16_t>(head & 0xFFFF), std::memory_order_relaxed);
+            newHead = (((head >> 16) + 1) << 16) | index;
+        } while (!g_FreeCounterHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+    }
+    CounterHandle GetCounterHandle(const Counter* pCounter)
+    {
+        return { pCounter->poolIndex, pCounter->generation.load() };
+    }
+    Counter* ResolveCounter(CounterHandle handle)
+    {
+        if (handle.index >= COUNTER_POOL_SIZE)
+        {
+            return nullptr;
+        }
+        Counter* pCounter = &g_CounterPool[handle.index];
+        return pCounter->generation.load() == handle.generation ? pCounter : nullptr;
     }
-    void FreeCounter(Counter* pCounter) 
+    int GetCountersInUse()
     {
-        delete pCounter; 
+        return g_CountersInUse.load(std::memory_order_relaxed);
+    }
+
+    // COUNTER WAITERS -------------------------------------------------------------------------------------------------------------------------
+
+    // jobs waiting on a counter (see KickWhenDone), only ever a few at once so a locked vector is plenty, and the count lets a counter reaching
+    // zero skip the lock when nobody's waiting - waiters register before checking and counters change before checking for waiters, so one of
+    // the two always sees the other
+    struct CounterWaiter
+    {
+        Counter* pCounter;
+        CounterHandle Handle;
+        Declaration Decl;
+    };
+    std::vector<CounterWaiter> g_CounterWaiters;
+    std::mutex g_CounterWaiterMutex;
+    std::atomic<int> g_CounterWaiterCount{ 0 };
+
+    bool IsWaiterDone(const CounterWaiter& waiter)
+    {
+        if (waiter.Handle.index != NO_COUNTER)
+        {
+            Counter* pCounter = ResolveCounter(waiter.Handle);
+            return pCounter == nullptr || pCounter->count.load() <= 0;
+        }
+        return waiter.pCounter->count.load() <= 0;
+    }
+
+    // called whenever a counter reaches zero or is freed
+    void KickFinishedWaiters()
+    {
+        if (g_CounterWaiterCount.load() == 0)
+        {
+            return;
+        }
+        Declaration ready[16];
+        int readyCount = 0;
+        {
+            std::lock_guard<std::mutex> lock(g_CounterWaiterMutex);
+            for (size_t i = 0; i < g_CounterWaiters.size() && readyCount < 16;)
+            {
+                if (IsWaiterDone(g_CounterWaiters[i]))
+                {
+                    ready[readyCount++] = g_CounterWaiters[i].Decl;
+                    g_CounterWaiters[i] = g_CounterWaiters.back();
+                    g_CounterWaiters.pop_back();
+                    g_CounterWaiterCount.fetch_sub(1);
+                    continue;
+                }
+                ++i;
+            }
+        }
+        // outside the lock, kicking allocates a counter which can free another and land back here
+        for (int i = 0; i < readyCount; ++i)
+        {
+            KickBatch(1, &ready[i]);
+        }
+        if (readyCount == 16)
+        {
+            KickFinishedWaiters();
+        }
+    }
+
+    bool AddCounterWaiter(const CounterWaiter& waiter)
+    {
+        std::lock_guard<std::mutex> lock(g_CounterWaiterMutex);
+        g_CounterWaiters.push_back(waiter);
+        g_CounterWaiterCount.fetch_add(1);
+        if (IsWaiterDone(waiter))
+        {
+            g_CounterWaiters.pop_back();
+            g_CounterWaiterCount.fetch_sub(1);
+            return false;
+        }
+        return true;
+    }
+
+    bool KickWhenDone(Counter* pCounter, const Declaration& decl)
+    {
+        // pooled counters are tracked through a handle, so the waiter can't be confused by the counter being reused
+        CounterHandle handle;
+        if (pCounter->poolIndex != NO_COUNTER)
+        {
+            handle = GetCounterHandle(pCounter);
+        }
+        return AddCounterWaiter({ pCounter, handle, decl });
+    }
+    bool KickWhenDone(CounterHandle handle, const Declaration& decl)
+    {
+        if (handle.index == NO_COUNTER)
+        {
+            return false;
+        }
+        return AddCounterWaiter({ nullptr, handle, decl });
+    }
+
+    // continuation for KickBatch counters, the batch is done so nothing references the counter any more
+    void FreeCounterOnComplete(void* pCounter, uintptr_t)
+    {
+        FreeCounter(static_cast<Counter*>(pCounter));
     }
 
     void KickJob(const Declaration& decl)
     {
+        if (g_Mode == SchedulerMode::WORK_STEALING)
+        {
+            PushJobs(1, &decl);
+            return;
+        }
+        if (g_Mode == SchedulerMode::SERIAL)
+        {
+            PushSerialJobs(1, &decl);
+            return;
+        }
         {
             std::lock_guard<std::mutex> lock(g_JobMutex);
-            g_JobQueue.push(decl);
+            PushToGlobalQueuesLocked(decl);
             g_Ready = true;
         }
         g_JobCV.notify_one();
+        WakeWaiters();
     }
     void KickJobs(int count, const Declaration aDecl[])
     {
+        if (g_Mode == SchedulerMode::WORK_STEALING)
+        {
+            PushJobs(count, aDecl);
+            return;
+        }
+        if (g_Mode == SchedulerMode::SERIAL)
+        {
+            PushSerialJobs(count, aDecl);
+            return;
+        }
         {
             std::lock_guard<std::mutex> lock(g_JobMutex);
             for (int i = 0; i < count; ++i)
             {
-                g_JobQueue.push(aDecl[i]);
+                PushToGlobalQueuesLocked(aDecl[i]);
             }
             g_Ready = true;
         }
         g_JobCV.notify_all();
+        WakeWaiters();
     }
 
     void AddJobToBuffer(const Declaration& decl)
     {
-        {
-            std::lock_guard<std::mutex> lock(g_BufferMutex);
-            g_JobBufferQueue.push(decl);
-        }
+        NextPhaseBuffer().Push(decl);
     }
     void AddJobsToBuffer(int count, const Declaration aDecl[])
     {
-        {
-            std::lock_guard<std::mutex> lock(g_BufferMutex);
-            for (int i = 0; i < count; ++i)
-            {
-                g_JobBufferQueue.push(aDecl[i]);
-            }
-        }
+        NextPhaseBuffer().Push(count, aDecl);
     }
     void AddJobsToBuffer(const std::vector<Declaration>& vDecl)
     {
+        NextPhaseBuffer().Push(static_cast<int>(vDecl.size()), vDecl.data());
+    }
+
+    void AddJobToUpkeep(const Declaration& decl, const UpkeepSchedule& schedule)
+    {
+        assert(schedule.EveryFrames >= 0 && schedule.EveryNs >= 0);
+        std::lock_guard<std::mutex> lock(g_UpkeepMutex);
+        g_UpkeepTasks.emplace_back();
+        UpkeepTask& task = g_UpkeepTasks.back();
+        task.Decl = decl;
+        task.Schedule = schedule;
+        // due straight away
+        task.LastRunFrame = g_UpkeepFrame - schedule.EveryFrames;
+        task.LastRunNs = NanosecondsSince(g_UpkeepEpoch) - schedule.EveryNs;
+        g_UpkeepNextCheckNs.store(0);
+    }
+
+    void SetUpkeepBudget(long long budgetNs)
+    {
+        g_UpkeepBudgetNs.store(budgetNs);
+    }
+
+    UpkeepStats GetUpkeepStats()
+    {
+        return { g_UpkeepRuns.load(), g_UpkeepLateRuns.load(), g_UpkeepUsedNs.load() };
+    }
+
+    void PostToMainThread(const Declaration& decl)
+    {
+        std::lock_guard<std::mutex> lock(g_MainThreadMutex);
+        g_MainThreadJobs.push_back(decl);
+    }
+
+    int GetMainThreadQueueDepth()
+    {
+        std::lock_guard<std::mutex> lock(g_MainThreadMutex);
+        return static_cast<int>(g_MainThreadJobs.size());
+    }
+
+    // takes one off the counter for a finished job, or for NextPhase letting go of the phase it held open - whichever takes it to zero runs the
+    // counter's continuation if it has one, otherwise moves the next phase in (for NextPhase's own count, only if anything was buffered for
+    // it), then kicks anything waiting on the counter - waiters are woken after the continuation so anything it changes is visible to them
+    void ReleaseCount(Counter* pCounter, bool releasingPhase)
+    {
+        // copy the continuation first, once the count is decremented a waiter is free to reuse or free the counter
+        MemberFunctionWrapper onComplete = pCounter->onComplete;
+        uintptr_t onCompleteParam = pCounter->onCompleteParam;
+        if (pCounter->count.fetch_sub(1) == 1)
         {
-            std::lock_guard<std::mutex> lock(g_BufferMutex);
-            for (size_t i = 0; i < vDecl.size(); ++i)
+            if (onComplete.func != nullptr)
+            {
+                onComplete.func(onComplete.instance, onCompleteParam);
+            }
+            else if (!releasingPhase || !IsBufferEmpty())
             {
-                g_JobBufferQueue.push(vDecl[i]);
+                NextPhase(pCounter);
             }
+            KickFinishedWaiters();
         }
+        WakeWaiters();
     }
-    void AddJobToDelayedBuffer(const Declaration& decl)
+
+    // complete the job then release its count on the counter
+    void ExecuteJob(const Declaration& decl)
     {
+        // jobs can run inside other jobs while helping, so restore rather than clear
+        Counter* pOuterCounter = tl_CurrentCounter;
+        tl_CurrentCounter = decl.m_pCounter;
+        // the job holds its counter, so the phase can be read now but not after the decrement
+        int phase = decl.m_pCounter->phase;
+        bool timed = phase >= 0 && phase < MAX_TIMED_PHASES;
+        auto start = std::chrono::steady_clock::now();
+#if USE_JOB_TRACE
+        bool trace = JobTrace::IsEnabled();
+        long long traceBegin = trace ? JobTrace::Now() : 0;
+#endif
+        decl.Invoke();
+#if USE_JOB_TRACE
+        if (trace)
+        {
+            JobTrace::Record(traceBegin, JobTrace::Now(), decl.m_MemberFunction.func, decl.m_MemberFunction.instance, phase, static_cast<int>(decl.m_Priority));
+        }
+#endif
+        long long jobNs = NanosecondsSince(start);
+        if (timed)
         {
-            std::lock_guard<std::mutex> lock(g_DelayedBufferMutex);
-            g_JobDelayedBufferQueue.push(decl);
+            g_PhaseBusyNs[phase].fetch_add(jobNs, std::memory_order_relaxed);
         }
+        g_JobTimes[timed ? phase : MAX_TIMED_PHASES].Record(jobNs);
+        tl_CurrentCounter = pOuterCounter;
+        ReleaseCount(decl.m_pCounter, false);
     }
 
-    void AddJobToUpkeep(const Declaration& decl)
+    bool NoQueuedJobs()
     {
+        for (int i = 0; i < NUM_PRIORITIES; ++i)
         {
-            std::lock_guard<std::mutex> lock(g_UpkeepMutex);
-            g_UpkeepJobs.push_back(decl);
+            if (g_QueueDepth[i].load(std::memory_order_relaxed) > 0) return false;
         }
+        return true;
     }
 
-    // wait for job to terminate (for its Counter to become zero)
-    void WaitForCounter(Counter* pCounter)
+    Counter* GetCurrentJobCounter()
     {
-        while (pCounter->count.load() > 0)
-        {
-            std::this_thread::yield();
-        }
+        return tl_CurrentCounter;
+    }
+
+    bool HasIdleCapacity()
+    {
+        return g_NumWorkers > 0 && NoQueuedJobs();
     }
-    // NO LONGER USED, SEE NextPhase
-    void WaitForCounterAndSwapBuffers(Counter* pCounter, bool waitForMainThread)
+
+    bool TryRunOneJob()
     {
-        while (pCounter->count > 0)
+        Declaration declCopy;
+        if (g_Mode == SchedulerMode::WORK_STEALING)
         {
-            std::this_thread::yield();
+            if (!TryTakeJob(declCopy))
+            {
+                return false;
+            }
         }
+        else if (g_Mode == SchedulerMode::SERIAL)
         {
-            std::unique_lock<std::mutex> lock(g_BufferMutex);
-            std::unique_lock<std::mutex> lock2(g_JobMutex);
-            std::unique_lock<std::mutex> lock3(g_DelayedBufferMutex);
-            // swap buffer queue with main job queue, then move any leftover jobs from the main queue back over
-            std::swap(g_JobBufferQueue, g_JobQueue);
-            // -1 since the transition job doesn't use this counter, but it is always present in the bufferqueue
-            pCounter->count.store(g_JobQueue.size() + waitForMainThread - 1);
-            while (!g_JobBufferQueue.empty())
+            if (!TakeSerialJob(declCopy))
             {
-                g_JobQueue.push(g_JobBufferQueue.front());
-                g_JobBufferQueue.pop();
+                return false;
             }
-            if (!g_JobDelayedBufferQueue.empty())
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(g_JobMutex);
+            if (!TakeFromGlobalQueuesLocked(declCopy))
             {
-                std::swap(g_JobBufferQueue, g_JobDelayedBufferQueue);
+                return false;
             }
         }
-        g_Ready = true;
-        g_JobCV.notify_all();
+        ExecuteJob(declCopy);
+        return true;
     }
-    void NextPhase(Counter* pCounter)
+
+    // run jobs until done, park when there's nothing to run - registering as parked before the final check means any change after it
+    // will see the registration and bump the epoch, so the wakeup can't be lost
+    void HelpUntil(const std::function<bool()>& done)
     {
+        while (!done())
         {
-            std::unique_lock<std::mutex> lock(g_BufferMutex);
-            std::unique_lock<std::mutex> lock2(g_JobMutex);
-            std::unique_lock<std::mutex> lock3(g_DelayedBufferMutex);
-
-            // swap buffer queue with main job queue
-            std::swap(g_JobBufferQueue, g_JobQueue);
-            pCounter->count.store(g_JobQueue.size() + g_IncludeMainThread);
-
-            while (!g_JobBufferQueue.empty())
+            if (TryRunOneJob())
+            {
+                g_HelpedJobs.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            if (g_Mode == SchedulerMode::SERIAL)
+            {
+                // the loop drains the serial queue in order, and nothing else runs jobs, so with it empty whatever this is waiting for can
+                // never happen - carrying on as if it had would make the run differ from every other, so stop here in every build
+                std::cerr << "Job system (serial) waiting on something no queued job will finish, the queue is empty" << std::endl;
+                std::abort();
+            }
+            g_ParkedWaiters.fetch_add(1);
+            uint32_t epoch = g_WaitEpoch.load();
+            if (!done() && NoQueuedJobs())
             {
-                g_JobQueue.push(g_JobBufferQueue.front());
-                g_JobBufferQueue.pop();
+                auto parkStart = std::chrono::steady_clock::now();
+                ParkOnEpoch(epoch);
+                g_ParkedNs.fetch_add(NanosecondsSince(parkStart), std::memory_order_relaxed);
             }
+            g_ParkedWaiters.fetch_sub(1);
+        }
+    }
 
-            if (!g_JobDelayedBufferQueue.empty())
+    // runs the jobs already posted to the main thread until they run out or budgetNs is spent (negative for no limit), the rest stay queued
+    int RunMainThreadJobs(long long budgetNs)
+    {
+        assert(ThreadIndex == 0);
+        auto start = std::chrono::steady_clock::now();
+        // only what's already queued, so a job which posts a follow up for itself can't keep this going forever
+        size_t available = 0;
+        {
+            std::lock_guard<std::mutex> lock(g_MainThreadMutex);
+            available = g_MainThreadJobs.size();
+        }
+        int run = 0;
+        while (static_cast<size_t>(run) < available)
+        {
+            Declaration decl;
+            {
+                std::lock_guard<std::mutex> lock(g_MainThreadMutex);
+                decl = g_MainThreadJobs.front();
+                g_MainThreadJobs.pop_front();
+            }
+            if (decl.m_pCounter != nullptr)
+            {
+                ExecuteJob(decl);
+            }
+            else
+            {
+#if USE_JOB_TRACE
+                long long traceBegin = JobTrace::Now();
+                decl.Invoke();
+                JobTrace::Record(traceBegin, JobTrace::Now(), decl.m_MemberFunction.func, decl.m_MemberFunction.instance, -1, static_cast<int>(decl.m_Priority));
+#else
+                decl.Invoke();
+#endif
+            }
+            ++run;
+            if (budgetNs >= 0 && NanosecondsSince(start) >= budgetNs)
             {
-                std::swap(g_JobBufferQueue, g_JobDelayedBufferQueue);
+                break;
             }
         }
-        g_Ready = true;
-        g_JobCV.notify_all();
+        return run;
+    }
+
+    // wait for job to terminate (for its Counter to become zero)
+    void WaitForCounter(Counter* pCounter)
+    {
+        HelpUntil([pCounter] { return pCounter->count.load() <= 0; });
+    }
+    void WaitForCounter(CounterHandle handle)
+    {
+        // a stale handle means the counter was freed, which only happens once whatever it was counting is done
+        HelpUntil([handle] { Counter* pCounter = ResolveCounter(handle); return pCounter == nullptr || pCounter->count.load() <= 0; });
+    }
+    void NextPhase(Counter* pCounter)
+    {
+        // everything which could add to the buffer for this phase has finished, rotate first so the other buffer (emptied last time) takes
+        // the next phase's jobs, then kick what was buffered - straight from the buffer's storage
+        // one extra count holds the phase open until the buffer has been handed out and reset, otherwise the phase could finish and rotate
+        // back round to this buffer while it's still being emptied
+        SubmissionBuffer<Declaration>& buffer = NextPhaseBuffer();
+        g_JobBufferRotation.fetch_add(1);
+        pCounter->count.store(buffer.Size() + g_IncludeMainThread + 1);
+        buffer.Consume([](int count, const Declaration aDecl[]) { KickJobs(count, aDecl); });
+        // the same as a job finishing, so if this takes the count to zero the waiters are still kicked and woken
+        ReleaseCount(pCounter, true);
+    }
+
+    CounterHandle KickBatch(int count, const Declaration aDecl[])
+    {
+        // scratch space reused per thread, only grows if a bigger batch than ever before is kicked from this thread
+        thread_local std::vector<Declaration> batch;
+        Counter* pCounter = AllocCounter();
+        CounterHandle handle = GetCounterHandle(pCounter);
+        pCounter->onComplete = { pCounter, &FreeCounterOnComplete };
+        pCounter->count.store(count);
+        if (count == 0)
+        {
+            FreeCounter(pCounter);
+            return handle;
+        }
+        batch.assign(aDecl, aDecl + count);
+        for (Declaration& decl : batch)
+        {
+            decl.m_pCounter = pCounter;
+        }
+        KickJobs(count, batch.data());
+        return handle;
     }
 
     // kick jobs and wait for completion
@@ -196,68 +915,345 @@ namespace JobSystem
         }
     }
 
+    // UPKEEP scheduler ----------------------------------------------------------------------------------------------------------------------
+
+    long long UpkeepDeadline(const UpkeepTask& task)
+    {
+        return task.Schedule.DeadlineNs > 0 ? task.LastRunNs + task.Schedule.DeadlineNs : LLONG_MAX;
+    }
+
+    // when a task can next run, it's ready once its cadence is up and there's budget left this frame, or regardless of both once it's past its
+    // deadline - LLONG_MAX if only a new frame can change that, call with g_UpkeepMutex held
+    long long UpkeepReadyAt(const UpkeepTask& task, bool budgetLeft)
+    {
+        if (task.Running)
+        {
+            return LLONG_MAX;
+        }
+        long long deadline = UpkeepDeadline(task);
+        if (!budgetLeft || g_UpkeepFrame - task.LastRunFrame < task.Schedule.EveryFrames)
+        {
+            return deadline;
+        }
+        return std::min(deadline, task.LastRunNs + task.Schedule.EveryNs);
+    }
+
+    void LowerUpkeepNextCheck(long long ns)
+    {
+        long long current = g_UpkeepNextCheckNs.load();
+        while (ns < current && !g_UpkeepNextCheckNs.compare_exchange_weak(current, ns)) {}
+    }
+
+    // claims the ready task with the earliest deadline, nullptr if nothing is ready
+    UpkeepTask* ClaimUpkeepTask()
+    {
+        std::lock_guard<std::mutex> lock(g_UpkeepMutex);
+        long long now = NanosecondsSince(g_UpkeepEpoch);
+        bool budgetLeft = g_UpkeepUsedNs.load() < g_UpkeepBudgetNs.load();
+        UpkeepTask* pBest = nullptr;
+        long long nextCheck = LLONG_MAX;
+        for (UpkeepTask& task : g_UpkeepTasks)
+        {
+            long long readyAt = UpkeepReadyAt(task, budgetLeft);
+            if (readyAt > now)
+            {
+                nextCheck = std::min(nextCheck, readyAt);
+                continue;
+            }
+            if (pBest == nullptr || UpkeepDeadline(task) < UpkeepDeadline(*pBest)
+                || (UpkeepDeadline(task) == UpkeepDeadline(*pBest) && task.LastRunNs < pBest->LastRunNs))
+            {
+                if (pBest != nullptr)
+                {
+                    // still ready, so the next thread to look shouldn't skip it
+                    nextCheck = now;
+                }
+                pBest = &task;
+            }
+            else
+            {
+                nextCheck = now;
+            }
+        }
+        if (pBest != nullptr)
+        {
+            pBest->Running = true;
+        }
+        g_UpkeepNextCheckNs.store(nextCheck);
+        return pBest;
+    }
+
+    // run a claimed task, charging its time to this frame's budget
+    void RunUpkeepTask(UpkeepTask& task)
+    {
+        // only the claiming thread writes these while it's running
+        long long start = NanosecondsSince(g_UpkeepEpoch);
+        bool late = start > UpkeepDeadline(task);
+#if USE_JOB_TRACE
+        long long traceBegin = JobTrace::IsEnabled() ? JobTrace::Now() : -1;
+#endif
+        task.Decl.Invoke();
+#if USE_JOB_TRACE
+        if (traceBegin >= 0)
+        {
+            JobTrace::Record(traceBegin, JobTrace::Now(), task.Decl.m_MemberFunction.func, task.Decl.m_MemberFunction.instance, -1, static_cast<int>(task.Decl.m_Priority));
+        }
+#endif
+        g_UpkeepUsedNs.fetch_add(NanosecondsSince(g_UpkeepEpoch) - start);
+        g_UpkeepRuns.fetch_add(1, std::memory_order_relaxed);
+        if (late)
+        {
+            g_UpkeepLateRuns.fetch_add(1, std::memory_order_relaxed);
+        }
+        std::lock_guard<std::mutex> lock(g_UpkeepMutex);
+        task.LastRunNs = start;
+        task.LastRunFrame = g_UpkeepFrame;
+        task.Running = false;
+        LowerUpkeepNextCheck(UpkeepReadyAt(task, g_UpkeepUsedNs.load() < g_UpkeepBudgetNs.load()));
+    }
+
+    // SERIAL mode - frame cadence only, every task which is due runs in the order they were added, so upkeep is the same every run
+    void RunSerialUpkeepFrame()
+    {
+        std::vector<UpkeepTask*> due;
+        {
+            std::lock_guard<std::mutex> lock(g_UpkeepMutex);
+            ++g_UpkeepFrame;
+            g_UpkeepUsedNs.store(0);
+            for (UpkeepTask& task : g_UpkeepTasks)
+            {
+                if (g_UpkeepFrame - task.LastRunFrame >= task.Schedule.EveryFrames)
+                {
+                    task.Running = true;
+                    due.push_back(&task);
+                }
+            }
+        }
+        for (UpkeepTask* pTask : due)
+        {
+            RunUpkeepTask(*pTask);
+        }
+    }
+
+    void BeginUpkeepFrame()
+    {
+        if (g_Mode == SchedulerMode::SERIAL)
+        {
+            RunSerialUpkeepFrame();
+            return;
+        }
+        // anything past its deadline didn't find an idle moment last frame, so it's queued as a normal low priority job rather than
+        // waiting for one any longer
+        // (a handful at most, there are only ever a few tasks)
+        UpkeepTask* overdue[8];
+        int overdueCount = 0;
+        {
+            std::lock_guard<std::mutex> lock(g_UpkeepMutex);
+            ++g_UpkeepFrame;
+            g_UpkeepUsedNs.store(0);
+            g_UpkeepNextCheckNs.store(0);
+            long long now = NanosecondsSince(g_UpkeepEpoch);
+            for (UpkeepTask& task : g_UpkeepTasks)
+            {
+                if (overdueCount < 8 && !task.Running && UpkeepDeadline(task) <= now)
+                {
+                    task.Running = true;
+                    overdue[overdueCount++] = &task;
+                }
+            }
+        }
+        for (int i = 0; i < overdueCount; ++i)
+        {
+            UpkeepTask* pTask = overdue[i];
+            Declaration decl = MakeJob([pTask] { RunUpkeepTask(*pTask); }, Priority::LOW, nullptr, &g_UpkeepTasks);
+            KickBatch(1, &decl);
+        }
+    }
+
+    // upkeep tasks are run by any worker which has nothing else to do after finishing a job, any newly queued job (of any priority) stops it at
+    // the next boundary - when nothing is ready this is a clock read and an atomic load, and the worker goes to sleep as normal
+    template<typename NoJobsPredicate>
+    void RunUpkeepJobs(NoJobsPredicate noJobs)
+    {
+        while (noJobs() && !g_Shutdown)
+        {
+            if (NanosecondsSince(g_UpkeepEpoch) < g_UpkeepNextCheckNs.load(std::memory_order_relaxed))
+            {
+                return;
+            }
+            UpkeepTask* pTask = ClaimUpkeepTask();
+            if (pTask == nullptr)
+            {
+                return;
+            }
+            RunUpkeepTask(*pTask);
+        }
+    }
+
+    // worker loop when work stealing, only touches g_JobMutex when there's something in the injection queues or when going to sleep
+    void WorkStealingWorkerLoop()
+    {
+        while (true)
+        {
+            Declaration declCopy;
+            if (TryTakeJob(declCopy))
+            {
+                ExecuteJob(declCopy);
+                RunUpkeepJobs(NoQueuedJobs);
+                continue;
+            }
+            if (g_PendingJobs.load() > 0)
+            {
+                // something is published but we lost the race for it (or it's mid-push), try again
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(g_JobMutex);
+            g_SleepingWorkers.fetch_add(1);
+            auto sleepStart = std::chrono::steady_clock::now();
+            g_JobCV.wait(lock, [] { return g_PendingJobs.load() > 0 || g_Shutdown; });
+            g_WorkerIdleNs.fetch_add(NanosecondsSince(sleepStart), std::memory_order_relaxed);
+            g_SleepingWorkers.fetch_sub(1);
+            if (g_Shutdown && g_PendingJobs.load() == 0)
+            {
+                break;
+            }
+        }
+    }
+
     // main loop for all but main thread, takes jobs from queue until empty then waits fo CV to begin again
-    void JobWorkerThread()
+    void JobWorkerThread(int workerIndex)
     {
-        ThreadIndex = Gamestate::instance->ObtainUniqueThreadLocalIndex();
+        // the main thread keeps 0
+        ThreadIndex = workerIndex + 1;
+        tl_WorkerIndex = workerIndex;
+        tl_StealSeed = 2654435761u * static_cast<unsigned int>(workerIndex + 1);
+        if (g_Mode == SchedulerMode::WORK_STEALING)
+        {
+            WorkStealingWorkerLoop();
+            return;
+        }
         while (true)
         {
             Declaration declCopy;
             {
                 std::unique_lock<std::mutex> lock(g_JobMutex);
-                g_JobCV.wait(lock, [] { return g_Ready || g_Shutdown; });
-                if (g_Shutdown && g_JobQueue.empty())
+                if (!g_Ready && !g_Shutdown)
+                {
+                    auto sleepStart = std::chrono::steady_clock::now();
+                    g_JobCV.wait(lock, [] { return g_Ready || g_Shutdown; });
+                    g_WorkerIdleNs.fetch_add(NanosecondsSince(sleepStart), std::memory_order_relaxed);
+                }
+                if (g_Shutdown && NoQueuedJobs())
                 {
                     // If shutdown is requested and the job queue is empty, exit the thread
                     break;
                 }
-                // Try to get the next job from the queue
+                // Try to get the next job from the queue, highest priority first
                 if (g_Ready)
                 {
-                    if (g_JobQueue.empty())
+                    if (!TakeFromGlobalQueuesLocked(declCopy))
                     {
                         g_Ready = false;
                         continue;
                     }
-                    declCopy = g_JobQueue.front();
-                    g_JobQueue.pop();
                 }
                 else
                 {
                     continue;
                 }
             }
-            // complete the job the decrement the counter
-            declCopy.m_MemberFunction.func(declCopy.m_MemberFunction.instance, declCopy.m_Param);
-            int counterVal = declCopy.m_pCounter->count.fetch_sub(1);
-            if (counterVal == 1)
-            {
-                NextPhase(declCopy.m_pCounter);
-            }
+            ExecuteJob(declCopy);
             // Check for low-priority jobs
-            if (ThreadIndex == NUM_THREADS)
-            {
-                while (g_JobQueue.empty() && !g_UpkeepJobs.empty() && !g_Shutdown)
-                {
-                    g_UpkeepMutex.lock();
-                    size_t index = g_UpkeepJobIndex.fetch_add(1) % g_UpkeepJobs.size();
-                    Declaration upkeepDecl = g_UpkeepJobs[index];
-                    g_UpkeepMutex.unlock();
-
-                    upkeepDecl.m_MemberFunction.func(upkeepDecl.m_MemberFunction.instance, upkeepDecl.m_Param);
-                    // no decrement counter since these are always active
-                    std::this_thread::yield();
-                }
-            }
+            RunUpkeepJobs(NoQueuedJobs);
+        }
+    }
+
+    int ChooseWorkerCount(int requested)
+    {
+        if (requested > 0)
+        {
+            return requested;
         }
+        // hardware_concurrency is allowed to return 0 if it can't tell
+        int hardwareThreads = static_cast<int>(std::thread::hardware_concurrency());
+        return hardwareThreads > 1 ? hardwareThreads - 1 : 1;
     }
 
-    void InitJobSystem(int numWorkerThreads)
+    int GetNumWorkers()
     {
+        return g_NumWorkers;
+    }
+
+    // best effort, if the OS refuses the worker just runs unpinned
+    void PinThreadToCore(std::thread& thread, int core)
+    {
+        int hardwareThreads = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+        core %= hardwareThreads;
+#ifdef _WIN32
+        if (core < static_cast<int>(sizeof(DWORD_PTR) * 8))
+        {
+            SetThreadAffinityMask(thread.native_handle(), static_cast<DWORD_PTR>(1) << core);
+        }
+#else
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(core, &cpuSet);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(cpuSet), &cpuSet);
+#endif
+    }
+
+    void InitJobSystem(int numWorkerThreads, SchedulerMode mode, bool pinWorkers)
+    {
+        g_Mode = mode;
+        if (g_Mode == SchedulerMode::SERIAL)
+        {
+            numWorkerThreads = 0;
+        }
+        // the main thread and every worker record into their own ring
+        JobTrace::Init(numWorkerThreads + 1);
+        JobTrace::SetName(&g_UpkeepTasks, "Overdue upkeep");
+        for (int i = 0; i < NUM_PRIORITIES; ++i)
+        {
+            g_QueueDepth[i].store(0);
+            g_PeakQueueDepth[i].store(0);
+            g_InjectedJobs[i].store(0);
+        }
+        // everything a previous run (shut down with nothing queued) could have left behind, so the job system can be started again
+        // with another mode or worker count, e.g. by the benchmarks
+        g_Shutdown = false;
+        g_Ready = false;
+        g_PendingJobs.store(0);
+        g_SleepingWorkers.store(0);
+        g_HelpedJobs.store(0);
+        g_ParkedNs.store(0);
+        g_WorkerIdleNs.store(0);
+        for (int i = 0; i < MAX_TIMED_PHASES; ++i)
+        {
+            g_PhaseBusyNs[i].store(0);
+        }
+        for (LatencyHistogram& jobTimes : g_JobTimes)
+        {
+            jobTimes.Summarise(true);
+        }
+        if (g_Mode == SchedulerMode::WORK_STEALING)
+        {
+            // deques must all exist before any worker starts stealing
+            g_WorkerQueues.reserve(numWorkerThreads);
+            for (int i = 0; i < numWorkerThreads; ++i)
+            {
+                g_WorkerQueues.push_back(std::make_unique<WorkerQueues>());
+            }
+        }
+        g_NumWorkers = numWorkerThreads;
         g_workerThreads.reserve(numWorkerThreads);
         for (int i = 0; i < numWorkerThreads; ++i)
         {
-            g_workerThreads.emplace_back(JobWorkerThread);
+            g_workerThreads.emplace_back(JobWorkerThread, i);
+            if (pinWorkers)
+            {
+                PinThreadToCore(g_workerThreads.back(), i + 1);
+            }
         }
     }
 
@@ -280,5 +1276,10 @@ namespace JobSystem
 
         // Clear the worker threads vector
         g_workerThreads.clear();
+        g_NumWorkers = 0;
+        g_MainThreadJobs.clear();
+        g_UpkeepTasks.clear();
+        g_SerialJobs.clear();
+        g_WorkerQueues.clear();
     }
-};
\ No newline at end of file
+};
@@ -1,35 +1,74 @@
 #pragma once
-#include "Top.h"
+#include "JobSystemConfig.h"
+#include "LatencyHistogram.h"
 #include <queue>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
 #include <functional>
-#include <queue>
-
-class Gamestate;
+#include <new>
+#include <type_traits>
 
 namespace JobSystem
 {
     /*
     * effective members - in .cpp
     * 
-    std::queue<Declaration> g_JobQueue;
-    std::queue<Declaration> g_JobBufferQueue;
-    std::queue<Declaration> g_JobDelayedBufferQueue;
-    std::vector<Declaration> g_UpkeepJobs;
+    std::queue<Declaration> g_JobQueues[NUM_PRIORITIES];
+    SubmissionBuffer<Declaration> g_JobBuffers[2];
+    std::atomic<unsigned int> g_JobBufferRotation;
+    std::deque<UpkeepTask> g_UpkeepTasks;
+    std::deque<Declaration> g_MainThreadJobs;
 
     std::mutex g_JobMutex;
-    std::mutex g_BufferMutex;
-    std::mutex g_DelayedBufferMutex;
+    std::mutex g_MainThreadMutex;
     std::mutex g_UpkeepMutex;
     std::condition_variable g_JobCV;
     bool g_Ready = false;
     std::atomic<bool> g_Shutdown{ false };
-    std::atomic<int> g_UpkeepJobIndex{ 0 };
+    long long g_UpkeepFrame;
+    std::atomic<long long> g_UpkeepBudgetNs;
+    std::atomic<long long> g_UpkeepUsedNs;
+    std::atomic<long long> g_UpkeepNextCheckNs;
+
+    std::atomic<int> g_QueueDepth[NUM_PRIORITIES];
+    std::atomic<int> g_PeakQueueDepth[NUM_PRIORITIES];
+
+    SchedulerMode g_Mode;
+    std::vector<std::unique_ptr<WorkerQueues>> g_WorkerQueues;
+    std::atomic<int> g_PendingJobs;
+    std::atomic<int> g_InjectedJobs[NUM_PRIORITIES];
+    std::atomic<int> g_SleepingWorkers;
+
+    std::atomic<uint32_t> g_WaitEpoch;
+    std::atomic<int> g_ParkedWaiters;
+    std::atomic<long long> g_HelpedJobs;
+    std::atomic<long long> g_ParkedNs;
+    std::atomic<long long> g_WorkerIdleNs;
+    std::atomic<long long> g_PhaseBusyNs[MAX_TIMED_PHASES];
+    LatencyHistogram g_JobTimes[MAX_TIMED_PHASES + 1];
+    std::deque<Declaration> g_SerialJobs;
+
+    Counter g_CounterPool[COUNTER_POOL_SIZE];
+    std::atomic<uint16_t> g_NextFreeCounter[COUNTER_POOL_SIZE];
+    std::atomic<uint32_t> g_FreeCounterHead;
+    std::atomic<int> g_CountersCreated;
+    std::atomic<int> g_CountersInUse;
+
+    std::vector<CounterWaiter> g_CounterWaiters;
+    std::mutex g_CounterWaiterMutex;
+    std::atomic<int> g_CounterWaiterCount;
 
     */
 
+    // how jobs are distributed to the worker threads, chosen once at startup so the two can be compared
+    // GLOBAL_QUEUE: every kick and every pop goes through g_JobMutex/g_JobQueue
+    // WORK_STEALING: each worker owns a Chase-Lev deque, jobs kicked from a worker go to its own deque, idle workers steal from
+    // the others, g_JobQueue is only used as an injection queue for non-worker threads (main thread) and deque overflow
+    // SERIAL: no workers, every job goes into one FIFO in the order it was kicked (priority is ignored) and is run by the main thread while it
+    // waits - the same frame in the same job order every time, for a single threaded reference and reproducing bugs without the threading
+    enum class SchedulerMode { GLOBAL_QUEUE, WORK_STEALING, SERIAL };
+
     // allow use of member functions of other classes as jobs
     struct MemberFunctionWrapper
     {
@@ -42,18 +81,44 @@ namespace JobSystem
         (static_cast<T*>(instance)->*MemberFunction)(param);
     }
 
-    // allowable priorities - not currently used much
+    // each priority has its own queue (own deque per worker when work stealing), higher priorities are taken first
+    // CRITICAL is always checked first so it preempts everything at the next job boundary, LOW and NORMAL are periodically
+    // looked at first so they can't be starved forever by a steady stream of HIGH jobs
     enum class Priority { LOW, NORMAL, HIGH, CRITICAL };
 
     // counter - decremented when job is finished, can be shared between multiple jobs
     struct Counter 
     {
         std::atomic<int> count;
+        // optional - called by whichever thread finishes the job which takes count to zero, in place of NextPhase (see FrameGraph)
+        MemberFunctionWrapper onComplete = { nullptr, nullptr };
+        uintptr_t onCompleteParam = 0;
+        // frame graph stage the jobs belong to, only used to label them in the trace
+        int16_t phase = -1;
+        // set by the counter pool, bumped every time the counter is freed so handles to an earlier use can tell
+        uint16_t poolIndex = 0xFFFF;
+        std::atomic<uint16_t> generation{ 0 };
+    };
+
+    // refers to one particular use of a pooled counter - once that counter is freed (e.g. its batch finished) the handle is stale, and waiting
+    // on a stale handle returns straight away, so it's safe to hold onto a handle for longer than the batch lives
+    struct CounterHandle
+    {
+        uint16_t index = 0xFFFF;
+        uint16_t generation = 0;
     };
 
-    // currently only use a couple of counters in total, but in theory this could use some custom allocator instead of using 'new'
+    // counters come from a fixed pool (no heap allocation in the frame), running out logs and aborts
     Counter* AllocCounter();
     void FreeCounter(Counter* pCounter);
+    CounterHandle GetCounterHandle(const Counter* pCounter);
+    // nullptr if the handle is stale
+    Counter* ResolveCounter(CounterHandle handle);
+    // number of pooled counters currently allocated
+    int GetCountersInUse();
+
+    // room for a job's captures, see MakeJob - enough for a handful of pointers/indices, anything bigger should capture a pointer to it
+    static const int JOB_CAPTURE_SIZE = 48;
 
     // simple job declaration - contains all info necessary to execute a job
     struct Declaration 
@@ -67,7 +132,49 @@ namespace JobSystem
         Priority m_Priority;
         // pointer to counter which is decremented on job completion, used for synchronisation
         Counter* m_pCounter;
+        // set by MakeJob - the function is called with m_Capture (the callable itself) instead of the instance, which is then only a name
+        // for the trace
+        bool m_Inline;
+        alignas(8) unsigned char m_Capture[JOB_CAPTURE_SIZE];
+
+        void Invoke() const
+        {
+            // the callable is only ever invoked through its const call operator, the cast just fits it to the wrapper's signature
+            m_MemberFunction.func(m_Inline ? const_cast<unsigned char*>(m_Capture) : m_MemberFunction.instance, m_Param);
+        }
     };
+    // declarations are copied about as raw bytes (deques, submission buffers), so must stay that way
+    static_assert(std::is_trivially_copyable<Declaration>::value, "Declaration must be trivially copyable");
+
+    template< typename Callable >
+    void InvokeCapture(void* capture, uintptr_t)
+    {
+        (*static_cast<const Callable*>(capture))();
+    }
+
+    // a job from any callable taking no arguments (normally a lambda), stored inside the declaration so there's no allocation and no
+    // side table for the job's data - e.g. MakeJob([this, pObj] { Process(*pObj); }, Priority::NORMAL, pCounter)
+    // captures are copied as raw bytes and never destroyed, so capture pointers and values rather than owning types like shared_ptr
+    // traceKey is an optional name for the job in the trace (see JobTrace::SetName)
+    template< typename F >
+    Declaration MakeJob(F&& function, Priority priority = Priority::NORMAL, Counter* pCounter = nullptr, const void* traceKey = nullptr)
+    {
+        typedef typename std::decay<F>::type Callable;
+        static_assert(sizeof(Callable) <= JOB_CAPTURE_SIZE, "job captures too much, capture a pointer to the data instead");
+        static_assert(alignof(Callable) <= 8, "job capture is over-aligned");
+        static_assert(std::is_trivially_copyable<Callable>::value && std::is_trivially_destructible<Callable>::value,
+            "job captures must be trivially copyable, capture raw pointers rather than owning types");
+        Declaration decl{ { const_cast<void*>(traceKey), &InvokeCapture<Callable> }, 0, priority, pCounter, true, {} };
+        ::new (static_cast<void*>(decl.m_Capture)) Callable(std::forward<F>(function));
+        return decl;
+    }
+
+    // a job calling instance->MemberFunction(param) - the trace names it by the dispatcher, see JobTrace::SetName
+    template< typename T, void (T::* MemberFunction)(uintptr_t) >
+    Declaration MakeMemberJob(T* instance, Priority priority = Priority::NORMAL, Counter* pCounter = nullptr, uintptr_t param = 0)
+    {
+        return Declaration{ { instance, &MemberFunctionDispatcher<T, MemberFunction> }, param, priority, pCounter, false, {} };
+    }
 
     // used to sync with main thread
     bool IsBufferEmpty();
@@ -78,30 +185,109 @@ namespace JobSystem
     void KickJob(const Declaration& decl);
     void KickJobs(int count, const Declaration aDecl[]);
 
-    // buffer queue stores the jobs to be executed in the next phase
+    // buffer stores the jobs to be executed in the next phase, lock-free so these are fine to call from inside jobs
     void AddJobToBuffer(const Declaration& decl);
     void AddJobsToBuffer(int count, const Declaration aDecl[]);
     void AddJobsToBuffer(const std::vector<Declaration>& vDecl);
-    // temporary solution to allow object removal job to be created during the update phase and be executed during cleanup (update->collision->cleanup)
-    void AddJobToDelayedBuffer(const Declaration& decl);
-    // always active jobs
-    void AddJobToUpkeep(const Declaration& decl);
 
-    // wait until a counter is 0 and all jobs using that counter have completed
+    // upkeep - background maintenance (e.g. topping up object pools) run by whichever worker goes idle, within a time budget per frame
+    // a task is ready once at least EveryFrames frames and EveryNs have passed since it last ran, and ready tasks run earliest deadline first
+    // while the frame's budget lasts - a task which gets to DeadlineNs since it last ran (0 for no deadline) runs regardless of the budget, and
+    // if no worker went idle in time it's queued as a LOW priority job at the start of the next frame
+    struct UpkeepSchedule
+    {
+        int EveryFrames = 1;
+        long long EveryNs = 0;
+        long long DeadlineNs = 100000000;
+    };
+    // the declaration's priority and counter are ignored, call during setup
+    void AddJobToUpkeep(const Declaration& decl, const UpkeepSchedule& schedule = UpkeepSchedule());
+    // total time all threads together may spend on upkeep each frame (overdue tasks aside)
+    void SetUpkeepBudget(long long budgetNs);
+    // main thread, once per frame - starts the next frame's budget and kicks anything overdue
+    void BeginUpkeepFrame();
+    struct UpkeepStats
+    {
+        // task runs since startup, and how many of those were past their deadline
+        long long Runs;
+        long long LateRuns;
+        // budget used so far this frame
+        long long UsedNsThisFrame;
+    };
+    UpkeepStats GetUpkeepStats();
+
+    // main thread queue - for work which has to happen on the main (render) thread, e.g. shader uniforms, texture uploads, text
+    // any thread can post, only the main thread runs them, at the points it calls RunMainThreadJobs (see Gamestate::CreateFrameGraph)
+    // jobs run in the order posted, the counter (if any) is decremented as usual
+    void PostToMainThread(const Declaration& decl);
+    // main thread only - runs jobs which were posted before the call until the queue is empty or budgetNs is used up (always at least one,
+    // negative for no budget), anything left waits for the next call - so big work like streaming a texture can be split into jobs (or a
+    // job which posts its own continuation) and spread over frames, returns the number of jobs run
+    int RunMainThreadJobs(long long budgetNs = -1);
+    int GetMainThreadQueueDepth();
+
+    // wait until a counter is 0 and all jobs using that counter have completed, runs other queued jobs in the meantime and parks the
+    // thread when there's nothing it can run
     void WaitForCounter(Counter* pCounter);
-    // used for phase transition, waits for current phase to be done, then swaps buffer and main job queues, and signals (also moves delayed buffer->buffer)
-    void WaitForCounterAndSwapBuffers(Counter* pCounter, bool waitForMainThread = false);
+    void WaitForCounter(CounterHandle handle);
+    // same as above for any condition, the condition must only become true as a result of a job finishing (that's what wakes a parked waiter)
+    // in SERIAL mode the queue is run in order until the condition is met, running out of jobs first logs and aborts
+    void HelpUntil(const std::function<bool()>& done);
+    // take a single queued job and run it on the calling thread, returns false if there was nothing to take
+    bool TryRunOneJob();
+
+    // counter of the job the calling thread is running right now (the innermost one if it's helping while waiting), nullptr outside of a job
+    Counter* GetCurrentJobCounter();
+    // true when nothing is queued, so any thread which finishes what it's doing would go idle - used by ParallelFor to decide when to split
+    bool HasIdleCapacity();
+
+    // continuation without blocking - decl is kicked (with a pooled counter of its own, see KickBatch) once the counter reaches zero, or for a
+    // pooled counter once it's freed, returns false without kicking anything if that's already happened (what coroutines await, see JobCoroutine.h)
+    bool KickWhenDone(Counter* pCounter, const Declaration& decl);
+    bool KickWhenDone(CounterHandle handle, const Declaration& decl);
+
+    // kick a batch of jobs with a pooled counter of its own, which frees itself once the batch is done - wait on the returned handle for just
+    // this batch (the counter in each declaration is replaced)
+    CounterHandle KickBatch(int count, const Declaration aDecl[]);
 
     // add job(s) to job queue and wait for it/them to finish 
     void KickJobAndWait(const Declaration& decl);
     void KickJobsAndWait(int count, const Declaration aDecl[]);
 
     // loop function for all threads, stay in this function until shutdown, locks, checks queue for job and executes if there, otherwise waits for cv signal
-    void JobWorkerThread();
-    // start
-    void InitJobSystem(int numWorkerThreads);
+    // (when work stealing, pops its own deque then steals, only locking to sleep)
+    void JobWorkerThread(int workerIndex);
+    // number of workers to start for a requested count, anything <= 0 means one per hardware thread besides the main thread's
+    int ChooseWorkerCount(int requested);
+    // start, with pinWorkers each worker is restricted to a single core (worker i on core i + 1, leaving core 0 to the main thread)
+    // SERIAL mode starts no workers whatever the count
+    void InitJobSystem(int numWorkerThreads, SchedulerMode mode = SchedulerMode::WORK_STEALING, bool pinWorkers = false);
+    SchedulerMode GetSchedulerMode();
+    // workers started by InitJobSystem, ThreadIndex runs from 0 (main thread) to this, so per-thread arrays need GetNumWorkers() + 1 slots
+    int GetNumWorkers();
+    // number of jobs currently queued at a priority level, and the most that have been queued at once since startup
+    int GetQueueDepth(Priority priority);
+    int GetPeakQueueDepth(Priority priority);
+
+    // where the time goes while threads wait, used to report CPU utilisation
+    struct WaitStats
+    {
+        // jobs run by a thread while it was waiting in WaitForCounter/HelpUntil
+        long long HelpedJobs;
+        // total time waiting threads spent parked with nothing to run
+        long long ParkedNs;
+        // total time worker threads spent asleep with nothing to run (summed over all workers)
+        long long WorkerIdleNs;
+    };
+    WaitStats GetWaitStats();
+    // time spent running jobs whose counter is labelled with this phase (frame graph stage), summed over all threads since startup
+    static const int MAX_TIMED_PHASES = 32;
+    long long GetPhaseBusyNs(int phase);
+    // distribution of how long single jobs of a phase took (any phase outside 0 to MAX_TIMED_PHASES - 1 gives every job which wasn't part of
+    // one), recorded for every job, reset clears it so the next summary starts from now
+    LatencyHistogram::Summary SummariseJobTimes(int phase, bool reset);
 
-    // stop
+    // stop, waits for anything still queued - the job system can then be started again with InitJobSystem
     void ShutdownJobSystem();
     void NextPhase(Counter* pCounter);
     void SetIncludeMainThread(bool inc);
@@ -0,0 +1,18 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// everything the job system (JobSystem, FrameGraph, ParallelFor, JobTrace, JobCoroutine) needs from outside itself, kept apart from Top.h so
+// the job system builds on its own without SFML or the game, e.g. for the benchmarks in Benchmarks/
+
+// record every job into per-thread ring buffers for a Chrome trace (F9 or exit writes it), see JobTrace.h
+#ifndef USE_JOB_TRACE
+#define USE_JOB_TRACE true
+#endif
+
+// each thread has a unique index, used for certain wait-free functionality - main thread is 0, workers are 1 to JobSystem::GetNumWorkers()
+// (set by the job system when it starts each worker)
+extern thread_local int ThreadIndex;
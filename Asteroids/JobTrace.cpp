@@ -0,0 +1,189 @@
+#include "JobTrace.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+namespace JobTrace
+{
+    // enough for a few seconds of frames on every thread, power of two so the index wraps with a mask
+    static const uint32_t RING_CAPACITY = 1 << 15;
+
+    // single writer (the owning thread), the writer fills the slot then publishes it by bumping Head, a reader copies and then checks Head
+    // again to throw away anything which was overwritten while it was copying
+    struct Ring
+    {
+        alignas(64) std::atomic<uint32_t> Head{ 0 };
+        Event Events[RING_CAPACITY];
+    };
+
+    std::vector<std::unique_ptr<Ring>> g_Rings;
+    std::atomic<bool> g_Enabled{ true };
+    // the tick rate is worked out when the trace is written, from how far the ticks and the steady clock have moved since Init
+    std::chrono::steady_clock::time_point g_ClockStart = std::chrono::steady_clock::now();
+    long long g_TickStart = Now();
+    std::unordered_map<const void*, std::string> g_Names;
+    std::vector<std::string> g_PhaseNames;
+
+    void Init(int threadCount)
+    {
+        g_ClockStart = std::chrono::steady_clock::now();
+        g_TickStart = Now();
+        g_Rings.clear();
+        for (int i = 0; i < threadCount; ++i)
+        {
+            g_Rings.push_back(std::make_unique<Ring>());
+        }
+    }
+
+    void SetEnabled(bool enabled)
+    {
+        g_Enabled.store(enabled, std::memory_order_relaxed);
+    }
+    bool IsEnabled()
+    {
+        return g_Enabled.load(std::memory_order_relaxed);
+    }
+
+    long long Now()
+    {
+#if defined(_MSC_VER) || defined(__i386__) || defined(__x86_64__)
+        return static_cast<long long>(__rdtsc());
+#else
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    void Record(long long begin, long long end, void (*function)(void*, uintptr_t), const void* instance, int phase, int priority)
+    {
+        if (!IsEnabled() || ThreadIndex < 0 || ThreadIndex >= static_cast<int>(g_Rings.size()))
+        {
+            return;
+        }
+        Ring& ring = *g_Rings[ThreadIndex];
+        uint32_t head = ring.Head.load(std::memory_order_relaxed);
+        ring.Events[head & (RING_CAPACITY - 1)] = { begin, end, function, instance, nullptr, static_cast<int16_t>(phase), static_cast<uint8_t>(priority) };
+        ring.Head.store(head + 1, std::memory_order_release);
+    }
+    void Record(long long begin, long long end, const char* label, int phase)
+    {
+        if (!IsEnabled() || ThreadIndex < 0 || ThreadIndex >= static_cast<int>(g_Rings.size()))
+        {
+            return;
+        }
+        Ring& ring = *g_Rings[ThreadIndex];
+        uint32_t head = ring.Head.load(std::memory_order_relaxed);
+        ring.Events[head & (RING_CAPACITY - 1)] = { begin, end, nullptr, nullptr, label, static_cast<int16_t>(phase), static_cast<uint8_t>(NO_PRIORITY) };
+        ring.Head.store(head + 1, std::memory_order_release);
+    }
+
+    void SetName(const void* key, const char* name)
+    {
+        g_Names[key] = name;
+    }
+    void SetName(void (*function)(void*, uintptr_t), const char* name)
+    {
+        g_Names[reinterpret_cast<const void*>(function)] = name;
+    }
+    void SetPhaseName(int phase, const std::string& name)
+    {
+        if (phase >= static_cast<int>(g_PhaseNames.size()))
+        {
+            g_PhaseNames.resize(phase + 1);
+        }
+        g_PhaseNames[phase] = name;
+    }
+
+    // TRACE output helpers -------------------------------------------------------------------------------------------------------------------
+
+    std::string EventName(const Event& event)
+    {
+        if (event.label != nullptr)
+        {
+            return event.label;
+        }
+        auto found = g_Names.find(event.instance);
+        if (found == g_Names.end())
+        {
+            found = g_Names.find(reinterpret_cast<const void*>(event.function));
+        }
+        if (found != g_Names.end())
+        {
+            return found->second;
+        }
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "job %p", reinterpret_cast<const void*>(event.function));
+        return buffer;
+    }
+
+    const char* PriorityName(int priority)
+    {
+        static const char* names[] = { "LOW", "NORMAL", "HIGH", "CRITICAL" };
+        return priority < 4 ? names[priority] : "none";
+    }
+
+    // copy out whatever is still intact in one thread's ring, oldest first
+    void CopyRing(Ring& ring, std::vector<Event>& out)
+    {
+        uint32_t head = ring.Head.load(std::memory_order_acquire);
+        uint32_t first = head > RING_CAPACITY ? head - RING_CAPACITY : 0;
+        size_t start = out.size();
+        for (uint32_t i = first; i != head; ++i)
+        {
+            out.push_back(ring.Events[i & (RING_CAPACITY - 1)]);
+        }
+        uint32_t headAfter = ring.Head.load(std::memory_order_acquire);
+        // the writer fills slot headAfter before publishing it, so the entry RING_CAPACITY back from there may be half written too
+        uint32_t overwritten = headAfter + 1 - first > RING_CAPACITY ? headAfter + 1 - first - RING_CAPACITY : 0;
+        if (overwritten > 0)
+        {
+            out.erase(out.begin() + start, out.begin() + start + std::min<size_t>(overwritten, out.size() - start));
+        }
+    }
+
+    bool WriteChromeTrace(const std::string& path)
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+        long long clockNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_ClockStart).count();
+        double usPerTick = clockNs / 1000.0 / std::max(Now() - g_TickStart, 1LL);
+
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+        std::vector<Event> events;
+        for (size_t thread = 0; thread < g_Rings.size(); ++thread)
+        {
+            file << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << thread
+                << ",\"args\":{\"name\":\"" << (thread == 0 ? std::string("main") : "worker " + std::to_string(thread)) << "\"}}";
+            first = false;
+
+            events.clear();
+            CopyRing(*g_Rings[thread], events);
+            for (const Event& event : events)
+            {
+                // chrome wants microseconds, keep the fraction so short jobs don't all collapse to zero
+                file << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << thread << ",\"name\":\"" << EventName(event) << "\",\"cat\":\"job\""
+                    << ",\"ts\":" << (event.begin - g_TickStart) * usPerTick << ",\"dur\":" << (event.end - event.begin) * usPerTick
+                    << ",\"args\":{\"priority\":\"" << PriorityName(event.priority) << "\",\"phase\":" << event.phase;
+                if (event.phase >= 0 && event.phase < static_cast<int>(g_PhaseNames.size()))
+                {
+                    file << ",\"phaseName\":\"" << g_PhaseNames[event.phase] << "\"";
+                }
+                file << "}}";
+            }
+        }
+        file << "\n]}\n";
+        return static_cast<bool>(file);
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "JobSystemConfig.h"
+#include <atomic>
+#include <cstdint>
+
+// per-job trace capture, each thread records begin/end of every job it runs (and anything else timed with Record, e.g. the main thread
+// waiting on a stage) into its own ring buffer, dumped on demand as a Chrome trace (open in chrome://tracing or ui.perfetto.dev)
+// recording is a raw cycle counter read, a few stores and one relaxed atomic store into memory only that thread writes, so it's cheap enough to leave on,
+// the ring keeps the most recent events and old ones are simply overwritten
+namespace JobTrace
+{
+    // what's known about one event, function and instance identify a job (see SetName), anything else has a label instead
+    // phase is the frame graph stage index (-1 if none), priority is a JobSystem::Priority (NO_PRIORITY if not a job)
+    struct Event
+    {
+        long long begin;
+        long long end;
+        void (*function)(void*, uintptr_t);
+        const void* instance;
+        const char* label;
+        int16_t phase;
+        uint8_t priority;
+    };
+    static const int NO_PRIORITY = 0xFF;
+
+    // call before any thread records, threadCount is every thread which can record (main thread plus workers)
+    void Init(int threadCount);
+    void SetEnabled(bool enabled);
+    bool IsEnabled();
+
+    // ticks on the trace clock (the cpu's timestamp counter where there is one), only converted to time when the trace is written
+    long long Now();
+    // record a completed event for the calling thread (uses ThreadIndex)
+    void Record(long long begin, long long end, void (*function)(void*, uintptr_t), const void* instance, int phase, int priority);
+    // same for something which isn't a job, label must outlive the trace (i.e. a literal)
+    void Record(long long begin, long long end, const char* label, int phase = -1);
+
+    // readable names for the trace, key is either a job's instance or its function (instance is looked up first, so e.g. each ParallelFor
+    // loop can have its own name even though they all share one function), not thread-safe - call during setup
+    void SetName(const void* key, const char* name);
+    void SetName(void (*function)(void*, uintptr_t), const char* name);
+    void SetPhaseName(int phase, const std::string& name);
+
+    // writes everything still in the rings, safe to call while jobs are running (events being overwritten at that moment are skipped)
+    bool WriteChromeTrace(const std::string& path);
+}
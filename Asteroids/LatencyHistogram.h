@@ -0,0 +1,107 @@
+#pragma once
+#include <atomic>
+#include <bit>
+#include <cstdint>
+
+// HDR-style latency histogram - buckets are log-linear, 16 per power of two so a value is never more than about 6% from its bucket's bound,
+// covering 1ns to over four minutes in 560 counters with no allocation
+// recording is one relaxed atomic add (and a compare-exchange only when there's a new max), so it's cheap enough to leave on and any thread can
+// record while another summarises - a value recorded during a summary just lands in that one or the next
+class LatencyHistogram
+{
+public:
+    static const int SUB_BUCKET_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    // largest shift a value can need, anything bigger is clamped into the top bucket
+    static const int MAX_SHIFT = 33;
+    static const int NUM_BUCKETS = SUB_BUCKETS + (MAX_SHIFT + 1) * SUB_BUCKETS;
+
+    struct Summary
+    {
+        long long Count;
+        // percentiles are the upper bound of the bucket they fall in (never more than the max), so they err on the slow side
+        long long P50Ns;
+        long long P99Ns;
+        long long MaxNs;
+    };
+
+    void Record(long long ns)
+    {
+        if (ns < 0)
+        {
+            ns = 0;
+        }
+        m_Buckets[BucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+        long long max = m_MaxNs.load(std::memory_order_relaxed);
+        while (ns > max && !m_MaxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    // everything recorded since the last reset, resetting makes the next summary cover just the time from now (e.g. one report period)
+    Summary Summarise(bool reset)
+    {
+        // copied out first so the percentiles are taken from one set of counts
+        uint32_t counts[NUM_BUCKETS];
+        long long total = 0;
+        for (int i = 0; i < NUM_BUCKETS; ++i)
+        {
+            counts[i] = reset ? m_Buckets[i].exchange(0, std::memory_order_relaxed) : m_Buckets[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        long long max = reset ? m_MaxNs.exchange(0, std::memory_order_relaxed) : m_MaxNs.load(std::memory_order_relaxed);
+        Summary summary = { total, 0, 0, max };
+        if (total == 0)
+        {
+            return summary;
+        }
+        long long p50Rank = (total + 1) / 2;
+        long long p99Rank = total - total / 100;
+        long long seen = 0;
+        for (int i = 0; i < NUM_BUCKETS && seen < p99Rank; ++i)
+        {
+            long long before = seen;
+            seen += counts[i];
+            if (before < p50Rank && seen >= p50Rank)
+            {
+                summary.P50Ns = UpperBoundOf(i) < max ? UpperBoundOf(i) : max;
+            }
+            if (seen >= p99Rank)
+            {
+                summary.P99Ns = UpperBoundOf(i) < max ? UpperBoundOf(i) : max;
+            }
+        }
+        return summary;
+    }
+
+private:
+    std::atomic<uint32_t> m_Buckets[NUM_BUCKETS] = {};
+    std::atomic<long long> m_MaxNs{ 0 };
+
+    // below SUB_BUCKETS every value has its own bucket, above that the top SUB_BUCKET_BITS + 1 bits pick the bucket within the value's power of two
+    static int BucketOf(long long ns)
+    {
+        uint64_t value = static_cast<uint64_t>(ns);
+        if (value < SUB_BUCKETS)
+        {
+            return static_cast<int>(value);
+        }
+        int shift = std::bit_width(value) - (SUB_BUCKET_BITS + 1);
+        if (shift > MAX_SHIFT)
+        {
+            return NUM_BUCKETS - 1;
+        }
+        int top = static_cast<int>(value >> shift);
+        return SUB_BUCKETS + shift * SUB_BUCKETS + (top - SUB_BUCKETS);
+    }
+    static long long UpperBoundOf(int bucket)
+    {
+        if (bucket < SUB_BUCKETS)
+        {
+            return bucket;
+        }
+        int shift = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+        long long top = SUB_BUCKETS + (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+        return ((top + 1) << shift) - 1;
+    }
+};
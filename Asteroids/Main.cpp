@@ -1,9 +1,84 @@
 #include "Gamestate.h"
+#include "CpuFeatures.h"
+#include <cstring>
 
-int main()
+// options: --threads N (worker threads, 0 for one per spare hardware thread), --pin / --no-pin (pin workers to cores),
+// --serial (everything on the main thread in a fixed order, see Gamestate::BeginPlay), --pipelined / --no-pipelined (draw the previous
+// frame while simulating the next), --sim-rate N (fixed simulation steps per second, 0 for one per rendered frame), --seed N (master seed
+// for the random streams, 0 for a new one each run), --particles N (particles in the ship's exhaust), --no-avx2 (scalar kernels even if the
+// cpu has AVX2), --report FILE (periodic frame reports go to FILE instead of stdout)
+int main(int argc, char* argv[])
 {
+    int numWorkers = DEFAULT_NUM_THREADS;
+    bool pinWorkers = PIN_WORKER_THREADS;
+    bool serial = false;
+    bool pipelined = PIPELINE_FRAMES;
+    int simulationRate = SIMULATION_RATE;
+    uint64_t seed = RANDOM_SEED;
+    int particleCount = PARTICLE_COUNT;
+    const char* reportPath = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            numWorkers = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--pin") == 0)
+        {
+            pinWorkers = true;
+        }
+        else if (std::strcmp(argv[i], "--no-pin") == 0)
+        {
+            pinWorkers = false;
+        }
+        else if (std::strcmp(argv[i], "--serial") == 0)
+        {
+            serial = true;
+        }
+        else if (std::strcmp(argv[i], "--report") == 0 && i + 1 < argc)
+        {
+            reportPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--pipelined") == 0)
+        {
+            pipelined = true;
+        }
+        else if (std::strcmp(argv[i], "--no-pipelined") == 0)
+        {
+            pipelined = false;
+        }
+        else if (std::strcmp(argv[i], "--sim-rate") == 0 && i + 1 < argc)
+        {
+            simulationRate = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--no-avx2") == 0)
+        {
+            CpuFeatures::DisableAvx2();
+        }
+        else if (std::strcmp(argv[i], "--particles") == 0 && i + 1 < argc)
+        {
+            particleCount = std::atoi(argv[++i]);
+        }
+        else
+        {
+            std::cout << "Unknown option " << argv[i] << ", options are --threads N, --pin, --no-pin, --serial, --pipelined, --no-pipelined, --sim-rate N, --seed N, --particles N, --no-avx2 and --report FILE" << std::endl;
+        }
+    }
+
     Gamestate game;
-    game.BeginPlay();
+    if (particleCount != PARTICLE_COUNT)
+    {
+        game.SetParticleCount(particleCount);
+    }
+    if (reportPath != nullptr)
+    {
+        game.SetReportFile(reportPath);
+    }
+    game.BeginPlay(numWorkers, pinWorkers, serial, pipelined, simulationRate, seed);
 
     return 0;
-}
\ No newline at end of file
+}
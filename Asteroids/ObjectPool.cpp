@@ -5,66 +5,104 @@
 #include "Asteroid.h"
 #include "Projectile.h"
 #include "Components.h"
+#include <algorithm>
+#include <cmath>
 
-ObjectPool::ObjectPool(const std::shared_ptr<GameObject>& prefab, int countIncreasePerExpansion, int initialAllocationCount, float lowerBoundPC, float upperBoundPC) :
-    m_Prefab(prefab), m_CountIncreasePerExpansion(countIncreasePerExpansion), m_PoolSizeLowerBoundPC(lowerBoundPC), m_PoolSizeUpperBoundPC(upperBoundPC)
+ObjectPool::ObjectPool(ObjectRegistry& registry, std::unique_ptr<GameObject> prefab, int countIncreasePerExpansion, int initialAllocationCount, float lowerBoundPC, float upperBoundPC) :
+    m_Registry(registry), m_Prefab(std::move(prefab)), m_CountIncreasePerExpansion(countIncreasePerExpansion), m_PoolSizeLowerBoundPC(lowerBoundPC), m_PoolSizeUpperBoundPC(upperBoundPC)
 {
     m_Prefab->SetInactive();
     m_Prefab->GetComponent<PooledObjectComponent>()->SetPool(this);
     FillPool(initialAllocationCount);
 }
 
-std::shared_ptr<GameObject> ObjectPool::GetPooledObject()
+GameObject* ObjectPool::PopHead()
 {
-    auto oldHead = std::atomic_load(&m_Head);
+    uint64_t oldHead = m_Head.load(std::memory_order_acquire);
+    uint64_t newHead;
     do
     {
-        // pool is empty - refill pool, then make new object to immediately return
-        if (!oldHead)
+        uint32_t index = static_cast<uint32_t>(oldHead);
+        if (index == ObjectRegistry::NONE)
         {
-            FillPool(m_CountIncreasePerExpansion);
-            auto newObj = m_Prefab->CloneToSharedPtr();
-            m_TotalObjectCount.fetch_add(1);
-            newObj->SetActive();
-            return newObj;
+            return nullptr;
         }
-    } while (!std::atomic_compare_exchange_weak(&m_Head, &oldHead, oldHead->Next));
-
-    // successful atomic exchange, take object from old head
-    std::shared_ptr<GameObject> obj = oldHead->Object;
+        // the link may already be out of date if another thread has popped this object, but then the tag has moved on and the exchange fails
+        newHead = MakeHead(oldHead, m_Registry.PoolLink(index).load(std::memory_order_relaxed));
+    } while (!m_Head.compare_exchange_weak(oldHead, newHead, std::memory_order_acquire, std::memory_order_acquire));
     m_CurrentPoolSize.fetch_sub(1);
+    return m_Registry.GetAt(static_cast<uint32_t>(oldHead));
+}
+
+GameObject* ObjectPool::GetPooledObject()
+{
+    GameObject* obj = PopHead();
+    // pool is empty - make a new object to return immediately, and refill the pool off this thread's back
+    if (obj == nullptr)
+    {
+        if (!m_RefillPending.exchange(true))
+        {
+            RefillInBackground(m_CountIncreasePerExpansion);
+        }
+        obj = CloneFromPrefab();
+        m_TotalObjectCount.fetch_add(1);
+        obj->SetActive();
+        return obj;
+    }
+    m_TakenSinceMaintenance.fetch_add(1, std::memory_order_relaxed);
     obj->SetActive();
-    return oldHead->Object;
+    return obj;
+}
+
+GameObject* ObjectPool::CloneFromPrefab()
+{
+    return m_Registry.Get(m_Registry.Register(m_Prefab->CloneToUniquePtr()));
+}
+
+JobSystem::Coroutine ObjectPool::RefillInBackground(int count)
+{
+    // the caller is in the middle of spawning something, the cloning happens later as a low priority job
+    co_await JobSystem::Reschedule(JobSystem::Priority::LOW);
+    FillPool(count);
+    m_RefillPending.store(false);
 }
 
 void ObjectPool::FillPool(int count)
 {
     for (int i = 0; i < count; ++i)
     {
-        auto newObj = m_Prefab->CloneToSharedPtr();
-        AddToPool(newObj);
+        AddToPool(CloneFromPrefab());
     }
     m_TotalObjectCount.fetch_add(count);
 }
 
-void ObjectPool::AddToPool(std::shared_ptr<GameObject>& obj)
+void ObjectPool::AddToPool(GameObject* obj)
 {
     obj->SetInactive();
-    auto oldHead = std::atomic_load(&m_Head);
-    auto newNode = std::make_shared<Node>(obj, oldHead);
-
-    while (!std::atomic_compare_exchange_weak(&m_Head, &newNode->Next, newNode)) {}
+    uint32_t index = obj->GetHandle().Index;
+    uint64_t oldHead = m_Head.load(std::memory_order_relaxed);
+    do
+    {
+        m_Registry.PoolLink(index).store(static_cast<uint32_t>(oldHead), std::memory_order_relaxed);
+    } while (!m_Head.compare_exchange_weak(oldHead, MakeHead(oldHead, index), std::memory_order_release, std::memory_order_relaxed));
     m_CurrentPoolSize.fetch_add(1);
 }
 
 void ObjectPool::MaintainPoolBuffer()
 {
-    float percentage = static_cast<float>(m_CurrentPoolSize) / static_cast<float>(m_TotalObjectCount);
-    if (percentage < m_PoolSizeLowerBoundPC || m_CurrentPoolSize < m_MinBufferSize)
+    // keep enough spare for the biggest recent burst (with headroom), as well as the lower bound
+    int taken = m_TakenSinceMaintenance.exchange(0, std::memory_order_relaxed);
+    m_RecentDemand = std::max(static_cast<float>(taken), m_RecentDemand * DEMAND_DECAY);
+    int poolSize = m_CurrentPoolSize.load();
+    int totalCount = m_TotalObjectCount.load();
+    int target = std::max({ m_MinBufferSize, static_cast<int>(std::ceil(totalCount * m_PoolSizeLowerBoundPC)),
+        static_cast<int>(std::ceil(m_RecentDemand * DEMAND_HEADROOM)) });
+    if (poolSize < target)
     {
-        FillPool(1);
+        // capped so one run can't blow the upkeep budget, the rest comes next run
+        FillPool(std::min(target - poolSize, MAX_FILL_PER_MAINTENANCE));
     }
-    else if (percentage > m_PoolSizeUpperBoundPC && m_CurrentPoolSize.load() > m_MinBufferSize)
+    else if (poolSize > target && poolSize > totalCount * m_PoolSizeUpperBoundPC)
     {
         RemoveHead();
     }
@@ -77,44 +115,36 @@ void ObjectPool::SetPoolSizeBoundPercentages(float lower, float upper)
 }
 void ObjectPool::RemoveHead()
 {
-    auto oldHead = std::atomic_load(&m_Head);
-    do
+    GameObject* obj = PopHead();
+    if (obj == nullptr)
     {
-        if (!oldHead)
-        {
-            return;
-        }
+        return;
     }
-    while (!std::atomic_compare_exchange_weak(&m_Head, &oldHead, oldHead->Next));
-
-    m_CurrentPoolSize.fetch_sub(1);
+    // nothing else refers to a pooled object, it left the active objects before it was returned (see Gamestate::CleanUp)
+    m_Registry.Destroy(obj->GetHandle());
     m_TotalObjectCount.fetch_sub(1);
 }
 
-ObjectPool* ObjectPoolManager::CreatePool(const std::string& poolName, const std::shared_ptr<GameObject>& prefab, int countIncreasePerExpansion, int initialAllocationCount, float lowerBoundPC, float upperBoundPC)
+ObjectPool* ObjectPoolManager::CreatePool(const std::string& poolName, std::unique_ptr<GameObject> prefab, int countIncreasePerExpansion, int initialAllocationCount, float lowerBoundPC, float upperBoundPC)
 {
-    m_Pools[poolName] = std::make_unique<ObjectPool>(prefab, countIncreasePerExpansion, initialAllocationCount, lowerBoundPC, upperBoundPC);
-    m_PoolIterator = m_Pools.begin();
+    m_Pools[poolName] = std::make_unique<ObjectPool>(m_Registry, std::move(prefab), countIncreasePerExpansion, initialAllocationCount, lowerBoundPC, upperBoundPC);
     return m_Pools[poolName].get();
 }
 
-std::shared_ptr<GameObject> ObjectPoolManager::GetPooledObject(const std::string& PoolName)
+GameObject* ObjectPoolManager::GetPooledObject(const std::string& PoolName)
 {
     return m_Pools[PoolName]->GetPooledObject();
 }
 
-void ObjectPoolManager::ReturnToPool(std::shared_ptr<GameObject> obj, const std::string& poolName)
+void ObjectPoolManager::ReturnToPool(GameObject* obj, const std::string& poolName)
 {
     m_Pools[poolName]->AddToPool(obj);
 }
 void ObjectPoolManager::MaintainPoolBuffers(uintptr_t _unused)
 {
-    // note that it's fine for multiple threads to be maintaining the same pool and hence for this itr to loop around
-    std::unique_lock<std::mutex> lock(m_MaintenanceMutex);
-    auto itr = m_PoolIterator++;
-    if (m_PoolIterator == m_Pools.end())
+    // every pool each run, the upkeep scheduler decides how often that is and keeps it within the frame's budget
+    for (auto& pool : m_Pools)
     {
-        m_PoolIterator = m_Pools.begin();
+        pool.second->MaintainPoolBuffer();
     }
-    itr->second->MaintainPoolBuffer();
 }
\ No newline at end of file
@@ -1,13 +1,15 @@
 #pragma once
 #include "Top.h"
+#include "JobCoroutine.h"
+#include "ObjectRegistry.h"
 #include <atomic>
 #include <memory>
 #include <unordered_map>
-#include <mutex>
 
 class GameObject;
 
 // thread-safe lock-free object pool, uses linked list with atomic removal and insertion at the head, allows dynamic pool size adjustments based on config params
+// the objects are owned by the registry, the pool only links their slots together, so nothing here touches a refcount
 class ObjectPool
 {
 public:
@@ -18,36 +20,47 @@ public:
     ObjectPool& operator=(ObjectPool&&) noexcept = delete;
 
     // pool must be created with a prefab, and optional args for how the pool should function and be maintained
-    ObjectPool(const std::shared_ptr<GameObject>& prefab, int countIncreasePerExpansion = 3, int initialAllocationCount = 10, float lowerBoundPC = 0.2f, float upperBoundPC = 0.5f);
+    ObjectPool(ObjectRegistry& registry, std::unique_ptr<GameObject> prefab, int countIncreasePerExpansion = 3, int initialAllocationCount = 10, float lowerBoundPC = 0.2f, float upperBoundPC = 0.5f);
     
     // objects in/out - thread-safe, lock-free insertion and removal
-    std::shared_ptr<GameObject> GetPooledObject();
-    void AddToPool(std::shared_ptr<GameObject>& Object);
+    GameObject* GetPooledObject();
+    void AddToPool(GameObject* obj);
     
-    // upkeep job
+    // upkeep job - tops the pool up to cover the recent peak demand in one go, so a burst of spawns finds the objects already there
+    // rather than cloning on the spawning thread, and trims it back one object at a time
     void MaintainPoolBuffer();
     
     // change bounds at runtime in anticipation of higher or lower requirements for the forseeable future
     void SetPoolSizeBoundPercentages(float lower, float upper);
     void FillPool(int count);
 private:
-    // node stores object and sharedptr to next - using sharedptr avoids any ABA problems with reallocation
-    struct Node
-    {
-        std::shared_ptr<GameObject> Object;
-        std::shared_ptr<Node> Next;
-        Node(std::shared_ptr<GameObject> _Object, std::shared_ptr<Node> _Next) : Object(_Object), Next(_Next) {}
-    };
-    
+    ObjectRegistry& m_Registry;
+
     // whenever the pool is expanded, copy the prefab to make new objects (T must derive from GameObject)
-    std::shared_ptr<GameObject> m_Prefab;
+    std::unique_ptr<GameObject> m_Prefab;
     
-    // head of linked list storing all inactive objects - must ONLY be used as if it's atomic
-    std::shared_ptr<Node> m_Head;
+    // head of the linked list storing all inactive objects, the registry index of the first object in the low 32 bits (each object's link to
+    // the next is ObjectRegistry::PoolLink) and a tag in the high 32 bits which changes on every push and pop, so a thread which read the head
+    // before another popped it and pushed it back fails its exchange rather than linking in a stale next (the ABA problem)
+    static const uint64_t EMPTY = ObjectRegistry::NONE;
+    std::atomic<uint64_t> m_Head{ EMPTY };
+    static uint64_t MakeHead(uint64_t oldHead, uint32_t index) { return ((oldHead >> 32) + 1) << 32 | index; }
+    // pops the head, nullptr if the pool is empty
+    GameObject* PopHead();
+    // a new object for the pool, owned by the registry
+    GameObject* CloneFromPrefab();
     
     // atomic counts to keep track for maintaining pool size
     std::atomic<int> m_TotalObjectCount;
     std::atomic<int> m_CurrentPoolSize;
+
+    // demand tracking - objects taken since the last maintenance, and a slowly decaying peak of that (only touched by maintenance, which
+    // the upkeep scheduler never runs on two threads at once)
+    std::atomic<int> m_TakenSinceMaintenance{ 0 };
+    float m_RecentDemand = 0.f;
+    static constexpr float DEMAND_DECAY = 0.98f;
+    static constexpr float DEMAND_HEADROOM = 2.f;
+    static const int MAX_FILL_PER_MAINTENANCE = 32;
     
     // pool config settings
     const int m_CountIncreasePerExpansion = 3;
@@ -55,6 +68,10 @@ private:
     float m_PoolSizeUpperBoundPC = .1f;
     float m_PoolSizeLowerBoundPC = .2f;
 
+    // set while a background refill is on its way, so an empty pool only starts one at a time
+    std::atomic<bool> m_RefillPending{ false };
+    JobSystem::Coroutine RefillInBackground(int count);
+
     void RemoveHead();
 };
 
@@ -64,13 +81,14 @@ class ObjectPoolManager
 private:
     typedef std::unordered_map<std::string, std::unique_ptr<ObjectPool>> MapOfPools;
     MapOfPools m_Pools;
-    std::mutex m_MaintenanceMutex;
-    MapOfPools::iterator m_PoolIterator;
+    ObjectRegistry& m_Registry;
 public:
-    ObjectPool* CreatePool(const std::string& poolName, const std::shared_ptr<GameObject>& prefab, int countIncreasePerExpansion, int initialAllocationCount, float lowerBoundPC = 0.2f, float upperBoundPC = 0.5f);
+    ObjectPoolManager(ObjectRegistry& registry) : m_Registry(registry) {}
+
+    ObjectPool* CreatePool(const std::string& poolName, std::unique_ptr<GameObject> prefab, int countIncreasePerExpansion, int initialAllocationCount, float lowerBoundPC = 0.2f, float upperBoundPC = 0.5f);
 
-    std::shared_ptr<GameObject> GetPooledObject(const std::string& PoolName);
-    void ReturnToPool(std::shared_ptr<GameObject> obj, const std::string& poolName);
+    GameObject* GetPooledObject(const std::string& PoolName);
+    void ReturnToPool(GameObject* obj, const std::string& poolName);
     void MaintainPoolBuffers(uintptr_t _unused);
 };
 
@@ -0,0 +1,82 @@
+#include "ObjectRegistry.h"
+#include "GameObject.h"
+#include "Components.h"
+
+ObjectRegistry::~ObjectRegistry()
+{
+	for (int i = 0; i < MAX_BLOCKS; ++i)
+	{
+		Slot* block = m_Blocks[i].load();
+		if (block == nullptr)
+		{
+			break;
+		}
+		for (uint32_t j = 0; j < BLOCK_SIZE; ++j)
+		{
+			delete block[j].Object.load();
+		}
+		delete[] block;
+	}
+}
+
+ObjectHandle ObjectRegistry::Register(std::unique_ptr<GameObject> obj)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	uint32_t index = m_FreeHead;
+	if (index != NONE)
+	{
+		m_FreeHead = SlotAt(index).NextFree;
+	}
+	else
+	{
+		index = m_SlotCount++;
+		assert((index >> BLOCK_BITS) < MAX_BLOCKS);
+		if ((index & (BLOCK_SIZE - 1)) == 0)
+		{
+			m_Blocks[index >> BLOCK_BITS].store(new Slot[BLOCK_SIZE], std::memory_order_release);
+		}
+	}
+	Slot& slot = SlotAt(index);
+	ObjectHandle handle = { index, slot.Generation.load(std::memory_order_relaxed) };
+	obj->SetHandle(handle);
+	slot.Object.store(obj.release(), std::memory_order_release);
+	return handle;
+}
+
+void ObjectRegistry::Destroy(ObjectHandle handle)
+{
+	GameObject* obj = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (Get(handle) == nullptr)
+		{
+			return;
+		}
+		Slot& slot = SlotAt(handle.Index);
+		// stale before the object goes, so a lookup either gets it or nothing
+		slot.Generation.fetch_add(1, std::memory_order_release);
+		obj = slot.Object.exchange(nullptr, std::memory_order_acq_rel);
+		slot.NextFree = m_FreeHead;
+		m_FreeHead = handle.Index;
+	}
+	delete obj;
+}
+
+GameObject* ObjectRegistry::Get(ObjectHandle handle) const
+{
+	if (handle.Index >= static_cast<uint32_t>(MAX_BLOCKS) * BLOCK_SIZE)
+	{
+		return nullptr;
+	}
+	Slot* block = m_Blocks[handle.Index >> BLOCK_BITS].load(std::memory_order_acquire);
+	if (block == nullptr)
+	{
+		return nullptr;
+	}
+	const Slot& slot = block[handle.Index & (BLOCK_SIZE - 1)];
+	if (slot.Generation.load(std::memory_order_acquire) != handle.Generation)
+	{
+		return nullptr;
+	}
+	return slot.Object.load(std::memory_order_acquire);
+}
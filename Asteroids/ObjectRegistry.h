@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+class GameObject;
+
+// refers to a game object for as long as it exists - copying one is copying 64 bits rather than touching a refcount, and once the object is
+// destroyed the handle is stale rather than pointing at whatever reuses its slot, which ObjectRegistry::Get detects
+struct ObjectHandle
+{
+	uint32_t Index = UINT32_MAX;
+	uint32_t Generation = 0;
+	bool operator==(const ObjectHandle& other) const { return Index == other.Index && Generation == other.Generation; }
+};
+
+// owns every game object (other than the pools' prefabs) and maps handles to them
+// registering and destroying take a lock, they only happen when a pool grows or shrinks, looking up is lock-free from any thread - the slots
+// are in fixed blocks which are never moved or freed, so a lookup never reads freed memory however stale its handle is
+// destroying an object while another thread is still using it is still a bug, the pools only destroy objects nothing else refers to
+class ObjectRegistry
+{
+public:
+	static const uint32_t NONE = UINT32_MAX;
+
+	ObjectRegistry() = default;
+	ObjectRegistry(const ObjectRegistry&) = delete;
+	ObjectRegistry& operator=(const ObjectRegistry&) = delete;
+	~ObjectRegistry();
+
+	// takes ownership and gives the object its handle
+	ObjectHandle Register(std::unique_ptr<GameObject> obj);
+	// nothing happens if the handle is stale
+	void Destroy(ObjectHandle handle);
+	// nullptr if the handle is stale
+	GameObject* Get(ObjectHandle handle) const;
+	// unchecked, for an index the caller knows is live (e.g. an object sitting in its pool)
+	GameObject* GetAt(uint32_t index) const { return SlotAt(index).Object.load(std::memory_order_acquire); }
+
+	// one link per slot for the free list of whichever pool the object is sitting in, kept here rather than in the object so a pool can
+	// still read it after another thread has taken the object and the pool has destroyed it (see ObjectPool::GetPooledObject)
+	std::atomic<uint32_t>& PoolLink(uint32_t index) { return SlotAt(index).PoolLink; }
+
+private:
+	static const int BLOCK_BITS = 10;
+	static const uint32_t BLOCK_SIZE = 1 << BLOCK_BITS;
+	static const int MAX_BLOCKS = 1024;
+
+	struct Slot
+	{
+		std::atomic<GameObject*> Object{ nullptr };
+		// starts at 1 so a default handle never matches, bumped whenever the object is destroyed
+		std::atomic<uint32_t> Generation{ 1 };
+		std::atomic<uint32_t> PoolLink{ NONE };
+		// only touched under the lock
+		uint32_t NextFree = NONE;
+	};
+
+	std::atomic<Slot*> m_Blocks[MAX_BLOCKS] = {};
+	uint32_t m_SlotCount = 0;
+	uint32_t m_FreeHead = NONE;
+	std::mutex m_Mutex;
+
+	Slot& SlotAt(uint32_t index) const { return m_Blocks[index >> BLOCK_BITS].load(std::memory_order_acquire)[index & (BLOCK_SIZE - 1)]; }
+};
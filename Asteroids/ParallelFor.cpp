@@ -0,0 +1,77 @@
+#include "ParallelFor.h"
+#include <algorithm>
+
+namespace JobSystem
+{
+    ParallelForLoop::ParallelForLoop(RangeFunctionWrapper body, int grain, Priority priority, RangeCostWrapper cost)
+        : m_Body(body), m_Cost(cost), m_Grain(std::max(grain, 1)), m_Priority(priority)
+    {
+    }
+
+    Declaration ParallelForLoop::MakeJob()
+    {
+        return JobSystem::MakeJob([this] { Run(); }, m_Priority, nullptr, this);
+    }
+
+    void ParallelForLoop::Run()
+    {
+        assert(GetCurrentJobCounter() != nullptr);
+        if (m_Count <= 0)
+        {
+            return;
+        }
+        m_NumChunks = (m_Count + m_Grain - 1) / m_Grain;
+        if (m_Cost.func != nullptr)
+        {
+            // vector only reallocates if the range grows beyond anything seen before
+            m_CostPrefix.resize(m_NumChunks + 1);
+            m_CostPrefix[0] = 0.f;
+            for (int i = 0; i < m_NumChunks; ++i)
+            {
+                int begin = i * m_Grain;
+                m_CostPrefix[i + 1] = m_CostPrefix[i] + m_Cost.func(m_Cost.instance, begin, std::min(begin + m_Grain, m_Count));
+            }
+        }
+        SplitAndRun(0, m_NumChunks);
+    }
+
+    void ParallelForLoop::SplitAndRun(int firstChunk, int endChunk)
+    {
+        while (firstChunk < endChunk)
+        {
+            if (endChunk - firstChunk > 1 && HasIdleCapacity())
+            {
+                // the new job joins the counter of the one running now, which can't have reached zero since this job hasn't finished
+                int split = SplitPoint(firstChunk, endChunk);
+                Counter* pCounter = GetCurrentJobCounter();
+                pCounter->count.fetch_add(1);
+                KickJob(JobSystem::MakeJob([this, split, endChunk] { SplitAndRun(split, endChunk); }, m_Priority, pCounter, this));
+                endChunk = split;
+                continue;
+            }
+            int begin = firstChunk * m_Grain;
+            m_Body.func(m_Body.instance, begin, std::min(begin + m_Grain, m_Count));
+            ++firstChunk;
+        }
+    }
+
+    // split so both halves cost about the same, always leaving at least one chunk on each side
+    int ParallelForLoop::SplitPoint(int firstChunk, int endChunk) const
+    {
+        if (m_Cost.func == nullptr)
+        {
+            return firstChunk + (endChunk - firstChunk) / 2;
+        }
+        float half = (m_CostPrefix[firstChunk] + m_CostPrefix[endChunk]) * 0.5f;
+        int split = static_cast<int>(std::upper_bound(m_CostPrefix.begin() + firstChunk + 1, m_CostPrefix.begin() + endChunk, half) - m_CostPrefix.begin());
+        return std::min(std::max(split, firstChunk + 1), endChunk - 1);
+    }
+
+    void ParallelFor(int count, int grain, RangeFunctionWrapper body, RangeCostWrapper cost, Priority priority)
+    {
+        ParallelForLoop loop(body, grain, priority, cost);
+        loop.SetCount(count);
+        Declaration decl = loop.MakeJob();
+        WaitForCounter(KickBatch(1, &decl));
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "JobSystem.h"
+#include <vector>
+
+namespace JobSystem
+{
+    // body of a parallel loop, called with consecutive sub-ranges [begin, end) of the loop, possibly on several threads at once
+    struct RangeFunctionWrapper
+    {
+        void* instance;
+        void (*func)(void*, int, int);
+    };
+    template< typename T, void (T::* MemberFunction)(int, int) >
+    void RangeFunctionDispatcher(void* instance, int begin, int end)
+    {
+        (static_cast<T*>(instance)->*MemberFunction)(begin, end);
+    }
+
+    // optional cost hint, the relative cost of running the body over [begin, end) - only the ratios matter, so e.g. a count of the expensive
+    // elements in the range will do
+    struct RangeCostWrapper
+    {
+        void* instance;
+        float (*func)(const void*, int, int);
+    };
+    template< typename T, float (T::* MemberFunction)(int, int) const >
+    float RangeCostDispatcher(const void* instance, int begin, int end)
+    {
+        return (static_cast<const T*>(instance)->*MemberFunction)(begin, end);
+    }
+
+    // adaptive parallel loop over [0, count), split into chunks of at least grain elements
+    // nothing is split up front: whichever thread is running a range splits off the back half (by cost if there's a hint) as a new job only
+    // when nothing else is queued, i.e. when some other thread would otherwise go idle, and checks again after every chunk - so uneven element
+    // costs just lead to more splitting near the end rather than threads sitting at the barrier, and with no idle threads the loop runs as a
+    // few big ranges with no scheduling overhead
+    // split off ranges join the counter of the job which split them, so the loop is done exactly when that counter says the job is
+    // the loop object has to outlive the loop, in practice it's a member which is reused every frame (see Gamestate)
+    class ParallelForLoop
+    {
+    public:
+        ParallelForLoop(RangeFunctionWrapper body, int grain, Priority priority, RangeCostWrapper cost = { nullptr, nullptr });
+        ParallelForLoop(const ParallelForLoop&) = delete;
+        ParallelForLoop& operator=(const ParallelForLoop&) = delete;
+
+        // size of the range for the next run, only change it while the loop isn't running
+        void SetCount(int count) { m_Count = count; }
+        int GetCount() const { return m_Count; }
+
+        // must be called from inside a job, runs the whole loop as part of that job (the calling thread takes the first range)
+        void Run();
+        // a job which runs the loop, e.g. as the only job of a frame graph stage
+        Declaration MakeJob();
+
+    private:
+        RangeFunctionWrapper m_Body;
+        RangeCostWrapper m_Cost;
+        int m_Grain;
+        Priority m_Priority;
+        int m_Count = 0;
+
+        // set up by Run for the current count
+        int m_NumChunks = 0;
+        // prefix sum of the cost of each chunk, only used with a cost hint
+        std::vector<float> m_CostPrefix;
+
+        void SplitAndRun(int firstChunk, int endChunk);
+        int SplitPoint(int firstChunk, int endChunk) const;
+    };
+
+    // one off loop from any thread (job or not), blocks until every element is done - runs other jobs in the meantime like WaitForCounter
+    void ParallelFor(int count, int grain, RangeFunctionWrapper body, RangeCostWrapper cost = { nullptr, nullptr }, Priority priority = Priority::NORMAL);
+}
@@ -1,28 +1,52 @@
 #pragma once
 #include "Top.h"
 
-class ParticleSystem : public sf::Drawable, public sf::Transformable
+class RandomStream;
+
+// the particles are columns of floats in blocks of 8 so a block can be updated at once with AVX2, the vertices are only written to, once
+// per particle per update, straight after its block is updated
+// the vertices are double buffered like the entity store's transforms, an update writes the live half while the frozen one is drawn
+// blocks can be updated by different threads at once, as long as no two update the same block
+class ParticleSystem
 {
 public:
+	static const int BLOCK_SIZE = 8;
+
 	ParticleSystem(unsigned int count);
+	~ParticleSystem();
+	ParticleSystem(const ParticleSystem&) = delete;
+	ParticleSystem& operator=(const ParticleSystem&) = delete;
 
-	void SetEmitter(sf::Vector2f position);
-	void Update(sf::Time elapsed, int start, int end, float exhaustAngle);
-	size_t GetParticleCount() const { return m_Particles.size(); }
+	// ages and moves the particles of blocks [beginBlock, endBlock), respawning any that die at the emitter with a random velocity drawn from rng
+	void Update(float elapsedSeconds, int beginBlock, int endBlock, sf::Vector2f emitter, float exhaustAngle, RandomStream& rng);
+	size_t GetParticleCount() const { return m_Count; }
+	int GetBlockCount() const { return m_BlockCount; }
+	// the vertices just written become the frozen ones (for drawing) and the other half is written by the next update, returns the frozen
+	// half - O(1), only done in the snapshot stage once this frame's update is done
+	int FlipVertices();
+	const sf::VertexArray& GetVertices(int buffer) const { return m_Vertices[buffer]; }
 
 private:
-	struct Particle
-	{
-		sf::Vector2f velocity;
-		sf::Time lifetime;
-	};
-
-	std::vector<Particle> m_Particles;
-	sf::VertexArray m_Vertices;
-	sf::Time m_Lifetime;
-	sf::Vector2f m_Emitter;
-
-	virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const;
+	size_t m_Count;
+	int m_BlockCount;
+	// m_BlockCount * BLOCK_SIZE of each (the count rounded up to whole blocks, worked out once in the constructor), the ones past m_Count
+	// are updated along with the rest of their block but never drawn - all null with no particles
+	float* m_PosX = nullptr;
+	float* m_PosY = nullptr;
+	float* m_VelX = nullptr;
+	float* m_VelY = nullptr;
+	// seconds left
+	float* m_Lifetime = nullptr;
+	// 0 to 255
+	float* m_Alpha = nullptr;
+	sf::VertexArray m_Vertices[2];
+	int m_LiveVertices = 0;
+	float m_OneOverLifetime;
 
-	void ResetParticle(std::size_t index, float exhaustAngle);
-};
\ No newline at end of file
+#if USE_AVX2_SYSTEMS
+	// Update with AVX2, only called when the cpu has it (see CpuFeatures.h)
+	void UpdateAvx2(float elapsedSeconds, int beginBlock, int endBlock, sf::Vector2f emitter, float exhaustAngle, RandomStream& rng);
+#endif
+	void ResetParticle(int index, sf::Vector2f emitter, float exhaustAngle, RandomStream& rng);
+	void WriteVertices(int block);
+};
@@ -23,23 +23,23 @@ PlayerShip::PlayerShip(const PlayerShip& other) : GameObject(other)
     m_TimeSinceInvulnBegin = other.m_TimeSinceInvulnBegin;
     m_Lives = other.m_Lives;
 }
-void PlayerShip::HandleInputs(float deltaTime)
+void PlayerShip::HandleInputs(float deltaTime, float& rotation, float& velX, float& velY)
 {
     if (sf::Keyboard::isKeyPressed(sf::Keyboard::Left))
     {
-        RotateLeft(deltaTime);
+        RotateLeft(deltaTime, rotation);
     }
     else if (sf::Keyboard::isKeyPressed(sf::Keyboard::Right))
     {
-        RotateRight(deltaTime);
+        RotateRight(deltaTime, rotation);
     }
     if (sf::Keyboard::isKeyPressed(sf::Keyboard::Up))
     {
-        AccelerateForward(deltaTime);
+        AccelerateForward(deltaTime, rotation, velX, velY);
     }
     else if (sf::Keyboard::isKeyPressed(sf::Keyboard::Down))
     {
-        Decelerate(deltaTime);
+        Decelerate(deltaTime, rotation, velX, velY);
     }
     if (sf::Keyboard::isKeyPressed(sf::Keyboard::Space))
     {
@@ -64,35 +64,16 @@ void PlayerShip::HandleInputs(float deltaTime)
     }
 }
 
-void PlayerShip::Update(float deltaTime)
+void PlayerShip::Steer(float deltaTime, float& rotation, float& velX, float& velY)
 {
     // Inputs
-    HandleInputs(deltaTime);
+    HandleInputs(deltaTime, rotation, velX, velY);
 
     // Timers
     m_TimeSincelastProjectile += deltaTime;
     m_TimeSinceInvulnBegin += deltaTime;
     m_TimeSinceLightSwitch += deltaTime;
 
-    // Update position and wrap to screen if needed
-    sf::Vector2f newPos = m_Position + sf::Vector2f(m_VelX * deltaTime, m_VelY * deltaTime);
-    if (newPos.x < 0)
-    {
-        newPos.x += SCREEN_WIDTH;
-    }
-    else if (newPos.x > SCREEN_WIDTH) 
-    {
-        newPos.x -= SCREEN_WIDTH;
-    }
-    if (newPos.y < 0) 
-    { 
-        newPos.y += SCREEN_HEIGHT;
-    }
-    else if (newPos.y > SCREEN_HEIGHT)
-    {
-        newPos.y -= SCREEN_HEIGHT;
-    }
-
     if (m_LightMax)
     {
         m_LightTimer -= deltaTime;
@@ -112,24 +93,28 @@ void PlayerShip::Update(float deltaTime)
     {
         GetComponent<CollisionComponent>()->SetSelfTag(DefaultCollisionTagsSelf);
     }
-    m_Position = newPos;
-    Decay(deltaTime);
-    GetComponent<CollisionComponent>()->UpdateInCollisionGrid();
 }
 
-void PlayerShip::RotateLeft(float deltaTime)
+void PlayerShip::InitialiseEntity(EntityChunk& chunk, int row)
 {
-    m_Rotation -= deltaTime * m_RotationSpeed;
+    chunk.VelX[row] = m_VelX;
+    chunk.VelY[row] = m_VelY;
+    chunk.Drag[row] = m_DecayRate;
 }
-void PlayerShip::RotateRight(float deltaTime)
+
+void PlayerShip::RotateLeft(float deltaTime, float& rotation)
+{
+    rotation -= deltaTime * m_RotationSpeed;
+}
+void PlayerShip::RotateRight(float deltaTime, float& rotation)
 {
-    m_Rotation += deltaTime * m_RotationSpeed;
+    rotation += deltaTime * m_RotationSpeed;
 }
 
-void PlayerShip::AccelerateForward(float deltaTime)
+void PlayerShip::AccelerateForward(float deltaTime, float rotation, float& velX, float& velY)
 {
-    float new_x = m_VelX + deltaTime * std::sin(m_Rotation * TO_RADIANS) * m_Acceleration;
-    float new_y = m_VelY - deltaTime * std::cos(m_Rotation * TO_RADIANS) * m_Acceleration;
+    float new_x = velX + deltaTime * std::sin(rotation * TO_RADIANS) * m_Acceleration;
+    float new_y = velY - deltaTime * std::cos(rotation * TO_RADIANS) * m_Acceleration;
     float speedSquared = new_x * new_x + new_y * new_y;
     if (speedSquared > m_MaxSpeed * m_MaxSpeed)
     {
@@ -138,13 +123,13 @@ void PlayerShip::AccelerateForward(float deltaTime)
         new_x = (new_x / speed) * m_MaxSpeed;
         new_y = (new_y / speed) * m_MaxSpeed;
     }
-    m_VelX = new_x;
-    m_VelY = new_y;
+    velX = new_x;
+    velY = new_y;
 }
-void PlayerShip::Decelerate(float deltaTime)
+void PlayerShip::Decelerate(float deltaTime, float rotation, float& velX, float& velY)
 {
-    float new_x = m_VelX - deltaTime * std::sin(m_Rotation * TO_RADIANS) * m_Acceleration;
-    float new_y = m_VelY + deltaTime * std::cos(m_Rotation * TO_RADIANS) * m_Acceleration;
+    float new_x = velX - deltaTime * std::sin(rotation * TO_RADIANS) * m_Acceleration;
+    float new_y = velY + deltaTime * std::cos(rotation * TO_RADIANS) * m_Acceleration;
     float speedSquared = new_x * new_x + new_y * new_y;
     if (speedSquared > m_MaxSpeed * m_MaxSpeed)
     {
@@ -153,21 +138,16 @@ void PlayerShip::Decelerate(float deltaTime)
         new_x = (new_x / speed) * m_MaxSpeed;
         new_y = (new_y / speed) * m_MaxSpeed;
     }
-    m_VelX = new_x;
-    m_VelY = new_y;
-}
-
-void PlayerShip::Decay(float deltaTime)
-{
-    m_VelX -= (m_VelX > 0 ? 1 : -1) * m_DecayRate * deltaTime;
-    m_VelY -= (m_VelY > 0 ? 1 : -1) * m_DecayRate * deltaTime;
+    velX = new_x;
+    velY = new_y;
 }
 
 void PlayerShip::FireProjectile()
 {
-    std::shared_ptr<GameObject> proj = Gamestate::instance->GetPooledObject(ProjectilePoolName);
-    sf::Vector2f offset = sf::Vector2f(std::cos((m_Rotation+90) * TO_RADIANS) * 20, std::sin((m_Rotation+90) * TO_RADIANS) * 20);
-    proj->ReinitialiseObject(m_Position - offset, m_Rotation, proj);
+    GameObject* proj = Gamestate::instance->GetPooledObject(ProjectilePoolName);
+    float rotation = GetRotation();
+    sf::Vector2f offset = sf::Vector2f(std::cos((rotation+90) * TO_RADIANS) * 20, std::sin((rotation+90) * TO_RADIANS) * 20);
+    proj->ReinitialiseObject(GetPosition() - offset, rotation);
     m_TimeSincelastProjectile = 0;    
 }
 
@@ -187,13 +167,18 @@ void PlayerShip::HandleCollision(uint16_t otherTags)
         SetBothRotations(0);
         m_VelX = 0; 
         m_VelY = 0;
+        if (EntityChunk* chunk = GetEntityChunk())
+        {
+            chunk->VelX[GetEntityRow()] = 0;
+            chunk->VelY[GetEntityRow()] = 0;
+        }
         GetComponent<CollisionComponent>()->SetSelfTag(0);
         m_TimeSinceInvulnBegin = 0;
     }
 }
-std::shared_ptr<GameObject> PlayerShip::CloneToSharedPtr()
+std::unique_ptr<GameObject> PlayerShip::CloneToUniquePtr()
 {
-    std::shared_ptr<GameObject> obj = std::make_shared<PlayerShip>(*this);
-    obj->CloneComponentsFromOther(obj, this);
+    std::unique_ptr<GameObject> obj = std::make_unique<PlayerShip>(*this);
+    obj->CloneComponentsFromOther(this);
     return obj;
 }
@@ -7,6 +7,7 @@ class PlayerShip : public GameObject
 {
 private:
 	int m_Lives = 3;
+	// copied into the entity store when the ship becomes active, which is where it's steered and moved from then on
 	float m_VelX = 0;
 	float m_VelY = 0;
 	float m_ProjectileCD = .25f;
@@ -23,27 +24,29 @@ private:
 	float m_TimeSinceLightSwitch = 0.f;
 	bool m_LightMax = false;
 
-	// processes inputs, called at the start of update
-	void HandleInputs(float deltaTime);
+	// processes inputs, called at the start of Steer
+	void HandleInputs(float deltaTime, float& rotation, float& velX, float& velY);
 
 	// control changes
 	void FireProjectile();
-	void RotateLeft(float);
-	void RotateRight(float);
-	void AccelerateForward(float);
-	void Decelerate(float);
-
-	// velocity decays by a fixed amount
-	void Decay(float);
+	void RotateLeft(float, float& rotation);
+	void RotateRight(float, float& rotation);
+	void AccelerateForward(float, float rotation, float& velX, float& velY);
+	void Decelerate(float, float rotation, float& velX, float& velY);
 
 public:
 	PlayerShip(sf::Texture& _Texture);
 	PlayerShip(const PlayerShip&);
 
+	// inputs, timers and light, run every frame by the steering system on the ship's row in the entity store before it's moved
+	// (the velocity decays by a fixed amount through the store's drag)
+	void Steer(float deltaTime, float& rotation, float& velX, float& velY);
+
 	// overrides
-	void Update(float deltaTime) override;
+	EntityArchetype GetArchetype() const override { return EntityArchetype::Ship; }
+	void InitialiseEntity(EntityChunk& chunk, int row) override;
 	void HandleCollision(uint16_t otherTags) override;
-	std::shared_ptr<GameObject> CloneToSharedPtr() override;
+	std::unique_ptr<GameObject> CloneToUniquePtr() override;
 	void Reinitialise() override {}
 
 	void SetProjectileCD(float cd) { m_ProjectileCD = cd; }
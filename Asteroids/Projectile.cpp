@@ -16,43 +16,32 @@ Projectile::Projectile(const Projectile& other) : GameObject(other)
     m_VelY = other.m_VelY;
 }
 
-void Projectile::Update(float deltaTime)
+void Projectile::InitialiseEntity(EntityChunk& chunk, int row)
 {
-    if (!m_Active) return;
-    if (m_Position.x < 5.f || m_Position.x > SCREEN_WIDTH - 5.f || m_Position.y < 5.f || m_Position.y > SCREEN_HEIGHT - 5.f)
-    {
-        // remove if it goes off screen, does not wrap
-        SetInactive();
-        Gamestate::instance->AddToCleanupObjectsDelayed(GetComponent<CollisionComponent>()->GetParentSharedPtr());
-    }
-    else
-    {
-        m_Position.x += m_VelX * deltaTime;
-        m_Position.y -= m_VelY * deltaTime;
-    }
-    GetComponent<CollisionComponent>()->UpdateInCollisionGrid();
+    chunk.VelX[row] = m_VelX;
+    chunk.VelY[row] = m_VelY;
 }
 
 void Projectile::HandleCollision(uint16_t otherTags)
 {
     if (!GetActive()) { return; }
     SetInactive();
-    Gamestate::instance->AddToCleanupObjects(GetComponent<CollisionComponent>()->GetParentSharedPtr());
+    Gamestate::instance->AddToCleanupObjects(GetHandle());
 }
 
 void Projectile::CalculateXandYVelocity()
 {
-    m_VelX = m_Speed * sinf(m_Rotation * TO_RADIANS);
-    m_VelY = m_Speed * cosf(m_Rotation * TO_RADIANS);
+    m_VelX = m_Speed * sinf(GetRotation() * TO_RADIANS);
+    m_VelY = -m_Speed * cosf(GetRotation() * TO_RADIANS);
 }
 
 void Projectile::Reinitialise()
 {
     CalculateXandYVelocity();
 }
-std::shared_ptr<GameObject> Projectile::CloneToSharedPtr()
+std::unique_ptr<GameObject> Projectile::CloneToUniquePtr()
 {
-    std::shared_ptr<GameObject> obj = std::make_shared<Projectile>(*this);
-    obj->CloneComponentsFromOther(obj, this);
+    std::unique_ptr<GameObject> obj = std::make_unique<Projectile>(*this);
+    obj->CloneComponentsFromOther(this);
     return obj;
 }
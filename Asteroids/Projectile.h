@@ -5,6 +5,7 @@
 class Projectile : public GameObject
 {
 private:
+	// screen space (y down), copied into the entity store when the projectile becomes active
 	float m_VelX = 0;
 	float m_VelY = 0;
 	const float m_Speed = 500;
@@ -15,10 +16,11 @@ public:
 	Projectile(const Projectile& other);
 
 	// overrides
-	void Update(float deltaTime) override;
+	EntityArchetype GetArchetype() const override { return EntityArchetype::Projectile; }
+	void InitialiseEntity(EntityChunk& chunk, int row) override;
 	void HandleCollision(uint16_t otherTags) override;
 	void Reinitialise() override;
-	std::shared_ptr<GameObject> CloneToSharedPtr() override;
+	std::unique_ptr<GameObject> CloneToUniquePtr() override;
 
 	static const uint16_t DefaultCollisionTagsSelf;
 	static const uint16_t DefaultCollisionTagsOther;
@@ -0,0 +1,79 @@
+#include "Random.h"
+#include <algorithm>
+#include <cassert>
+#include <random>
+
+namespace
+{
+    // seeding only, spreads a 64 bit number over the state so nearby seeds and stream numbers still start far apart
+    uint64_t SplitMix64(uint64_t& x)
+    {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // the generator is stuck at zero if its whole state is
+    void FixZeroState(uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d)
+    {
+        if ((a | b | c | d) == 0)
+        {
+            a = 1;
+        }
+    }
+
+    uint64_t g_MasterSeed = 0;
+}
+
+RandomStream::RandomStream(uint64_t seed, uint64_t stream)
+{
+    uint64_t x = seed ^ (stream * 0xD1B54A32D192ED03ull);
+    uint64_t word = SplitMix64(x);
+    m_State[0] = static_cast<uint32_t>(word);
+    m_State[1] = static_cast<uint32_t>(word >> 32);
+    word = SplitMix64(x);
+    m_State[2] = static_cast<uint32_t>(word);
+    m_State[3] = static_cast<uint32_t>(word >> 32);
+    FixZeroState(m_State[0], m_State[1], m_State[2], m_State[3]);
+}
+
+int RandomStream::Int(int lower, int upper)
+{
+    if (lower > upper)
+    {
+        assert(false);
+        std::swap(lower, upper);
+    }
+    uint64_t range = static_cast<uint64_t>(static_cast<int64_t>(upper) - lower) + 1;
+    return static_cast<int>(lower + static_cast<int64_t>((Next() * range) >> 32));
+}
+
+namespace Random
+{
+    void Seed(uint64_t master)
+    {
+        if (master == 0)
+        {
+            // only here, once a run - this can be a syscall
+            std::random_device rd;
+            master = (static_cast<uint64_t>(rd()) << 32) | rd();
+        }
+        g_MasterSeed = master;
+    }
+
+    uint64_t GetMasterSeed()
+    {
+        return g_MasterSeed;
+    }
+
+    RandomStream MakeStream(Purpose purpose, uint64_t step, uint64_t id)
+    {
+        // each part is mixed in rather than packed into bits of its own, so no step count or id is too big to key by
+        uint64_t x = static_cast<uint64_t>(purpose);
+        uint64_t key = SplitMix64(x) ^ step;
+        key = SplitMix64(key) ^ id;
+        key = SplitMix64(key);
+        return RandomStream(g_MasterSeed, key);
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+
+// xoshiro128** (Blackman & Vigna) - a few shifts and xors a draw, no locks and no allocation, so it's fine in the middle of a job's loop
+// a stream is seeded from the master seed and its stream number, so any number of them can be made which don't overlap in practice and each
+// gives the same sequence for the same master seed and stream number
+// not thread-safe, a job makes its own keyed by what it's drawing for (Random::MakeStream) and draws from it on whatever thread it's on
+class RandomStream
+{
+public:
+    RandomStream() : RandomStream(0, 0) {}
+    RandomStream(uint64_t seed, uint64_t stream);
+
+    uint32_t Next()
+    {
+        uint32_t result = Rotl(m_State[1] * 5, 7) * 9;
+        uint32_t t = m_State[1] << 9;
+        m_State[2] ^= m_State[0];
+        m_State[3] ^= m_State[1];
+        m_State[1] ^= m_State[2];
+        m_State[0] ^= m_State[3];
+        m_State[2] ^= t;
+        m_State[3] = Rotl(m_State[3], 11);
+        return result;
+    }
+    // in [lower, upper], both inclusive - multiply and shift rather than rejecting, so very slightly uneven for huge ranges
+    int Int(int lower, int upper);
+    // in [0, 1), from the top 24 bits so every value is exactly representable
+    float Float() { return (Next() >> 8) * (1.f / 16777216.f); }
+    // in [lower, upper)
+    float Float(float lower, float upper) { return lower + Float() * (upper - lower); }
+
+private:
+    uint32_t m_State[4];
+
+    static uint32_t Rotl(uint32_t x, int k) { return (x << k) | (x >> (32 - k)); }
+};
+
+namespace Random
+{
+    // sets the master seed every stream is made from, 0 picks a new one from std::random_device - call before anything draws (see
+    // Gamestate::BeginPlay)
+    void Seed(uint64_t master);
+    uint64_t GetMasterSeed();
+
+    // what a keyed stream is drawn for, so two draws keyed by the same step and id (an asteroid's spawn point and its drift) still differ
+    enum class Purpose : uint8_t
+    {
+        Particles,
+        AsteroidSpawn,
+        AsteroidDrift,
+    };
+    // a stream of the caller's own keyed by what it's for, the simulation step and an id (an object's handle, the start of a parallel loop's
+    // range), so its values depend on nothing but the master seed and the key, not on the thread that draws them
+    RandomStream MakeStream(Purpose purpose, uint64_t step, uint64_t id);
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// refers to one value in a slot map for as long as it's in there - removing the value (or anything else) never moves what a handle points at,
+// and once the value is removed the handle is stale rather than pointing at whatever reuses the slot
+struct SlotHandle
+{
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+};
+
+// values packed into one contiguous array, so iterating or splitting them between jobs is plain indexing, with O(1) add and remove through
+// stable handles - removing moves the last value into the gap, so dense indices (and the order) change but handles don't
+// not thread-safe, changes are made by one thread at a time (see Gamestate::CleanUp)
+template<typename T>
+class SlotMap
+{
+    static const uint32_t NONE = UINT32_MAX;
+
+    // a slot in use holds the dense index of its value, a free one holds the next free slot
+    struct Slot
+    {
+        uint32_t denseOrNextFree;
+        uint32_t generation;
+    };
+
+    std::vector<T> m_Dense;
+    std::vector<uint32_t> m_DenseToSlot;
+    std::vector<Slot> m_Slots;
+    uint32_t m_FreeHead = NONE;
+
+public:
+    SlotHandle Add(T value)
+    {
+        uint32_t slot = m_FreeHead;
+        if (slot != NONE)
+        {
+            m_FreeHead = m_Slots[slot].denseOrNextFree;
+        }
+        else
+        {
+            slot = static_cast<uint32_t>(m_Slots.size());
+            m_Slots.push_back({ NONE, 0 });
+        }
+        m_Slots[slot].denseOrNextFree = static_cast<uint32_t>(m_Dense.size());
+        m_Dense.push_back(std::move(value));
+        m_DenseToSlot.push_back(slot);
+        return { slot, m_Slots[slot].generation };
+    }
+
+    // false (and nothing removed) if the handle is stale
+    bool Remove(SlotHandle handle)
+    {
+        if (!Contains(handle))
+        {
+            return false;
+        }
+        uint32_t dense = m_Slots[handle.index].denseOrNextFree;
+        uint32_t last = static_cast<uint32_t>(m_Dense.size()) - 1;
+        if (dense != last)
+        {
+            m_Dense[dense] = std::move(m_Dense[last]);
+            m_DenseToSlot[dense] = m_DenseToSlot[last];
+            m_Slots[m_DenseToSlot[dense]].denseOrNextFree = dense;
+        }
+        m_Dense.pop_back();
+        m_DenseToSlot.pop_back();
+        ++m_Slots[handle.index].generation;
+        m_Slots[handle.index].denseOrNextFree = m_FreeHead;
+        m_FreeHead = handle.index;
+        return true;
+    }
+
+    bool Contains(SlotHandle handle) const
+    {
+        // removing bumps the generation, so a free slot never matches a handle which was given out
+        return handle.index < m_Slots.size() && m_Slots[handle.index].generation == handle.generation;
+    }
+    // nullptr if the handle is stale
+    T* Get(SlotHandle handle)
+    {
+        return Contains(handle) ? &m_Dense[m_Slots[handle.index].denseOrNextFree] : nullptr;
+    }
+
+    // dense access, indices run from 0 to Size() - 1 and are only valid until the next add or remove
+    int Size() const { return static_cast<int>(m_Dense.size()); }
+    T& operator[](int dense) { return m_Dense[dense]; }
+    const T& operator[](int dense) const { return m_Dense[dense]; }
+    SlotHandle HandleAt(int dense) const
+    {
+        uint32_t slot = m_DenseToSlot[dense];
+        return { slot, m_Slots[slot].generation };
+    }
+    typename std::vector<T>::iterator begin() { return m_Dense.begin(); }
+    typename std::vector<T>::iterator end() { return m_Dense.end(); }
+    typename std::vector<T>::const_iterator begin() const { return m_Dense.begin(); }
+    typename std::vector<T>::const_iterator end() const { return m_Dense.end(); }
+};
@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <type_traits>
+
+// bounded lock-free multi-producer buffer for deferring work to a later point (e.g. jobs for the next phase/stage)
+// producers claim a slot with a single fetch_add and write into it, no locks and no contention beyond that one cache line
+// if the buffer is full the item goes into a mutex protected overflow vector instead, so nothing is ever dropped
+// Consume must only be called once every producer is done (e.g. after the counter of every job which could add to it has hit zero, which
+// is what publishes the writes), it hands out the items as at most two contiguous arrays then empties the buffer in O(1)
+template<typename T>
+class SubmissionBuffer
+{
+    static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+
+    alignas(64) std::atomic<int> m_Claimed{ 0 };
+    int m_Capacity;
+    std::unique_ptr<T[]> m_Slots;
+    std::mutex m_OverflowMutex;
+    std::vector<T> m_Overflow;
+
+public:
+    explicit SubmissionBuffer(int capacity = 1024) : m_Capacity(capacity), m_Slots(new T[capacity]) {}
+    SubmissionBuffer(const SubmissionBuffer&) = delete;
+    SubmissionBuffer& operator=(const SubmissionBuffer&) = delete;
+
+    // any thread
+    void Push(const T& item)
+    {
+        int index = m_Claimed.fetch_add(1, std::memory_order_relaxed);
+        if (index < m_Capacity)
+        {
+            m_Slots[index] = item;
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_OverflowMutex);
+        m_Overflow.push_back(item);
+    }
+    void Push(int count, const T items[])
+    {
+        int start = m_Claimed.fetch_add(count, std::memory_order_relaxed);
+        int inSlots = start >= m_Capacity ? 0 : (count < m_Capacity - start ? count : m_Capacity - start);
+        for (int i = 0; i < inSlots; ++i)
+        {
+            m_Slots[start + i] = items[i];
+        }
+        if (inSlots < count)
+        {
+            std::lock_guard<std::mutex> lock(m_OverflowMutex);
+            m_Overflow.insert(m_Overflow.end(), items + inSlots, items + count);
+        }
+    }
+
+    // only meaningful once producers are done
+    int Size() const
+    {
+        return m_Claimed.load(std::memory_order_relaxed);
+    }
+    bool Empty() const
+    {
+        return Size() == 0;
+    }
+
+    // consumer only, calls consume(count, items) for the slots and then the overflow (if any), then empties the buffer
+    template<typename Consumer>
+    void Consume(Consumer&& consume)
+    {
+        int claimed = m_Claimed.load(std::memory_order_acquire);
+        int inSlots = claimed < m_Capacity ? claimed : m_Capacity;
+        if (inSlots > 0)
+        {
+            consume(inSlots, m_Slots.get());
+        }
+        if (claimed > m_Capacity)
+        {
+            std::lock_guard<std::mutex> lock(m_OverflowMutex);
+            consume(static_cast<int>(m_Overflow.size()), m_Overflow.data());
+            m_Overflow.clear();
+        }
+        m_Claimed.store(0, std::memory_order_relaxed);
+    }
+    void Clear()
+    {
+        Consume([](int, const T*) {});
+    }
+};
@@ -6,6 +6,7 @@
 #include <iostream>
 #include <random>
 #include <set>
+#include "JobSystemConfig.h"
 
 #define USE_CPU_FOR_OCCLUDERS false
 #define FRAME_RATE_LIMIT 360
@@ -13,7 +14,24 @@
 #define SCREEN_WIDTH 1920
 #define SCREEN_HEIGHT 1920
 #define GRID_RESOLUTION 24
-#define NUM_THREADS 8
+// worker threads, 0 picks one per hardware thread left over after the main thread - can be overridden with --threads N
+#define DEFAULT_NUM_THREADS 0
+// pin each worker to its own core (--pin / --no-pin on the command line)
+#define PIN_WORKER_THREADS false
+// per-worker work-stealing deques, false falls back to the single global job queue for comparison
+#define USE_WORK_STEALING true
+// draw the previous frame while simulating the next (--pipelined / --no-pipelined on the command line, see Gamestate::BeginPlay)
+#define PIPELINE_FRAMES false
+// fixed simulation steps per second, drawing interpolates between them (--sim-rate N on the command line, 0 for one step per rendered frame)
+#define SIMULATION_RATE 120
+// master seed for every random stream (see Random.h), 0 picks a new one each run except in serial runs, which always use the same one -
+// --seed N on the command line, the seed is printed at startup so a serial run can be repeated (threaded ones only partly, see BeginPlay)
+#define RANDOM_SEED 0
+// particles in the ship's exhaust (--particles N on the command line) - 4000 update on one thread in about the time the old 2000 took
+#define PARTICLE_COUNT 4000
+// build versions of the entity systems and the particle update which take 8 rows at a time with AVX2, only run if the cpu has it (checked
+// at startup, see CpuFeatures.h, --no-avx2 to run the scalar loops anyway) - false leaves them out of the build
+#define USE_AVX2_SYSTEMS true
 #define M_PI 3.14159265
 const int PATCH_SIZE = SCREEN_WIDTH / GRID_RESOLUTION;
 
@@ -27,5 +45,3 @@ static_assert(PATCH_SIZE % 8 == 0);
 
 const float TO_RADIANS = 0.0174532f;
 const sf::Time MIN_FRAME_TIME = sf::seconds(1.f / FRAME_RATE_LIMIT);
-
-int random_int(int range_lower, int range_upper);
@@ -0,0 +1,106 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+// fixed capacity Chase-Lev work-stealing deque, one per worker thread
+// the owning thread pushes and pops at the bottom (LIFO, stays hot in cache), any other thread can steal from the top (FIFO)
+// only the owner may call Push/Pop, Steal is safe from any thread, T must be trivially copyable since a thief can read a slot
+// that loses the race for it, the value is simply discarded in that case
+// no growth - Push returns false when full and the caller is expected to fall back to a shared queue
+template<typename T, int64_t Capacity = 4096>
+class WorkStealingDeque
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+    static const int64_t Mask = Capacity - 1;
+
+    // top and bottom are on separate cache lines, thieves hammer top, the owner hammers bottom
+    alignas(64) std::atomic<int64_t> m_Top{ 0 };
+    alignas(64) std::atomic<int64_t> m_Bottom{ 0 };
+    alignas(64) T m_Buffer[Capacity];
+
+public:
+    WorkStealingDeque() = default;
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // owner only
+    bool Push(const T& item)
+    {
+        int64_t b = m_Bottom.load(std::memory_order_relaxed);
+        int64_t t = m_Top.load(std::memory_order_acquire);
+        if (b - t >= Capacity)
+        {
+            return false;
+        }
+        m_Buffer[b & Mask] = item;
+        std::atomic_thread_fence(std::memory_order_release);
+        m_Bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // owner only, pushes as many as will fit and returns how many were pushed, publishes them all with a single store
+    int PushRange(int count, const T items[])
+    {
+        int64_t b = m_Bottom.load(std::memory_order_relaxed);
+        int64_t t = m_Top.load(std::memory_order_acquire);
+        int64_t space = Capacity - (b - t);
+        int pushed = static_cast<int>(count < space ? count : space);
+        for (int i = 0; i < pushed; ++i)
+        {
+            m_Buffer[(b + i) & Mask] = items[i];
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        m_Bottom.store(b + pushed, std::memory_order_relaxed);
+        return pushed;
+    }
+
+    // owner only
+    bool Pop(T& out)
+    {
+        int64_t b = m_Bottom.load(std::memory_order_relaxed) - 1;
+        m_Bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_Top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            // empty, restore
+            m_Bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        out = m_Buffer[b & Mask];
+        if (t != b)
+        {
+            // more than one item left, no thief can reach this one
+            return true;
+        }
+        // last item, race any thieves for it
+        bool won = m_Top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        m_Bottom.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+
+    // any thread
+    bool Steal(T& out)
+    {
+        int64_t t = m_Top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_Bottom.load(std::memory_order_acquire);
+        if (t >= b)
+        {
+            return false;
+        }
+        out = m_Buffer[t & Mask];
+        return m_Top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    // approximate, only used for heuristics
+    int64_t Size() const
+    {
+        int64_t b = m_Bottom.load(std::memory_order_relaxed);
+        int64_t t = m_Top.load(std::memory_order_relaxed);
+        return b > t ? b - t : 0;
+    }
+};
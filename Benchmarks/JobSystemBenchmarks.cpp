@@ -0,0 +1,523 @@
+// microbenchmarks for the job system on its own, no SFML and no game - builds on plain Linux (see the Makefile)
+// each result is one line of JSON on stdout (and in the --out file), so runs from before and after a scheduler change can be diffed or plotted
+//
+//   JobSystemBenchmarks [--mode work_stealing|global_queue|serial|all] [--workers N] [--quick] [--trace] [--out results.jsonl]
+//
+// empty_job_throughput  - cost per job of kicking and running jobs which do nothing, one at a time, as one batch, and kicked from inside jobs
+// fanout_latency        - time from KickJobs to the first job starting and to every job having started, with the workers asleep beforehand
+// next_phase_cost       - time for NextPhase to swap the buffers and kick what was buffered, against how many jobs were buffered
+// wait_wake_latency     - time from the last job finishing to a thread parked in WaitForCounter running again
+// contention_scaling    - throughput of tiny jobs for 1 to N workers, kicked from the main thread and spawned by other jobs
+// coroutine_frames      - coroutines started on one thread and finished on another, cost per coroutine and how many frame blocks that
+//                         took (it should stay at one batch's worth however many rounds run, the run fails if it doesn't)
+#include "JobSystem.h"
+#include "JobTrace.h"
+#include "JobCoroutine.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        std::vector<JobSystem::SchedulerMode> Modes;
+        int MaxWorkers = 0;
+        bool Quick = false;
+        bool Trace = false;
+        std::string OutPath;
+    };
+
+    Options g_Options;
+    FILE* g_pOut = nullptr;
+    const char* g_ModeName = "";
+    int g_Workers = 0;
+
+    long long NowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void SpinFor(long long ns)
+    {
+        long long end = NowNs() + ns;
+        while (NowNs() < end)
+        {
+        }
+    }
+
+    // samples are sorted in place
+    long long Percentile(std::vector<long long>& samples, double p)
+    {
+        if (samples.empty())
+        {
+            return 0;
+        }
+        std::sort(samples.begin(), samples.end());
+        size_t index = static_cast<size_t>(p * (samples.size() - 1) + 0.5);
+        return samples[std::min(index, samples.size() - 1)];
+    }
+
+    void Emit(const char* benchmark, const char* variant, long long param, const char* metric, double value, const char* unit)
+    {
+        char line[512];
+        snprintf(line, sizeof(line),
+            "{\"benchmark\":\"%s\",\"variant\":\"%s\",\"mode\":\"%s\",\"workers\":%d,\"param\":%lld,\"metric\":\"%s\",\"value\":%.3f,\"unit\":\"%s\"}\n",
+            benchmark, variant, g_ModeName, g_Workers, param, metric, value, unit);
+        fputs(line, stdout);
+        if (g_pOut != nullptr)
+        {
+            fputs(line, g_pOut);
+        }
+    }
+
+    const char* ModeName(JobSystem::SchedulerMode mode)
+    {
+        switch (mode)
+        {
+        case JobSystem::SchedulerMode::GLOBAL_QUEUE: return "global_queue";
+        case JobSystem::SchedulerMode::WORK_STEALING: return "work_stealing";
+        case JobSystem::SchedulerMode::SERIAL: return "serial";
+        }
+        return "unknown";
+    }
+
+    void Start(JobSystem::SchedulerMode mode, int workers)
+    {
+        JobSystem::InitJobSystem(workers, mode);
+        // the trace is on by default, which would put its cost into every number
+        JobTrace::SetEnabled(g_Options.Trace);
+        g_ModeName = ModeName(mode);
+        g_Workers = JobSystem::GetNumWorkers();
+    }
+
+    void Stop()
+    {
+        JobSystem::ShutdownJobSystem();
+    }
+
+    // counters used directly (rather than through KickBatch) need an onComplete, otherwise the job which takes them to zero calls NextPhase
+    void NoOpOnComplete(void*, uintptr_t)
+    {
+    }
+    JobSystem::Counter* AllocBenchCounter(int count)
+    {
+        JobSystem::Counter* pCounter = JobSystem::AllocCounter();
+        pCounter->onComplete = { nullptr, &NoOpOnComplete };
+        pCounter->count.store(count);
+        return pCounter;
+    }
+
+    // lets the workers run out of work and go to sleep, so latencies include waking them as they would at the start of a frame
+    void LetWorkersSleep()
+    {
+        SpinFor(200000);
+    }
+
+    // EMPTY JOB THROUGHPUT ----
+
+    void BenchEmptyJobThroughput()
+    {
+        const int numJobs = g_Options.Quick ? 20000 : 200000;
+        std::vector<JobSystem::Declaration> decls(numJobs, JobSystem::MakeJob([] {}));
+
+        // KickJob one at a time, all on one counter
+        {
+            JobSystem::Counter* pCounter = AllocBenchCounter(numJobs);
+            long long start = NowNs();
+            for (JobSystem::Declaration decl : decls)
+            {
+                decl.m_pCounter = pCounter;
+                JobSystem::KickJob(decl);
+            }
+            JobSystem::WaitForCounter(pCounter);
+            long long elapsed = NowNs() - start;
+            JobSystem::FreeCounter(pCounter);
+            Emit("empty_job_throughput", "kick_job", numJobs, "ns_per_job", double(elapsed) / numJobs, "ns");
+            Emit("empty_job_throughput", "kick_job", numJobs, "jobs_per_sec", numJobs * 1e9 / elapsed, "jobs/s");
+        }
+
+        // one KickJobs call for the lot
+        {
+            long long start = NowNs();
+            JobSystem::WaitForCounter(JobSystem::KickBatch(numJobs, decls.data()));
+            long long elapsed = NowNs() - start;
+            Emit("empty_job_throughput", "kick_jobs_batch", numJobs, "ns_per_job", double(elapsed) / numJobs, "ns");
+            Emit("empty_job_throughput", "kick_jobs_batch", numJobs, "jobs_per_sec", numJobs * 1e9 / elapsed, "jobs/s");
+        }
+
+        // kicked from inside jobs, which is the worker's own deque when work stealing
+        {
+            static const int SPAWNERS = 64;
+            struct Spawn
+            {
+                JobSystem::Counter* pCounter;
+                int children;
+            } spawn = { nullptr, numJobs / SPAWNERS };
+            int total = SPAWNERS + spawn.children * SPAWNERS;
+            spawn.pCounter = AllocBenchCounter(total);
+            Spawn* pSpawn = &spawn;
+            JobSystem::Declaration spawner = JobSystem::MakeJob([pSpawn]
+            {
+                JobSystem::Declaration child = JobSystem::MakeJob([] {}, JobSystem::Priority::NORMAL, pSpawn->pCounter);
+                for (int i = 0; i < pSpawn->children; ++i)
+                {
+                    JobSystem::KickJob(child);
+                }
+            }, JobSystem::Priority::NORMAL, spawn.pCounter);
+            long long start = NowNs();
+            for (int i = 0; i < SPAWNERS; ++i)
+            {
+                JobSystem::KickJob(spawner);
+            }
+            JobSystem::WaitForCounter(spawn.pCounter);
+            long long elapsed = NowNs() - start;
+            JobSystem::FreeCounter(spawn.pCounter);
+            Emit("empty_job_throughput", "kick_from_jobs", total, "ns_per_job", double(elapsed) / total, "ns");
+            Emit("empty_job_throughput", "kick_from_jobs", total, "jobs_per_sec", total * 1e9 / elapsed, "jobs/s");
+        }
+    }
+
+    // FAN-OUT LATENCY ----
+
+    struct FanOutTimes
+    {
+        std::atomic<long long> FirstStartNs;
+        std::atomic<long long> LastStartNs;
+    };
+
+    void BenchFanOutLatency()
+    {
+        const int reps = g_Options.Quick ? 20 : 200;
+        const int fanOuts[] = { 1, std::max(g_Workers, 1), 4 * std::max(g_Workers, 1), 64, 512 };
+        FanOutTimes times;
+        FanOutTimes* pTimes = &times;
+        JobSystem::Declaration job = JobSystem::MakeJob([pTimes]
+        {
+            long long now = NowNs();
+            long long first = pTimes->FirstStartNs.load();
+            while (now < first && !pTimes->FirstStartNs.compare_exchange_weak(first, now))
+            {
+            }
+            long long last = pTimes->LastStartNs.load();
+            while (now > last && !pTimes->LastStartNs.compare_exchange_weak(last, now))
+            {
+            }
+        });
+        for (int fanOut : fanOuts)
+        {
+            std::vector<JobSystem::Declaration> decls(fanOut, job);
+            std::vector<long long> first, all;
+            for (int rep = 0; rep < reps; ++rep)
+            {
+                LetWorkersSleep();
+                times.FirstStartNs.store(LLONG_MAX);
+                times.LastStartNs.store(0);
+                long long kicked = NowNs();
+                JobSystem::WaitForCounter(JobSystem::KickBatch(fanOut, decls.data()));
+                first.push_back(times.FirstStartNs.load() - kicked);
+                all.push_back(times.LastStartNs.load() - kicked);
+            }
+            Emit("fanout_latency", "first_start", fanOut, "p50", double(Percentile(first, 0.5)), "ns");
+            Emit("fanout_latency", "first_start", fanOut, "p99", double(Percentile(first, 0.99)), "ns");
+            Emit("fanout_latency", "all_started", fanOut, "p50", double(Percentile(all, 0.5)), "ns");
+            Emit("fanout_latency", "all_started", fanOut, "p99", double(Percentile(all, 0.99)), "ns");
+        }
+    }
+
+    // NEXT PHASE COST ----
+
+    void BenchNextPhaseCost()
+    {
+        const int reps = g_Options.Quick ? 20 : 200;
+        const int depths[] = { 0, 16, 64, 256, 1024, 4096 };
+        JobSystem::Counter* pCounter = AllocBenchCounter(0);
+        for (int depth : depths)
+        {
+            std::vector<JobSystem::Declaration> decls(depth, JobSystem::MakeJob([] {}, JobSystem::Priority::NORMAL, pCounter));
+            std::vector<long long> samples;
+            for (int rep = 0; rep < reps; ++rep)
+            {
+                // what a stage does - buffer the next phase's jobs, then swap once the current one is done
+                JobSystem::AddJobsToBuffer(decls);
+                long long start = NowNs();
+                JobSystem::NextPhase(pCounter);
+                samples.push_back(NowNs() - start);
+                JobSystem::WaitForCounter(pCounter);
+            }
+            long long p50 = Percentile(samples, 0.5);
+            Emit("next_phase_cost", "swap_and_kick", depth, "p50", double(p50), "ns");
+            Emit("next_phase_cost", "swap_and_kick", depth, "p99", double(Percentile(samples, 0.99)), "ns");
+            if (depth > 0)
+            {
+                Emit("next_phase_cost", "swap_and_kick", depth, "p50_per_job", double(p50) / depth, "ns");
+            }
+        }
+        JobSystem::FreeCounter(pCounter);
+    }
+
+    // WAIT WAKE LATENCY ----
+
+    struct WakeTimes
+    {
+        std::atomic<bool> Started;
+        std::atomic<long long> FinishedNs;
+    };
+
+    void BenchWaitWakeLatency()
+    {
+        // nothing to wake in serial mode, the main thread runs the job itself
+        if (g_Workers == 0)
+        {
+            return;
+        }
+        const int reps = g_Options.Quick ? 50 : 500;
+        WakeTimes times;
+        WakeTimes* pTimes = &times;
+        JobSystem::Declaration job = JobSystem::MakeJob([pTimes]
+        {
+            pTimes->Started.store(true);
+            // long enough for the main thread to have parked
+            SpinFor(50000);
+            pTimes->FinishedNs.store(NowNs());
+        });
+        std::vector<long long> samples;
+        for (int rep = 0; rep < reps; ++rep)
+        {
+            times.Started.store(false);
+            JobSystem::CounterHandle handle = JobSystem::KickBatch(1, &job);
+            // make sure a worker has the job, otherwise the main thread would just run it while waiting
+            while (!times.Started.load())
+            {
+            }
+            JobSystem::WaitForCounter(handle);
+            samples.push_back(NowNs() - times.FinishedNs.load());
+        }
+        Emit("wait_wake_latency", "parked_main_thread", 1, "p50", double(Percentile(samples, 0.5)), "ns");
+        Emit("wait_wake_latency", "parked_main_thread", 1, "p99", double(Percentile(samples, 0.99)), "ns");
+        Emit("wait_wake_latency", "parked_main_thread", 1, "max", double(samples.back()), "ns");
+    }
+
+    // CONTENTION SCALING ----
+
+    void BenchContentionScaling(JobSystem::SchedulerMode mode)
+    {
+        const int numJobs = g_Options.Quick ? 20000 : 200000;
+        // a little work per job so there's something to scale, but small enough that the queues are the bottleneck
+        static const long long JOB_NS = 500;
+        JobSystem::Declaration job = JobSystem::MakeJob([] { SpinFor(JOB_NS); });
+        std::vector<JobSystem::Declaration> decls(numJobs, job);
+        int maxWorkers = mode == JobSystem::SchedulerMode::SERIAL ? 0 : JobSystem::ChooseWorkerCount(g_Options.MaxWorkers);
+        for (int workers = mode == JobSystem::SchedulerMode::SERIAL ? 0 : 1; workers <= maxWorkers; ++workers)
+        {
+            Start(mode, workers);
+            {
+                long long start = NowNs();
+                JobSystem::WaitForCounter(JobSystem::KickBatch(numJobs, decls.data()));
+                long long elapsed = NowNs() - start;
+                Emit("contention_scaling", "kick_from_main", numJobs, "jobs_per_sec", numJobs * 1e9 / elapsed, "jobs/s");
+            }
+            {
+                // each job kicks the next two until there are numJobs, so every thread is kicking as well as running
+                struct Tree
+                {
+                    JobSystem::Counter* pCounter;
+                    std::atomic<int> remaining;
+                    JobSystem::Declaration node;
+                } tree;
+                tree.pCounter = AllocBenchCounter(1);
+                tree.remaining.store(numJobs - 1);
+                Tree* pTree = &tree;
+                tree.node = JobSystem::MakeJob([pTree]
+                {
+                    SpinFor(JOB_NS);
+                    for (int child = 0; child < 2; ++child)
+                    {
+                        if (pTree->remaining.fetch_sub(1) <= 0)
+                        {
+                            break;
+                        }
+                        pTree->pCounter->count.fetch_add(1);
+                        JobSystem::KickJob(pTree->node);
+                    }
+                }, JobSystem::Priority::NORMAL, tree.pCounter);
+                long long start = NowNs();
+                JobSystem::KickJob(tree.node);
+                JobSystem::WaitForCounter(tree.pCounter);
+                long long elapsed = NowNs() - start;
+                JobSystem::FreeCounter(tree.pCounter);
+                Emit("contention_scaling", "spawned_by_jobs", numJobs, "jobs_per_sec", numJobs * 1e9 / elapsed, "jobs/s");
+            }
+            Stop();
+        }
+    }
+
+    // COROUTINE FRAMES ----
+
+    // suspends the coroutine and leaves its handle in the vector, for another thread to finish it
+    struct ParkAwaiter
+    {
+        std::vector<std::coroutine_handle<>>* pParked;
+
+        bool await_ready() const { return false; }
+        void await_suspend(std::coroutine_handle<> coroutine) { pParked->push_back(coroutine); }
+        void await_resume() {}
+    };
+
+    JobSystem::Coroutine ParkedCoroutine(std::vector<std::coroutine_handle<>>* pParked)
+    {
+        co_await ParkAwaiter{ pParked };
+    }
+
+    // returns false if the frames freed on the other thread weren't reused
+    bool BenchCoroutineFrames()
+    {
+        const int rounds = g_Options.Quick ? 2000 : 20000;
+        static const int BATCH = 64;
+        std::vector<std::coroutine_handle<>> parked;
+        parked.reserve(BATCH);
+        // 0 while this thread starts a batch, 1 while the other finishes it, 2 to stop
+        std::atomic<int> turn{ 0 };
+        std::thread finisher([&]
+        {
+            while (true)
+            {
+                int current;
+                while ((current = turn.load(std::memory_order_acquire)) == 0)
+                {
+                    std::this_thread::yield();
+                }
+                if (current == 2)
+                {
+                    return;
+                }
+                for (std::coroutine_handle<> coroutine : parked)
+                {
+                    coroutine.resume();
+                }
+                parked.clear();
+                turn.store(0, std::memory_order_release);
+            }
+        });
+        size_t blocksBefore = JobSystem::GetCoroutineFrameBlocks();
+        long long start = NowNs();
+        for (int round = 0; round < rounds; ++round)
+        {
+            for (int i = 0; i < BATCH; ++i)
+            {
+                ParkedCoroutine(&parked);
+            }
+            turn.store(1, std::memory_order_release);
+            while (turn.load(std::memory_order_acquire) != 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+        long long elapsed = NowNs() - start;
+        turn.store(2, std::memory_order_release);
+        finisher.join();
+        size_t blocks = JobSystem::GetCoroutineFrameBlocks() - blocksBefore;
+        Emit("coroutine_frames", "start_here_finish_there", BATCH, "ns_per_coroutine", double(elapsed) / (double(rounds) * BATCH), "ns");
+        Emit("coroutine_frames", "start_here_finish_there", BATCH, "frame_blocks", double(blocks), "blocks");
+        if (blocks > BATCH)
+        {
+            fprintf(stderr, "coroutine_frames: %zu frame blocks for batches of %d, frames freed on another thread aren't being reused\n", blocks, BATCH);
+            return false;
+        }
+        return true;
+    }
+
+    bool ParseMode(const char* name, std::vector<JobSystem::SchedulerMode>& modes)
+    {
+        if (strcmp(name, "work_stealing") == 0 || strcmp(name, "all") == 0)
+        {
+            modes.push_back(JobSystem::SchedulerMode::WORK_STEALING);
+        }
+        if (strcmp(name, "global_queue") == 0 || strcmp(name, "all") == 0)
+        {
+            modes.push_back(JobSystem::SchedulerMode::GLOBAL_QUEUE);
+        }
+        if (strcmp(name, "serial") == 0 || strcmp(name, "all") == 0)
+        {
+            modes.push_back(JobSystem::SchedulerMode::SERIAL);
+        }
+        return !modes.empty();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc)
+        {
+            if (!ParseMode(argv[++i], g_Options.Modes))
+            {
+                fprintf(stderr, "unknown mode %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+        {
+            g_Options.MaxWorkers = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+        {
+            g_Options.OutPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--quick") == 0)
+        {
+            g_Options.Quick = true;
+        }
+        else if (strcmp(argv[i], "--trace") == 0)
+        {
+            g_Options.Trace = true;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--mode work_stealing|global_queue|serial|all] [--workers N] [--quick] [--trace] [--out file]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (g_Options.Modes.empty())
+    {
+        ParseMode("all", g_Options.Modes);
+    }
+    if (!g_Options.OutPath.empty())
+    {
+        g_pOut = fopen(g_Options.OutPath.c_str(), "w");
+        if (g_pOut == nullptr)
+        {
+            fprintf(stderr, "couldn't open %s\n", g_Options.OutPath.c_str());
+            return 1;
+        }
+    }
+
+    // the benchmarks play the part of the main thread
+    ThreadIndex = 0;
+    for (JobSystem::SchedulerMode mode : g_Options.Modes)
+    {
+        Start(mode, g_Options.MaxWorkers);
+        BenchEmptyJobThroughput();
+        BenchFanOutLatency();
+        BenchNextPhaseCost();
+        BenchWaitWakeLatency();
+        Stop();
+        BenchContentionScaling(mode);
+    }
+    g_ModeName = "";
+    g_Workers = 0;
+    bool framesReused = BenchCoroutineFrames();
+
+    if (g_pOut != nullptr)
+    {
+        fclose(g_pOut);
+    }
+    return framesReused ? 0 : 1;
+}
@@ -0,0 +1,196 @@
+// what spawning an asteroid costs in random draws, before and after Random.h replaced random_int - the spawn stages can't be timed without the
+// game, so this times just the draws they make, from 1 to N threads at once as the collision stage's Split does in overdrive
+// each result is one line of JSON, like JobSystemBenchmarks
+//
+//   RandomBenchmarks [--threads N] [--quick] [--out results.jsonl]
+//
+// spawn_draws  - the draws of one SpawnLargeAsteroidOffscreen and the Asteroid::Reinitialise it calls (a side, a position, two drifts)
+//                old_random_int: a std::random_device and an mt19937 seeded from it for every draw, as random_int did
+//                keyed_streams:  a Random::MakeStream keyed by the step and the asteroid's handle for each of the two, as the game does now
+#include "Random.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        int MaxThreads = 0;
+        bool Quick = false;
+        std::string OutPath;
+    };
+
+    Options g_Options;
+    FILE* g_pOut = nullptr;
+
+    // the same bounds as the game's, only so the draws are the same sizes
+    const int SCREEN_WIDTH = 1920;
+    const int SCREEN_HEIGHT = 1080;
+
+    long long NowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void Emit(const char* benchmark, const char* variant, int threads, const char* metric, double value, const char* unit)
+    {
+        char line[512];
+        snprintf(line, sizeof(line), "{\"benchmark\":\"%s\",\"variant\":\"%s\",\"threads\":%d,\"metric\":\"%s\",\"value\":%.3f,\"unit\":\"%s\"}\n",
+            benchmark, variant, threads, metric, value, unit);
+        fputs(line, stdout);
+        if (g_pOut != nullptr)
+        {
+            fputs(line, g_pOut);
+        }
+    }
+
+    // the random_int the game had before Random.h, word for word bar the tabs
+    int OldRandomInt(int range_lower, int range_upper)
+    {
+        if (range_lower > range_upper) throw std::out_of_range("rand int bad");
+        if (range_upper == range_lower) return range_lower;
+        std::random_device rd;
+        std::mt19937 rng(rd());
+        std::uniform_int_distribution<std::mt19937::result_type> rnd_dist(range_lower, range_upper);
+        return rnd_dist(rng);
+    }
+
+    // returns something from the draws so they can't be optimised away
+    int OldSpawnDraws()
+    {
+        int side = OldRandomInt(0, 3);
+        int position = side < 2 ? OldRandomInt(0, SCREEN_WIDTH) : OldRandomInt(0, SCREEN_HEIGHT);
+        int xDrift = OldRandomInt(20, 80);
+        int yDrift = OldRandomInt(-80, -20);
+        return side + position + xDrift + yDrift;
+    }
+
+    int KeyedSpawnDraws(uint64_t step, uint64_t handle)
+    {
+        RandomStream spawn = Random::MakeStream(Random::Purpose::AsteroidSpawn, step, handle);
+        int side = spawn.Int(0, 3);
+        int position = side < 2 ? spawn.Int(0, SCREEN_WIDTH) : spawn.Int(0, SCREEN_HEIGHT);
+        RandomStream drift = Random::MakeStream(Random::Purpose::AsteroidDrift, step, handle);
+        int xDrift = drift.Int(20, 80);
+        int yDrift = drift.Int(-80, -20);
+        return side + position + xDrift + yDrift;
+    }
+
+    // spawnsPerThread on each of threads threads at once, returns the mean ns per spawn as one thread sees it
+    template <typename SpawnFunction>
+    double TimeSpawns(int threads, int spawnsPerThread, SpawnFunction spawn)
+    {
+        std::atomic<int> ready{ 0 };
+        std::atomic<bool> go{ false };
+        std::atomic<long long> totalNs{ 0 };
+        std::atomic<long long> sink{ 0 };
+        std::vector<std::thread> pool;
+        for (int t = 0; t < threads; ++t)
+        {
+            pool.emplace_back([&, t]()
+            {
+                ready.fetch_add(1);
+                while (!go.load())
+                {
+                }
+                long long sum = 0;
+                long long start = NowNs();
+                for (int i = 0; i < spawnsPerThread; ++i)
+                {
+                    // a handle per spawn, as no two asteroids spawned in one step share one
+                    sum += spawn(static_cast<uint64_t>(i / 64), (static_cast<uint64_t>(t) << 32) | static_cast<uint32_t>(i));
+                }
+                totalNs.fetch_add(NowNs() - start);
+                sink.fetch_add(sum);
+            });
+        }
+        while (ready.load() < threads)
+        {
+        }
+        go.store(true);
+        for (std::thread& thread : pool)
+        {
+            thread.join();
+        }
+        if (sink.load() == 42)
+        {
+            printf(" ");
+        }
+        return static_cast<double>(totalNs.load()) / (static_cast<double>(threads) * spawnsPerThread);
+    }
+
+    // SPAWN DRAWS ----
+
+    void BenchSpawnDraws()
+    {
+        int maxThreads = g_Options.MaxThreads > 0 ? g_Options.MaxThreads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        // random_device can be a syscall a draw, so the old way gets far fewer spawns in the same time
+        int oldSpawns = g_Options.Quick ? 2000 : 20000;
+        int newSpawns = g_Options.Quick ? 200000 : 2000000;
+        std::vector<int> threadCounts;
+        for (int threads = 1; threads < maxThreads; threads *= 2)
+        {
+            threadCounts.push_back(threads);
+        }
+        threadCounts.push_back(maxThreads);
+        for (int threads : threadCounts)
+        {
+            double oldNs = TimeSpawns(threads, oldSpawns, [](uint64_t, uint64_t) { return OldSpawnDraws(); });
+            double newNs = TimeSpawns(threads, newSpawns, &KeyedSpawnDraws);
+            Emit("spawn_draws", "old_random_int", threads, "ns_per_spawn", oldNs, "ns");
+            Emit("spawn_draws", "keyed_streams", threads, "ns_per_spawn", newNs, "ns");
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            g_Options.MaxThreads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+        {
+            g_Options.OutPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--quick") == 0)
+        {
+            g_Options.Quick = true;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--threads N] [--quick] [--out file]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!g_Options.OutPath.empty())
+    {
+        g_pOut = fopen(g_Options.OutPath.c_str(), "w");
+        if (g_pOut == nullptr)
+        {
+            fprintf(stderr, "couldn't open %s\n", g_Options.OutPath.c_str());
+            return 1;
+        }
+    }
+
+    // the seed doesn't change the cost, a fixed one keeps runs comparable
+    Random::Seed(12345);
+    BenchSpawnDraws();
+
+    if (g_pOut != nullptr)
+    {
+        fclose(g_pOut);
+    }
+    return 0;
+}